@@ -3,9 +3,15 @@
 base_env = Environment(CXX='clang++',
                        CXXFLAGS=['-Werror', '-Wall', '-Wpedantic', '-Wextra', '-g', '-std=c++17', '-I/home/alvar/include/'])
 base_env.Append(CPPPATH=['#'])
+# scons stats=0 compiles out the instrumentation of src/Stats.hpp.
+if ARGUMENTS.get('stats', '1') == '0':
+    base_env.Append(CPPDEFINES=['CALCULATOR_NO_STATS'])
 base_env['OBJPREFIX'] = '#/build/obj/' + base_env['OBJPREFIX']
 base_env['PROGPREFIX'] = '#/build/bin/' + base_env['PROGPREFIX']
 base_env['PROGSUFFIX'] = '.out'
 
-SConscript('src/SConscript.py', exports='base_env')
-# SConscript('tests/SConscript.py', exports='base_env')
+Default(SConscript('src/SConscript.py', exports='base_env'))
+# Built on request only: scons bench
+Alias('bench', SConscript('bench/SConscript.py', exports='base_env'))
+# Built on request only: scons test, which runs them too
+SConscript('tests/SConscript.py', exports='base_env')
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "src/Stats.hpp"
+
+namespace
+{
+
+std::string number(double value, int precision)
+{
+    char text[64];
+    std::snprintf(text, sizeof text, "%.*f", precision, value);
+    return text;
+}
+
+std::string quoted(std::string const& text)
+{
+    std::string result = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + '"';
+}
+
+}
+
+Benchmark::Benchmark(std::string name, setup prepare, std::uint64_t lines)
+    : name(std::move(name))
+    , prepare(std::move(prepare))
+    , lines(lines)
+{
+}
+
+std::string const& Benchmark::get_name() const
+{
+    return name;
+}
+
+Benchmark::Result Benchmark::run(double min_seconds) const
+{
+    body work = prepare();
+
+    Result result;
+    result.name = name;
+
+    std::uint64_t iterations = 1;
+    while (true)
+    {
+        std::uint64_t allocations_before = allocations();
+        auto start = std::chrono::steady_clock::now();
+        work(iterations);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::uint64_t allocations_during = allocations() - allocations_before;
+
+        if (seconds >= min_seconds || iterations >= (std::uint64_t(1) << 40))
+        {
+            double operations = double(iterations) * double(lines == 0 ? 1 : lines);
+            result.iterations = iterations;
+            result.ns_per_op = seconds * 1e9 / operations;
+            result.allocations_per_op = double(allocations_during) / operations;
+            if (lines != 0)
+            {
+                result.lines_per_second = operations / seconds;
+            }
+            return result;
+        }
+
+        // Aim a little past the target, growing at most a hundredfold so a
+        // first run made fast by cold caches can't overshoot it by much.
+        double scale = seconds > 0 ? min_seconds * 1.2 / seconds : 100;
+        iterations = std::max(iterations + 1, std::uint64_t(double(iterations) * std::min(scale, 100.0)));
+    }
+}
+
+std::string Benchmark::to_json(std::vector<Result> const& results)
+{
+    std::string json = "{\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        Result const& result = results[i];
+        json += i == 0 ? "\n" : ",\n";
+        json += "    {\"name\": " + quoted(result.name);
+        json += ", \"iterations\": " + std::to_string(result.iterations);
+        json += ", \"ns_per_op\": " + number(result.ns_per_op, 2);
+        json += ", \"allocations_per_op\": " + number(result.allocations_per_op, 3);
+        if (result.lines_per_second.has_value())
+        {
+            json += ", \"lines_per_s\": " + number(result.lines_per_second.value(), 0);
+        }
+        json += "}";
+    }
+    return json + "\n  ]\n}\n";
+}
+
+std::uint64_t Benchmark::allocations()
+{
+    return Stats::totals().counts[std::size_t(Stats::Counter::allocations)];
+}
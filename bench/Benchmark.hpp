@@ -0,0 +1,66 @@
+#ifndef GUARD_BENCHMARK_HPP
+#define GUARD_BENCHMARK_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A named piece of work that is timed by repeating it until it has run for
+// long enough. Setting up is kept out of the measurement: `setup` prepares
+// whatever state is needed and returns the body, which then does the work
+// `iterations` times each time it is called.
+//
+// Macrobenchmarks process `lines` lines of script each iteration. Their
+// operations are lines, and throughput is reported in lines per second too.
+class Benchmark
+{
+public:
+    using body = std::function<void(std::uint64_t iterations)>;
+    using setup = std::function<body()>;
+
+    struct Result
+    {
+        std::string name;
+        std::uint64_t iterations = 0;
+        double ns_per_op = 0;
+        double allocations_per_op = 0;
+        std::optional<double> lines_per_second;
+    };
+
+private:
+    std::string name;
+    setup prepare;
+    std::uint64_t lines;
+
+public:
+    Benchmark(std::string name, setup prepare, std::uint64_t lines = 0);
+
+    std::string const& get_name() const;
+
+    // Runs the body with more and more iterations until one run takes at
+    // least `min_seconds`, and reports that run.
+    Result run(double min_seconds) const;
+
+    static std::string to_json(std::vector<Result> const& results);
+
+    // Makes the compiler assume `value` is used, so computing it can't be
+    // optimized away.
+    template <typename T>
+    static void keep(T const& value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    // Number of calls to operator new so far, from every thread, as counted
+    // by Stats. Always 0 when those are compiled out.
+    static std::uint64_t allocations();
+};
+
+// Lists of benchmarks, defined next to the code that sets them up. Scripts
+// for the macrobenchmarks have `lines` lines.
+std::vector<Benchmark> micro_benchmarks();
+std::vector<Benchmark> macro_benchmarks(std::uint64_t lines);
+
+#endif
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Benchmark.hpp"
+#include "src/BatchRunner.hpp"
+#include "src/Calculator.hpp"
+#include "src/Numeric.hpp"
+#include "src/OutputBuffer.hpp"
+#include "src/ParallelRunner.hpp"
+
+// Macrobenchmarks replaying whole synthetic scripts in batch mode, each time
+// on a new calculator, with results written to /dev/null.
+
+namespace
+{
+
+// A generated script in a temporary file, removed with the object.
+class Script
+{
+public:
+    std::string path;
+    // Open on the file, for writing the script.
+    int fd;
+    int null_fd;
+
+public:
+    Script()
+        : path("/tmp/calculator-bench-XXXXXX")
+    {
+        fd = ::mkstemp(&path[0]);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+        null_fd = ::open("/dev/null", O_WRONLY);
+        if (null_fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "/dev/null");
+        }
+    }
+
+    Script(Script const&) = delete;
+
+    ~Script()
+    {
+        ::unlink(path.c_str());
+        ::close(fd);
+        ::close(null_fd);
+    }
+
+    Script& operator=(Script const&) = delete;
+};
+
+constexpr std::size_t symbols = 1024;
+
+// Defines v0 ... v1023, then mixes assignments, expressions reading a few
+// symbols, long operator chains and constant arithmetic. Assigned values
+// are kept small and divisors positive so every line succeeds.
+std::shared_ptr<Script> mixed_script(std::uint64_t lines)
+{
+    auto script = std::make_shared<Script>();
+
+    std::mt19937_64 random(42);
+    auto any = [&random] {
+        return "v" + std::to_string(random() % symbols);
+    };
+    auto constant = [&random] {
+        return long(random() % 1000);
+    };
+
+    {
+        OutputBuffer output(script->fd);
+        for (std::uint64_t line = 0; line < lines; line++)
+        {
+            std::string text;
+            if (line < symbols)
+            {
+                text = "v" + std::to_string(line) + " = " + std::to_string(line);
+            }
+            else
+            {
+                switch (random() % 10)
+                {
+                case 0:
+                case 1:
+                case 2:
+                case 3:
+                    text = any() + " = (" + any() + " + " + any() + " * " + std::to_string(constant()) + ") % 1000003";
+                    break;
+                case 4:
+                case 5:
+                case 6:
+                case 7:
+                    text = any() + " - " + any() + " / (" + any() + " % 7 + 1)";
+                    break;
+                case 8:
+                    text = any();
+                    for (int term = 0; term < 16; term++)
+                    {
+                        text += (term % 2 == 0 ? " + " : " - ") + any();
+                    }
+                    break;
+                default:
+                    text = std::to_string(constant()) + " * (" + std::to_string(constant()) + " + 3) - 1";
+                    break;
+                }
+            }
+            output.append(text);
+            output.append('\n');
+        }
+    }
+    return script;
+}
+
+// The same few lines over and over, which the result cache answers.
+std::shared_ptr<Script> repeated_script(std::uint64_t lines)
+{
+    auto script = std::make_shared<Script>();
+
+    static char const* const text[] = {"a = 12", "b = a * 3 + 1", "a * b - 7", "(a + b) * (a - b)", "b / a"};
+    {
+        OutputBuffer output(script->fd);
+        for (std::uint64_t line = 0; line < lines; line++)
+        {
+            output.append(text[line < 2 ? line : 2 + line % 3]);
+            output.append('\n');
+        }
+    }
+    return script;
+}
+
+template <typename Value>
+Benchmark::body batch(std::shared_ptr<Script> script)
+{
+    return [script](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; i++)
+        {
+            BasicCalculator<Value> calc;
+            BatchRunner runner(script->null_fd, script->null_fd);
+            Benchmark::keep(runner.run(calc, script->path));
+        }
+    };
+}
+
+template <typename Value>
+Benchmark::body parallel(std::shared_ptr<Script> script)
+{
+    return [script](std::uint64_t iterations) {
+        std::size_t jobs = std::max(2u, std::thread::hardware_concurrency());
+        for (std::uint64_t i = 0; i < iterations; i++)
+        {
+            BasicCalculator<Value> calc;
+            ParallelRunner<Value> runner(calc, jobs, script->null_fd, STDERR_FILENO);
+            Benchmark::keep(runner.run(script->path));
+        }
+    };
+}
+
+}
+
+std::vector<Benchmark> macro_benchmarks(std::uint64_t lines)
+{
+    return {
+        Benchmark("script/mixed", [lines] {
+            return batch<BigInt>(mixed_script(lines));
+        }, lines),
+        Benchmark("script/mixed_long", [lines] {
+            return batch<long>(mixed_script(lines));
+        }, lines),
+        Benchmark("script/mixed_parallel", [lines] {
+            return parallel<BigInt>(mixed_script(lines));
+        }, lines),
+        Benchmark("script/repeated", [lines] {
+            return batch<BigInt>(repeated_script(lines));
+        }, lines),
+    };
+}
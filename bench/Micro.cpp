@@ -0,0 +1,191 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "src/Calculator.hpp"
+#include "src/Compiler.hpp"
+#include "src/Lexer.hpp"
+#include "src/Numeric.hpp"
+
+// Microbenchmarks of single stages, on the calculator type the program uses
+// by default.
+
+namespace
+{
+
+using Value = BigInt;
+using Calc = BasicCalculator<Value>;
+
+std::string symbol(std::size_t i)
+{
+    return "v" + std::to_string(i);
+}
+
+// A calculator where v0 ... v(count - 1) are defined.
+std::shared_ptr<Calc> calculator_with(std::size_t count)
+{
+    auto calc = std::make_shared<Calc>();
+    for (std::size_t i = 0; i < count; i++)
+    {
+        calc->assign(symbol(i), Value(long(i)));
+    }
+    return calc;
+}
+
+// v0 + v1 * v2 - v3 + ... with `length` operands, cycling through the
+// operators so precedence is exercised too.
+std::string operator_chain(std::size_t length)
+{
+    static char const* const operators[] = {" + ", " * ", " - "};
+    std::string line = symbol(0);
+    for (std::size_t i = 1; i < length; i++)
+    {
+        line += operators[i % 3];
+        line += symbol(i);
+    }
+    return line;
+}
+
+// (((v0 + v1) * v2) - v3) ... nested `depth` parentheses deep.
+std::string nested(std::size_t depth)
+{
+    static char const* const operators[] = {" + ", " * ", " - "};
+    std::string line = symbol(0);
+    for (std::size_t i = 1; i <= depth; i++)
+    {
+        line = "(" + line + operators[i % 3] + symbol(i % 8) + ")";
+    }
+    return line;
+}
+
+// Evaluates `line` over and over, assigning v0 first each time so the
+// result cache can't answer.
+Benchmark::body execute(std::shared_ptr<Calc> calc, std::string line)
+{
+    AtomTable::atom changed = AtomTable::intern(symbol(0));
+    return [calc, line, changed](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; i++)
+        {
+            calc->assign(changed, Value(long(i & 0xff)));
+            Benchmark::keep(calc->execute_value(line));
+        }
+    };
+}
+
+Benchmark::body compile(std::string line)
+{
+    return [line](std::uint64_t iterations) {
+        for (std::uint64_t i = 0; i < iterations; i++)
+        {
+            Benchmark::keep(Compiler<Value>::compile(line));
+        }
+    };
+}
+
+Benchmark::body tokenize(std::string line)
+{
+    return [line](std::uint64_t iterations) {
+        std::vector<Lexer::Token> tokens;
+        for (std::uint64_t i = 0; i < iterations; i++)
+        {
+            Lexer::tokenize(line, tokens);
+            Benchmark::keep(tokens);
+        }
+    };
+}
+
+constexpr std::size_t chain_length = 256;
+constexpr std::size_t nesting_depth = 256;
+constexpr std::size_t large_table = 1 << 20;
+
+}
+
+std::vector<Benchmark> micro_benchmarks()
+{
+    return {
+        Benchmark("lexer/tokenize", [] {
+            return tokenize("total = (price + 42) * quantity - discount / 7");
+        }),
+        Benchmark("lexer/literal", [] {
+            return tokenize("1234567890");
+        }),
+        Benchmark("lexer/chain", [] {
+            return tokenize(operator_chain(chain_length));
+        }),
+        Benchmark("compiler/is_symbol", [] {
+            return [](std::uint64_t iterations) {
+                std::string name = "quantity";
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    Benchmark::keep(Compiler<Value>::is_symbol(name));
+                }
+            };
+        }),
+        Benchmark("compiler/chain", [] {
+            return compile(operator_chain(chain_length));
+        }),
+        Benchmark("compiler/nested", [] {
+            return compile(nested(nesting_depth));
+        }),
+        Benchmark("calculator/lookup", [] {
+            auto calc = calculator_with(1000);
+            return [calc](std::uint64_t iterations) {
+                std::string name = symbol(500);
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    Benchmark::keep(calc->lookup(name));
+                }
+            };
+        }),
+        Benchmark("calculator/execute_cached", [] {
+            auto calc = calculator_with(chain_length);
+            return [calc](std::uint64_t iterations) {
+                std::string line = operator_chain(chain_length);
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    Benchmark::keep(calc->execute_value(line));
+                }
+            };
+        }),
+        Benchmark("calculator/execute_chain", [] {
+            return execute(calculator_with(chain_length), operator_chain(chain_length));
+        }),
+        Benchmark("calculator/execute_nested", [] {
+            return execute(calculator_with(8), nested(nesting_depth));
+        }),
+        Benchmark("symbols/lookup_large", [] {
+            auto calc = calculator_with(large_table);
+            return [calc](std::uint64_t iterations) {
+                std::vector<std::string> names;
+                for (std::size_t i = 0; i < 1024; i++)
+                {
+                    names.push_back(symbol(i * 1021 % large_table));
+                }
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    Benchmark::keep(calc->lookup(names[i % names.size()]));
+                }
+            };
+        }),
+        Benchmark("symbols/assign_large", [] {
+            auto calc = calculator_with(large_table);
+            return [calc](std::uint64_t iterations) {
+                std::vector<AtomTable::atom> atoms;
+                for (std::size_t i = 0; i < 1024; i++)
+                {
+                    atoms.push_back(AtomTable::intern(symbol(i * 1021 % large_table)));
+                }
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    calc->assign(atoms[i % atoms.size()], Value(long(i)));
+                }
+            };
+        }),
+        Benchmark("symbols/execute_large", [] {
+            return execute(calculator_with(large_table), symbol(0) + " + " + symbol(large_table - 1));
+        }),
+    };
+}
@@ -0,0 +1,15 @@
+# flake8: noqa
+
+Import('base_env')
+
+bench_env = base_env.Clone()
+
+bench_env.Append(CXXFLAGS=['-O2'], LIBS=['pthread'])
+bench_env['OBJPREFIX'] = bench_env['OBJPREFIX'] + 'bench/'
+
+# The calculator is compiled again, optimized, without its main.
+sources = Glob('*.cpp') + [source for source in Glob('#/src/*.cpp') if source.name != 'main.cpp']
+
+benchmarks = bench_env.Program(target='Benchmarks', source=sources)
+
+Return('benchmarks')
@@ -0,0 +1,100 @@
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+
+namespace
+{
+
+struct Options
+{
+    // Only benchmarks whose name contains this run.
+    std::string filter;
+
+    // Minimum duration of the measured run of each benchmark.
+    double min_seconds = 0.5;
+
+    // Length of the scripts replayed by the macrobenchmarks.
+    std::uint64_t lines = 1000000;
+};
+
+void usage(char const* program)
+{
+    std::cerr << "usage: " << program << " [--filter TEXT] [--min-time SECONDS] [--lines N]" << std::endl;
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (std::size_t i = 0; i < args.size(); i++)
+    {
+        try
+        {
+            if (args[i] == "--filter" && i + 1 < args.size())
+            {
+                options.filter = args[++i];
+            }
+            else if (args[i] == "--min-time" && i + 1 < args.size())
+            {
+                options.min_seconds = std::stod(args[++i]);
+            }
+            else if (args[i] == "--lines" && i + 1 < args.size())
+            {
+                options.lines = std::stoull(args[++i]);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        catch (std::exception const&)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+// Runs the benchmarks and prints their results as JSON on standard output,
+// so runs can be compared across releases. Progress goes to standard error.
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Benchmark> benchmarks = micro_benchmarks();
+    for (auto& benchmark : macro_benchmarks(options.lines))
+    {
+        benchmarks.push_back(benchmark);
+    }
+
+    try
+    {
+        std::vector<Benchmark::Result> results;
+        for (auto const& benchmark : benchmarks)
+        {
+            if (benchmark.get_name().find(options.filter) == std::string::npos)
+            {
+                continue;
+            }
+            std::cerr << benchmark.get_name() << std::endl;
+            results.push_back(benchmark.run(options.min_seconds));
+        }
+        std::cout << Benchmark::to_json(results);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
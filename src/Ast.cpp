@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "Ast.hpp"
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "Numeric.hpp"
+#include "Operators.hpp"
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::literal(Program::value_type encoded)
+{
+    return add({Kind::literal, Program::Opcode::push_literal, 0, encoded, 0, 0});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::constant(Value const& value)
+{
+    // Lines rarely hold more than a couple of constants.
+    auto found = std::find(pool.begin(), pool.end(), value);
+    auto slot = Program::slot_type(std::distance(pool.begin(), found));
+    if (found == pool.end())
+    {
+        pool.push_back(value);
+    }
+    return add({Kind::constant, Program::Opcode::push_constant, slot, 0, 0, 0});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::number(Value const& value)
+{
+    auto encoded = Numeric<Value>::encode(value);
+    return encoded.has_value() ? literal(encoded.value()) : constant(value);
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::symbol(Program::slot_type slot)
+{
+    return add({Kind::symbol, Program::Opcode::load_symbol, slot, 0, 0, 0});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::unary(Program::Opcode op, node_id operand)
+{
+    return add({Kind::unary, op, 0, 0, operand, 0});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::binary(Program::Opcode op, node_id lhs, node_id rhs)
+{
+    return add({Kind::binary, op, 0, 0, lhs, rhs});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::argument(node_id value, node_id next)
+{
+    return add({Kind::argument, Program::Opcode::identity, 0, 0, value, next});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::call(Program::slot_type function, Program::atom name, node_id arguments)
+{
+    return add({Kind::call, Program::Opcode::call, function, Program::value_type(name), arguments, none});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::recurse(Program::atom name, node_id arguments)
+{
+    return add({Kind::recurse, Program::Opcode::recurse, 0, Program::value_type(name), arguments, none});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::condition(node_id test, node_id then, node_id otherwise)
+{
+    node_id choices = add({Kind::alternatives, Program::Opcode::identity, 0, 0, then, otherwise});
+    return add({Kind::condition, Program::Opcode::jump_if_zero, 0, 0, test, choices});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::index(Program::atom name, std::size_t depth)
+{
+    return add({Kind::index, Program::Opcode::load_symbol, Program::slot_type(depth), Program::value_type(name), 0,
+                0});
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::reduce(Program::Reduction reduction, Program::atom index, node_id body,
+                                                node_id first, node_id last)
+{
+    node_id bounds = argument(first, argument(last, none));
+    return add({Kind::reduce, Program::Opcode::reduce, Program::slot_type(reduction), Program::value_type(index), body,
+                bounds});
+}
+
+template <typename Value>
+void Ast<Value>::clear()
+{
+    nodes.clear();
+    pool.clear();
+    std::fill(buckets.begin(), buckets.end(), none);
+}
+
+template <typename Value>
+typename Ast<Value>::Node const& Ast<Value>::operator[](node_id id) const
+{
+    return nodes[id];
+}
+
+template <typename Value>
+std::size_t Ast<Value>::size() const
+{
+    return nodes.size();
+}
+
+template <typename Value>
+bool Ast<Value>::is_word(node_id id, Program::value_type word) const
+{
+    auto encoded = Numeric<Value>::encode(Numeric<Value>::from_word(word));
+    return nodes[id].kind == Kind::literal && encoded.has_value() && nodes[id].value == encoded.value();
+}
+
+template <typename Value>
+bool Ast<Value>::is_number(node_id id) const
+{
+    return nodes[id].kind == Kind::literal || nodes[id].kind == Kind::constant;
+}
+
+template <typename Value>
+Value Ast<Value>::number_at(node_id id) const
+{
+    return nodes[id].kind == Kind::literal ? Numeric<Value>::decode(nodes[id].value) : pool[nodes[id].slot];
+}
+
+template <typename Value>
+std::vector<Value> const& Ast<Value>::constants() const
+{
+    return pool;
+}
+
+template <typename Value>
+std::string Ast<Value>::to_string(node_id id, std::pmr::vector<Program::atom> const& symbols) const
+{
+    auto spelling = [](Program::Opcode op, Operators::Arity arity) {
+        for (auto const& info : Operators::table)
+        {
+            if (info.opcode == op && info.arity == arity && info.assignment == Operators::Assignment::none)
+            {
+                return std::string(info.spelling);
+            }
+        }
+        return std::string("?");
+    };
+    auto operand = [this, &symbols](node_id operand_id) {
+        std::string text = to_string(operand_id, symbols);
+        return nodes[operand_id].kind == Kind::binary ? "(" + text + ")" : text;
+    };
+
+    Node const& node = nodes[id];
+    switch (node.kind)
+    {
+    case Kind::literal:
+        return Numeric<Value>::to_string(Numeric<Value>::decode(node.value));
+    case Kind::constant:
+        return Numeric<Value>::to_string(pool[node.slot]);
+    case Kind::symbol:
+        return AtomTable::name(symbols[node.slot]);
+    case Kind::unary:
+        return spelling(node.op, Operators::Arity::prefix) + operand(node.lhs);
+    case Kind::binary:
+        return operand(node.lhs) + " " + spelling(node.op, Operators::Arity::infix) + " " + operand(node.rhs);
+    case Kind::call:
+    case Kind::recurse:
+    {
+        std::string text = AtomTable::name(Program::atom(node.value)) + "(";
+        for (node_id argument = node.lhs; argument != none; argument = nodes[argument].rhs)
+        {
+            text += to_string(nodes[argument].lhs, symbols);
+            text += nodes[argument].rhs != none ? ", " : "";
+        }
+        return text + ")";
+    }
+    case Kind::condition:
+    {
+        Node const& choices = nodes[node.rhs];
+        return "if(" + to_string(node.lhs, symbols) + ", " + to_string(choices.lhs, symbols) + ", " +
+            to_string(choices.rhs, symbols) + ")";
+    }
+    case Kind::index:
+        return AtomTable::name(Program::atom(node.value));
+    case Kind::reduce:
+    {
+        Node const& bounds = nodes[node.rhs];
+        return std::string(Program::name(Program::Reduction(node.slot))) + "(" +
+            AtomTable::name(Program::atom(node.value)) + ", " + to_string(bounds.lhs, symbols) + ", " +
+            to_string(nodes[bounds.rhs].lhs, symbols) + ", " + to_string(node.lhs, symbols) + ")";
+    }
+    case Kind::argument:
+    case Kind::alternatives:
+        break;
+    }
+    return std::string();
+}
+
+template <typename Value>
+typename Ast<Value>::node_id Ast<Value>::add(Node const& node)
+{
+    if (buckets.size() < 2 * (nodes.size() + 1))
+    {
+        std::vector<node_id> old(std::max<std::size_t>(16, 2 * buckets.size()), none);
+        buckets.swap(old);
+        for (node_id id : old)
+        {
+            if (id != none)
+            {
+                std::size_t b = hash(nodes[id]) & (buckets.size() - 1);
+                while (buckets[b] != none)
+                {
+                    b = (b + 1) & (buckets.size() - 1);
+                }
+                buckets[b] = id;
+            }
+        }
+    }
+
+    std::size_t b = hash(node) & (buckets.size() - 1);
+    for (; buckets[b] != none; b = (b + 1) & (buckets.size() - 1))
+    {
+        if (same(nodes[buckets[b]], node))
+        {
+            return buckets[b];
+        }
+    }
+
+    node_id id = node_id(nodes.size());
+    nodes.push_back(node);
+    buckets[b] = id;
+    return id;
+}
+
+template <typename Value>
+std::size_t Ast<Value>::hash(Node const& node)
+{
+    std::size_t h = std::size_t(node.kind) * 31 + std::size_t(node.op);
+    h = h * 0x9e3779b97f4a7c15ull + std::size_t(node.value);
+    h = h * 0x9e3779b97f4a7c15ull + node.slot;
+    h = h * 0x9e3779b97f4a7c15ull + node.lhs;
+    h = h * 0x9e3779b97f4a7c15ull + node.rhs;
+    return h ^ (h >> 29);
+}
+
+template <typename Value>
+bool Ast<Value>::same(Node const& a, Node const& b)
+{
+    return a.kind == b.kind && a.op == b.op && a.slot == b.slot && a.value == b.value &&
+        a.lhs == b.lhs && a.rhs == b.rhs;
+}
+
+#define INSTANTIATE(Value) template class Ast<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
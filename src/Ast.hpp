@@ -0,0 +1,117 @@
+#ifndef GUARD_AST_HPP
+#define GUARD_AST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "Bytecode.hpp"
+
+// Expression tree of one line, stored as a vector of nodes that refer to
+// their operands by index. Identical subtrees are stored once (hash
+// consing), so the tree is really a DAG and a repeated subexpression has a
+// single node id.
+//
+// Numbers with an immediate encoding (see Numeric) are literal nodes holding
+// it; the others are constant nodes whose slot indexes constants().
+//
+// Calls and conditions have more than two operands, so they hang them on
+// list nodes: the arguments of a call are a chain of argument nodes, and
+// the two values a condition chooses from are an alternatives node. List
+// nodes only exist as operands of these, and have no value of their own.
+template <typename Value>
+class Ast
+{
+public:
+    using node_id = std::uint32_t;
+
+    enum class Kind : std::uint8_t
+    {
+        literal,
+        constant,
+        symbol,
+        unary,
+        binary,
+        // `slot` indexes Program::functions and `value` is the function's
+        // name; `lhs` is the first argument node, if any.
+        call,
+        // A call of the function being defined, named by `value`.
+        recurse,
+        // `lhs` is an argument, `rhs` the next argument node, if any.
+        argument,
+        // if(lhs, ...): `rhs` is the alternatives node.
+        condition,
+        // The value when the condition isn't zero, `lhs`, and when it is.
+        alternatives,
+        // The index of the reduction `slot` levels out from the outermost
+        // one, named by `value`.
+        index,
+        // A reduction, `slot` being its Program::Reduction and `value` the
+        // name of its index: `lhs` is the body and `rhs` the argument
+        // chain of the bounds.
+        reduce
+    };
+
+    struct Node
+    {
+        Kind kind;
+        Program::Opcode op;
+        Program::slot_type slot;
+        Program::value_type value;
+        node_id lhs;
+        node_id rhs;
+    };
+
+    static constexpr node_id none = ~node_id(0);
+
+private:
+    std::vector<Node> nodes;
+    // Open addressing hash table of node ids, `none` marking a free bucket.
+    // Its size is a power of two kept at least twice the number of nodes.
+    std::vector<node_id> buckets;
+    std::vector<Value> pool;
+
+public:
+    // A literal with the immediate `encoded`.
+    node_id literal(Program::value_type encoded);
+    node_id constant(Value const& value);
+    // A literal or a constant, whichever holds `value`.
+    node_id number(Value const& value);
+    node_id symbol(Program::slot_type slot);
+    node_id unary(Program::Opcode op, node_id operand);
+    node_id binary(Program::Opcode op, node_id lhs, node_id rhs);
+    // `arguments` is the chain of argument nodes, or none.
+    node_id argument(node_id value, node_id next);
+    node_id call(Program::slot_type function, Program::atom name, node_id arguments);
+    node_id recurse(Program::atom name, node_id arguments);
+    node_id condition(node_id test, node_id then, node_id otherwise);
+    node_id index(Program::atom name, std::size_t depth);
+    node_id reduce(Program::Reduction reduction, Program::atom index, node_id body, node_id first, node_id last);
+
+    // Drops every node, keeping the storage.
+    void clear();
+
+    Node const& operator[](node_id id) const;
+    std::size_t size() const;
+
+    // Whether `id` is the number `word`.
+    bool is_word(node_id id, Program::value_type word) const;
+    bool is_number(node_id id) const;
+    // Value of a literal or constant node.
+    Value number_at(node_id id) const;
+
+    std::vector<Value> const& constants() const;
+
+    // Infix text of the subtree at `id`, with `symbols` giving each slot's
+    // atom.
+    std::string to_string(node_id id, std::pmr::vector<Program::atom> const& symbols) const;
+
+private:
+    node_id add(Node const& node);
+    static std::size_t hash(Node const& node);
+    static bool same(Node const& a, Node const& b);
+};
+
+#endif
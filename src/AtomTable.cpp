@@ -0,0 +1,78 @@
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AtomTable.hpp"
+
+AtomTable& AtomTable::instance()
+{
+    static AtomTable table;
+    return table;
+}
+
+AtomTable::atom AtomTable::intern(std::string_view name)
+{
+    AtomTable& table = instance();
+    {
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        auto found = table.ids.find(name);
+        if (found != table.ids.end())
+        {
+            return found->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(table.mutex);
+    auto found = table.ids.find(name);
+    if (found != table.ids.end())
+    {
+        return found->second;
+    }
+    atom id = atom(table.names.size());
+    table.names.emplace_back(name);
+    table.ids.emplace(table.names.back(), id);
+    return id;
+}
+
+std::vector<AtomTable::atom> AtomTable::intern(std::vector<std::string_view> const& names)
+{
+    AtomTable& table = instance();
+    std::vector<atom> atoms;
+    atoms.reserve(names.size());
+
+    std::unique_lock<std::shared_mutex> lock(table.mutex);
+    table.ids.reserve(table.ids.size() + names.size());
+    for (std::string_view name : names)
+    {
+        auto found = table.ids.find(name);
+        if (found == table.ids.end())
+        {
+            table.names.emplace_back(name);
+            found = table.ids.emplace(table.names.back(), atom(table.names.size() - 1)).first;
+        }
+        atoms.push_back(found->second);
+    }
+    return atoms;
+}
+
+std::optional<AtomTable::atom> AtomTable::find(std::string_view name)
+{
+    AtomTable& table = instance();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    auto found = table.ids.find(name);
+    if (found == table.ids.end())
+    {
+        return std::nullopt;
+    }
+    return found->second;
+}
+
+std::string const& AtomTable::name(atom id)
+{
+    AtomTable& table = instance();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    return table.names.at(id);
+}
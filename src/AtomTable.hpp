@@ -0,0 +1,41 @@
+#ifndef GUARD_ATOM_TABLE_HPP
+#define GUARD_ATOM_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Process wide table of interned symbol names. Each distinct name gets a
+// small integer, its atom, that never changes and can index flat arrays.
+class AtomTable
+{
+public:
+    using atom = std::uint32_t;
+
+private:
+    std::shared_mutex mutex;
+    // A deque never moves its elements, so `ids` can keep views into them.
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, atom> ids;
+
+public:
+    static atom intern(std::string_view name);
+    // Interns many names at once, such as those of a snapshot, taking the
+    // lock once instead of for each.
+    static std::vector<atom> intern(std::vector<std::string_view> const& names);
+    static std::optional<atom> find(std::string_view name);
+    static std::string const& name(atom id);
+
+private:
+    AtomTable() = default;
+
+    static AtomTable& instance();
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BatchRunner.hpp"
+#include "Calculator.hpp"
+#include "Numeric.hpp"
+#include "OutputBuffer.hpp"
+
+BatchRunner::BatchRunner(int output_fd, int error_fd)
+    : output(output_fd), errors(error_fd)
+{
+}
+
+template <typename Value>
+BatchRunner::Summary BatchRunner::run(BasicCalculator<Value>& calculator, std::string const& path)
+{
+    Summary summary;
+    auto start = std::chrono::steady_clock::now();
+
+    std::string command;
+    for_each_line(path, [this, &calculator, &summary, &command](std::string_view line) {
+        summary.lines++;
+        if (line.find_first_not_of(" \t") == std::string_view::npos)
+        {
+            return;
+        }
+        command.assign(line.begin(), line.end());
+
+        if (Calculator::is_command(command))
+        {
+            auto text = calculator.evaluate(command);
+            if (!text.has_value())
+            {
+                report(errors, summary.lines, text.error().message);
+            }
+            else if (text.value().has_value())
+            {
+                output.append(text.value().value());
+                output.append('\n');
+            }
+            return;
+        }
+
+        auto value = calculator.evaluate_value(command);
+        if (!value.has_value())
+        {
+            report(errors, summary.lines, value.error().message);
+        }
+        else if (value.value().has_value())
+        {
+            summary.results++;
+            Numeric<Value>::write(output, value.value().value());
+            output.append('\n');
+        }
+    });
+    output.flush();
+    errors.flush();
+
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+void BatchRunner::report(OutputBuffer& errors, std::size_t line, std::string_view message)
+{
+    errors.append("line ");
+    errors.append(long(line));
+    errors.append(": ");
+    errors.append(message);
+    errors.append('\n');
+}
+
+void BatchRunner::for_each_line(std::string const& path, line_callback const& callback)
+{
+    if (path == "-")
+    {
+        read_blocks(STDIN_FILENO, path, callback);
+        return;
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        std::size_t size = std::size_t(info.st_size);
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            ::close(fd);
+            ::madvise(mapped, size, MADV_SEQUENTIAL);
+
+            char const* begin = static_cast<char const*>(mapped);
+            try
+            {
+                for_each_line(begin, begin + size, callback);
+            }
+            catch (...)
+            {
+                ::munmap(mapped, size);
+                throw;
+            }
+            ::munmap(mapped, size);
+            return;
+        }
+    }
+
+    try
+    {
+        read_blocks(fd, path, callback);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+void BatchRunner::for_each_line(char const* begin, char const* end, line_callback const& callback)
+{
+    while (begin != end)
+    {
+        char const* newline = static_cast<char const*>(std::memchr(begin, '\n', std::size_t(end - begin)));
+        char const* line_end = newline != nullptr ? newline : end;
+
+        std::string_view line(begin, std::size_t(line_end - begin));
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        callback(line);
+
+        begin = newline != nullptr ? newline + 1 : end;
+    }
+}
+
+void BatchRunner::read_blocks(int fd, std::string const& path, line_callback const& callback)
+{
+    std::vector<char> buffer(read_block);
+    // Bytes at the start of `buffer` belonging to a line that isn't complete
+    // yet.
+    std::size_t pending = 0;
+
+    while (true)
+    {
+        if (pending == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        ssize_t count = ::read(fd, buffer.data() + pending, buffer.size() - pending);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        if (count == 0)
+        {
+            for_each_line(buffer.data(), buffer.data() + pending, callback);
+            return;
+        }
+
+        char const* begin = buffer.data();
+        char const* end = begin + pending + std::size_t(count);
+        char const* last_newline = begin + pending + std::size_t(count);
+        while (last_newline != begin && last_newline[-1] != '\n')
+        {
+            last_newline--;
+        }
+
+        for_each_line(begin, last_newline, callback);
+        pending = std::size_t(end - last_newline);
+        std::memmove(buffer.data(), last_newline, pending);
+    }
+}
+
+#define INSTANTIATE(Value) \
+    template BatchRunner::Summary BatchRunner::run(BasicCalculator<Value>&, std::string const&);
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,55 @@
+#ifndef GUARD_BATCH_RUNNER_HPP
+#define GUARD_BATCH_RUNNER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "Calculator.hpp"
+#include "OutputBuffer.hpp"
+
+// Non-interactive evaluation of a whole script, one line per command. Files
+// are mapped into memory and anything else (pipes, terminals) is read in
+// large blocks; results and errors go through OutputBuffers, and errors
+// are taken as BasicCalculator::evaluate returns them, without exceptions.
+// Errors and results are buffered apart, so each error starts with the
+// number of its line, counting from 1.
+class BatchRunner
+{
+public:
+    struct Summary
+    {
+        std::size_t lines = 0;
+        std::size_t results = 0;
+        double seconds = 0;
+    };
+
+    using line_callback = std::function<void(std::string_view)>;
+
+private:
+    static constexpr std::size_t read_block = 1 << 20;
+
+private:
+    OutputBuffer output;
+    OutputBuffer errors;
+
+public:
+    BatchRunner(int output_fd, int error_fd);
+
+    // `path` is a file name, or "-" for standard input.
+    template <typename Value>
+    Summary run(BasicCalculator<Value>& calculator, std::string const& path);
+
+    // Calls `callback` with every line of `path`, without its line ending.
+    static void for_each_line(std::string const& path, line_callback const& callback);
+
+    // Appends "line N: message" to `errors`.
+    static void report(OutputBuffer& errors, std::size_t line, std::string_view message);
+
+private:
+    static void for_each_line(char const* begin, char const* end, line_callback const& callback);
+    static void read_blocks(int fd, std::string const& path, line_callback const& callback);
+};
+
+#endif
@@ -0,0 +1,542 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BigInt.hpp"
+#include "Calculator.hpp"
+
+namespace
+{
+
+// Below this many limbs schoolbook multiplication beats Karatsuba.
+constexpr std::size_t karatsuba_threshold = 32;
+
+// Largest power of ten in a limb, used to convert to and from decimal.
+constexpr std::uint32_t decimal_base = 1000000000;
+constexpr std::size_t decimal_digits = 9;
+
+}
+
+std::optional<BigInt> BigInt::parse(std::string_view text)
+{
+    bool negative = !text.empty() && text.front() == '-';
+    if (negative)
+    {
+        text.remove_prefix(1);
+    }
+    if (text.empty() || !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; }))
+    {
+        return std::nullopt;
+    }
+
+    // Chunks of up to nine digits: value = value * 10^k + chunk.
+    magnitude_type value;
+    std::size_t first = text.size() % decimal_digits;
+    if (first == 0)
+    {
+        first = decimal_digits;
+    }
+    for (std::size_t begin = 0; begin < text.size(); )
+    {
+        std::size_t length = begin == 0 ? first : decimal_digits;
+        std::uint64_t chunk = 0;
+        std::uint64_t scale = 1;
+        for (std::size_t i = begin; i < begin + length; i++)
+        {
+            chunk = chunk * 10 + std::uint64_t(text[i] - '0');
+            scale *= 10;
+        }
+        begin += length;
+
+        std::uint64_t carry = chunk;
+        for (auto& limb : value)
+        {
+            std::uint64_t product = std::uint64_t(limb) * scale + carry;
+            limb = limb_type(product);
+            carry = product >> 32;
+        }
+        if (carry != 0)
+        {
+            value.push_back(limb_type(carry));
+        }
+    }
+
+    trim(value);
+    return from(negative, std::move(value));
+}
+
+BigInt::word_type BigInt::wrapped() const
+{
+    if (is_word())
+    {
+        return small;
+    }
+    std::uint64_t low = limbs[0];
+    if (limbs.size() > 1)
+    {
+        low |= std::uint64_t(limbs[1]) << 32;
+    }
+    return static_cast<word_type>(negative ? 0 - low : low);
+}
+
+std::size_t BigInt::bit_length() const
+{
+    if (is_word())
+    {
+        std::uint64_t value = small < 0 ? 0 - static_cast<std::uint64_t>(small) : static_cast<std::uint64_t>(small);
+        return value == 0 ? 0 : 64 - std::size_t(__builtin_clzll(value));
+    }
+    return 32 * limbs.size() - std::size_t(__builtin_clz(limbs.back()));
+}
+
+std::size_t BigInt::hash() const
+{
+    if (is_word())
+    {
+        return std::hash<word_type>()(small);
+    }
+    std::size_t h = negative;
+    for (limb_type limb : limbs)
+    {
+        h = h * 0x9e3779b97f4a7c15ull + limb;
+    }
+    return h;
+}
+
+std::string BigInt::to_string() const
+{
+    if (is_word())
+    {
+        return std::to_string(small);
+    }
+
+    // Nine decimal digits at a time, least significant first.
+    magnitude_type value = limbs;
+    std::vector<limb_type> chunks;
+    while (!value.empty())
+    {
+        chunks.push_back(divide(value, decimal_base));
+    }
+
+    std::string text = negative ? "-" : "";
+    text += std::to_string(chunks.back());
+    for (auto chunk = std::next(chunks.rbegin()); chunk != chunks.rend(); chunk++)
+    {
+        std::string digits = std::to_string(*chunk);
+        text.append(decimal_digits - digits.size(), '0');
+        text += digits;
+    }
+    return text;
+}
+
+void BigInt::to_bytes(std::string& bytes) const
+{
+    if (is_word())
+    {
+        bytes.append(reinterpret_cast<char const*>(&small), sizeof(small));
+        return;
+    }
+    bytes.push_back(negative ? 1 : 0);
+    bytes.append(reinterpret_cast<char const*>(limbs.data()), limbs.size() * sizeof(limb_type));
+}
+
+std::optional<BigInt> BigInt::from_bytes(std::string_view bytes)
+{
+    if (bytes.size() == sizeof(word_type))
+    {
+        word_type word;
+        std::memcpy(&word, bytes.data(), sizeof(word));
+        return BigInt(word);
+    }
+    if (bytes.empty() || (bytes.size() - 1) % sizeof(limb_type) != 0 || std::uint8_t(bytes[0]) > 1 ||
+        (bytes.size() - 1) / sizeof(limb_type) > max_bits / 32)
+    {
+        return std::nullopt;
+    }
+
+    magnitude_type magnitude((bytes.size() - 1) / sizeof(limb_type));
+    std::memcpy(magnitude.data(), bytes.data() + 1, bytes.size() - 1);
+    while (!magnitude.empty() && magnitude.back() == 0)
+    {
+        magnitude.pop_back();
+    }
+    return from(bytes[0] == 1, std::move(magnitude));
+}
+
+BigInt BigInt::pow(BigInt const& base, BigInt const& exponent)
+{
+    if (exponent.is_zero())
+    {
+        return 1;
+    }
+    if (base.is_word() && (base.small == 0 || base.small == 1))
+    {
+        return base;
+    }
+    if (base.is_word() && base.small == -1)
+    {
+        return (exponent.wrapped() & 1) ? -1 : 1;
+    }
+    if (!exponent.is_word() || std::uint64_t(exponent.small) > max_bits / (base.bit_length() - 1))
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::too_large, "Result too large.");
+    }
+
+    BigInt result = 1;
+    BigInt factor = base;
+    for (word_type e = exponent.small; ; )
+    {
+        if (e & 1)
+        {
+            result = result * factor;
+        }
+        e >>= 1;
+        if (e == 0)
+        {
+            break;
+        }
+        factor = factor * factor;
+    }
+    return result;
+}
+
+bool operator<(BigInt const& a, BigInt const& b)
+{
+    if (a.is_word() && b.is_word())
+    {
+        return a.small < b.small;
+    }
+    if (a.is_negative() != b.is_negative())
+    {
+        return a.is_negative();
+    }
+    int order = BigInt::compare(a.magnitude(), b.magnitude());
+    return a.is_negative() ? order > 0 : order < 0;
+}
+
+BigInt BigInt::add(BigInt const& a, BigInt const& b, bool subtract)
+{
+    bool a_negative = a.is_negative();
+    bool b_negative = b.is_negative() != subtract;
+    magnitude_type x = a.magnitude();
+    magnitude_type y = b.magnitude();
+
+    if (a_negative == b_negative)
+    {
+        return from(a_negative, add(x, y));
+    }
+    if (compare(x, y) >= 0)
+    {
+        return from(a_negative, BigInt::subtract(x, y));
+    }
+    return from(b_negative, BigInt::subtract(y, x));
+}
+
+BigInt BigInt::multiply(BigInt const& a, BigInt const& b)
+{
+    if (a.bit_length() + b.bit_length() > max_bits)
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::too_large, "Result too large.");
+    }
+    return from(a.is_negative() != b.is_negative(), multiply(a.magnitude(), b.magnitude()));
+}
+
+BigInt BigInt::divide(BigInt const& a, BigInt const& b, bool remainder)
+{
+    magnitude_type quotient;
+    magnitude_type rest;
+    divide(a.magnitude(), b.magnitude(), quotient, rest);
+    if (remainder)
+    {
+        return from(a.is_negative(), std::move(rest));
+    }
+    return from(a.is_negative() != b.is_negative(), std::move(quotient));
+}
+
+BigInt::magnitude_type BigInt::magnitude() const
+{
+    if (!is_word())
+    {
+        return limbs;
+    }
+
+    std::uint64_t value = small < 0 ? 0 - static_cast<std::uint64_t>(small) : static_cast<std::uint64_t>(small);
+    magnitude_type result;
+    while (value != 0)
+    {
+        result.push_back(limb_type(value));
+        value >>= 32;
+    }
+    return result;
+}
+
+BigInt BigInt::from(bool negative, magnitude_type magnitude)
+{
+    if (magnitude.size() <= 2)
+    {
+        std::uint64_t value = magnitude.empty() ? 0 : magnitude[0];
+        if (magnitude.size() == 2)
+        {
+            value |= std::uint64_t(magnitude[1]) << 32;
+        }
+        if (value <= std::uint64_t(INT64_MAX))
+        {
+            auto word = static_cast<word_type>(value);
+            return negative ? -word : word;
+        }
+        if (negative && value == std::uint64_t(INT64_MAX) + 1)
+        {
+            return INT64_MIN;
+        }
+    }
+
+    BigInt result;
+    result.limbs = std::move(magnitude);
+    result.negative = negative;
+    return result;
+}
+
+int BigInt::compare(magnitude_type const& a, magnitude_type const& b)
+{
+    if (a.size() != b.size())
+    {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (std::size_t i = a.size(); i-- > 0;)
+    {
+        if (a[i] != b[i])
+        {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+BigInt::magnitude_type BigInt::add(magnitude_type const& a, magnitude_type const& b)
+{
+    magnitude_type const& longer = a.size() >= b.size() ? a : b;
+    magnitude_type const& shorter = a.size() >= b.size() ? b : a;
+
+    magnitude_type result(longer.size() + 1);
+    std::uint64_t carry = 0;
+    for (std::size_t i = 0; i < longer.size(); i++)
+    {
+        std::uint64_t sum = std::uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0) + carry;
+        result[i] = limb_type(sum);
+        carry = sum >> 32;
+    }
+    result.back() = limb_type(carry);
+    trim(result);
+    return result;
+}
+
+BigInt::magnitude_type BigInt::subtract(magnitude_type const& a, magnitude_type const& b)
+{
+    magnitude_type result(a.size());
+    std::int64_t borrow = 0;
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        std::int64_t difference = std::int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = difference < 0;
+        result[i] = limb_type(difference + (borrow << 32));
+    }
+    trim(result);
+    return result;
+}
+
+BigInt::magnitude_type BigInt::multiply(magnitude_type const& a, magnitude_type const& b)
+{
+    if (a.empty() || b.empty())
+    {
+        return magnitude_type();
+    }
+    magnitude_type result = karatsuba(a.data(), a.size(), b.data(), b.size());
+    trim(result);
+    return result;
+}
+
+BigInt::magnitude_type BigInt::karatsuba(limb_type const* a, std::size_t n, limb_type const* b, std::size_t m)
+{
+    // Returns n + m limbs, possibly with leading zeros.
+    if (std::min(n, m) < karatsuba_threshold)
+    {
+        magnitude_type result(n + m);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            std::uint64_t carry = 0;
+            for (std::size_t j = 0; j < m; j++)
+            {
+                std::uint64_t product = std::uint64_t(a[i]) * b[j] + result[i + j] + carry;
+                result[i + j] = limb_type(product);
+                carry = product >> 32;
+            }
+            result[i + m] = limb_type(carry);
+        }
+        return result;
+    }
+
+    // a = a1 * B^h + a0 and b = b1 * B^h + b0, so
+    // a * b = z2 * B^2h + (z1 - z2 - z0) * B^h + z0
+    // with z0 = a0 * b0, z2 = a1 * b1 and z1 = (a0 + a1) * (b0 + b1).
+    std::size_t h = std::max(n, m) / 2;
+    std::size_t n0 = std::min(n, h);
+    std::size_t m0 = std::min(m, h);
+    magnitude_type a0(a, a + n0);
+    magnitude_type a1(a + n0, a + n);
+    magnitude_type b0(b, b + m0);
+    magnitude_type b1(b + m0, b + m);
+    trim(a0);
+    trim(b0);
+
+    magnitude_type z0 = multiply(a0, b0);
+    magnitude_type z2 = multiply(a1, b1);
+    magnitude_type z1 = multiply(add(a0, a1), add(b0, b1));
+    z1 = subtract(subtract(z1, z0), z2);
+
+    magnitude_type result(n + m);
+    auto accumulate = [&result](magnitude_type const& part, std::size_t shift) {
+        std::uint64_t carry = 0;
+        std::size_t i = 0;
+        for (; i < part.size(); i++)
+        {
+            std::uint64_t sum = std::uint64_t(result[shift + i]) + part[i] + carry;
+            result[shift + i] = limb_type(sum);
+            carry = sum >> 32;
+        }
+        for (; carry != 0; i++)
+        {
+            std::uint64_t sum = std::uint64_t(result[shift + i]) + carry;
+            result[shift + i] = limb_type(sum);
+            carry = sum >> 32;
+        }
+    };
+    accumulate(z0, 0);
+    accumulate(z1, h);
+    accumulate(z2, 2 * h);
+    return result;
+}
+
+void BigInt::divide(magnitude_type const& a, magnitude_type const& b, magnitude_type& quotient, magnitude_type& remainder)
+{
+    if (compare(a, b) < 0)
+    {
+        quotient.clear();
+        remainder = a;
+        return;
+    }
+    if (b.size() == 1)
+    {
+        quotient = a;
+        limb_type rest = divide(quotient, b[0]);
+        remainder.clear();
+        if (rest != 0)
+        {
+            remainder.push_back(rest);
+        }
+        return;
+    }
+
+    // Knuth's algorithm D, with the divisor shifted so that its top limb
+    // has the high bit set.
+    int shift = __builtin_clz(b.back());
+    auto shifted = [shift](magnitude_type const& value, std::size_t extra) {
+        magnitude_type result(value.size() + extra);
+        for (std::size_t i = 0; i < value.size(); i++)
+        {
+            std::uint64_t bits = std::uint64_t(value[i]) << shift;
+            result[i] |= limb_type(bits);
+            if (i + 1 < result.size())
+            {
+                result[i + 1] = limb_type(bits >> 32);
+            }
+        }
+        return result;
+    };
+    magnitude_type v = shifted(b, 0);
+    magnitude_type u = shifted(a, 1);
+    std::size_t n = v.size();
+    std::size_t m = a.size() - n;
+
+    quotient.assign(m + 1, 0);
+    for (std::size_t j = m + 1; j-- > 0;)
+    {
+        std::uint64_t numerator = (std::uint64_t(u[j + n]) << 32) | u[j + n - 1];
+        std::uint64_t qhat = numerator / v[n - 1];
+        std::uint64_t rhat = numerator % v[n - 1];
+        while (qhat >> 32 != 0 || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2]))
+        {
+            qhat--;
+            rhat += v[n - 1];
+            if (rhat >> 32 != 0)
+            {
+                break;
+            }
+        }
+
+        // u[j .. j + n] -= qhat * v
+        std::int64_t borrow = 0;
+        std::uint64_t carry = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            std::uint64_t product = qhat * v[i] + carry;
+            carry = product >> 32;
+            std::int64_t difference = std::int64_t(u[i + j]) - std::int64_t(limb_type(product)) - borrow;
+            borrow = difference < 0;
+            u[i + j] = limb_type(difference + (borrow << 32));
+        }
+        std::int64_t difference = std::int64_t(u[j + n]) - std::int64_t(carry) - borrow;
+        borrow = difference < 0;
+        u[j + n] = limb_type(difference + (borrow << 32));
+
+        if (borrow != 0)
+        {
+            // qhat was one too large: add v back.
+            qhat--;
+            std::uint64_t sum_carry = 0;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                std::uint64_t sum = std::uint64_t(u[i + j]) + v[i] + sum_carry;
+                u[i + j] = limb_type(sum);
+                sum_carry = sum >> 32;
+            }
+            u[j + n] = limb_type(u[j + n] + sum_carry);
+        }
+        quotient[j] = limb_type(qhat);
+    }
+    trim(quotient);
+
+    remainder.assign(n, 0);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        remainder[i] = limb_type((u[i] >> shift) | (shift == 0 ? 0 : std::uint64_t(u[i + 1]) << (32 - shift)));
+    }
+    trim(remainder);
+}
+
+BigInt::limb_type BigInt::divide(magnitude_type& a, limb_type b)
+{
+    std::uint64_t rest = 0;
+    for (std::size_t i = a.size(); i-- > 0;)
+    {
+        std::uint64_t current = (rest << 32) | a[i];
+        a[i] = limb_type(current / b);
+        rest = current % b;
+    }
+    trim(a);
+    return limb_type(rest);
+}
+
+void BigInt::trim(magnitude_type& a)
+{
+    while (!a.empty() && a.back() == 0)
+    {
+        a.pop_back();
+    }
+}
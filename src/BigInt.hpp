@@ -0,0 +1,190 @@
+#ifndef GUARD_BIG_INT_HPP
+#define GUARD_BIG_INT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Integer of any size. Values that fit in 64 bits are kept inline and
+// their arithmetic is a checked machine operation, so they never allocate;
+// an operation that overflows continues with a vector of 32 bit limbs.
+// Results that fit in 64 bits again go back to the inline form.
+//
+// Division truncates toward zero and the remainder takes the sign of the
+// dividend, as with the built-in integers.
+class BigInt
+{
+public:
+    using word_type = std::int64_t;
+
+private:
+    using limb_type = std::uint32_t;
+    using magnitude_type = std::vector<limb_type>;
+
+private:
+    // The value while `limbs` is empty.
+    word_type small = 0;
+    // Otherwise the absolute value, least significant limb first, with no
+    // leading zero limbs.
+    magnitude_type limbs;
+    bool negative = false;
+
+public:
+    // Results needing more bits than this are refused rather than computed.
+    static constexpr std::size_t max_bits = std::size_t(1) << 26;
+
+public:
+    BigInt() = default;
+    BigInt(word_type value)
+        : small(value)
+    {
+    }
+
+    // Decimal digits, with an optional leading '-'.
+    static std::optional<BigInt> parse(std::string_view text);
+
+    bool is_word() const
+    {
+        return limbs.empty();
+    }
+
+    // The value, which must satisfy is_word().
+    word_type word() const
+    {
+        return small;
+    }
+
+    // Low 64 bits of the two's complement representation.
+    word_type wrapped() const;
+
+    bool is_negative() const
+    {
+        return is_word() ? small < 0 : negative;
+    }
+
+    bool is_zero() const
+    {
+        return is_word() && small == 0;
+    }
+
+    std::size_t bit_length() const;
+    std::size_t hash() const;
+    std::string to_string() const;
+
+    // Binary form, for snapshots: a word is its 8 bytes, anything larger a
+    // sign byte followed by its limbs, least significant first.
+    void to_bytes(std::string& bytes) const;
+    static std::optional<BigInt> from_bytes(std::string_view bytes);
+
+    friend BigInt operator+(BigInt const& a, BigInt const& b)
+    {
+        word_type result;
+        if (a.is_word() && b.is_word() && !__builtin_add_overflow(a.small, b.small, &result))
+        {
+            return result;
+        }
+        return add(a, b, false);
+    }
+
+    friend BigInt operator-(BigInt const& a, BigInt const& b)
+    {
+        word_type result;
+        if (a.is_word() && b.is_word() && !__builtin_sub_overflow(a.small, b.small, &result))
+        {
+            return result;
+        }
+        return add(a, b, true);
+    }
+
+    friend BigInt operator*(BigInt const& a, BigInt const& b)
+    {
+        word_type result;
+        if (a.is_word() && b.is_word() && !__builtin_mul_overflow(a.small, b.small, &result))
+        {
+            return result;
+        }
+        return multiply(a, b);
+    }
+
+    // The divisor must not be zero.
+    friend BigInt operator/(BigInt const& a, BigInt const& b)
+    {
+        if (a.is_word() && b.is_word() && b.small != -1)
+        {
+            return a.small / b.small;
+        }
+        return divide(a, b, false);
+    }
+
+    friend BigInt operator%(BigInt const& a, BigInt const& b)
+    {
+        if (a.is_word() && b.is_word())
+        {
+            return b.small == -1 ? 0 : a.small % b.small;
+        }
+        return divide(a, b, true);
+    }
+
+    BigInt operator-() const
+    {
+        if (is_word() && small != INT64_MIN)
+        {
+            return -small;
+        }
+        return BigInt() - *this;
+    }
+
+    // Same as -x - 1, which is what ~ does to two's complement integers.
+    BigInt operator~() const
+    {
+        if (is_word())
+        {
+            return ~small;
+        }
+        return -*this - 1;
+    }
+
+    // Exponentiation by squaring. The exponent must not be negative.
+    static BigInt pow(BigInt const& base, BigInt const& exponent);
+
+    friend bool operator==(BigInt const& a, BigInt const& b)
+    {
+        if (a.is_word() || b.is_word())
+        {
+            return a.is_word() && b.is_word() && a.small == b.small;
+        }
+        return a.negative == b.negative && a.limbs == b.limbs;
+    }
+
+    friend bool operator!=(BigInt const& a, BigInt const& b)
+    {
+        return !(a == b);
+    }
+
+    friend bool operator<(BigInt const& a, BigInt const& b);
+
+private:
+    static BigInt add(BigInt const& a, BigInt const& b, bool subtract);
+    static BigInt multiply(BigInt const& a, BigInt const& b);
+    static BigInt divide(BigInt const& a, BigInt const& b, bool remainder);
+
+    // Absolute value as limbs, whatever the form.
+    magnitude_type magnitude() const;
+    // Builds a value from a sign and an absolute value, choosing the form.
+    static BigInt from(bool negative, magnitude_type magnitude);
+
+    static int compare(magnitude_type const& a, magnitude_type const& b);
+    static magnitude_type add(magnitude_type const& a, magnitude_type const& b);
+    // a - b, with a >= b.
+    static magnitude_type subtract(magnitude_type const& a, magnitude_type const& b);
+    static magnitude_type multiply(magnitude_type const& a, magnitude_type const& b);
+    static magnitude_type karatsuba(limb_type const* a, std::size_t n, limb_type const* b, std::size_t m);
+    static void divide(magnitude_type const& a, magnitude_type const& b, magnitude_type& quotient, magnitude_type& remainder);
+    static limb_type divide(magnitude_type& a, limb_type b);
+    static void trim(magnitude_type& a);
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include <cstddef>
+#include <string>
+
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "Function.hpp"
+#include "Numeric.hpp"
+#include "Reduction.hpp"
+
+namespace
+{
+char const* mnemonic(Program::Opcode op)
+{
+    switch (op)
+    {
+    case Program::Opcode::push_literal:
+        return "push";
+    case Program::Opcode::push_constant:
+        return "const";
+    case Program::Opcode::load_symbol:
+        return "load";
+    case Program::Opcode::negate:
+        return "neg";
+    case Program::Opcode::bit_not:
+        return "not";
+    case Program::Opcode::identity:
+        return "id";
+    case Program::Opcode::power:
+        return "pow";
+    case Program::Opcode::multiply:
+        return "mul";
+    case Program::Opcode::divide:
+        return "div";
+    case Program::Opcode::modulo:
+        return "mod";
+    case Program::Opcode::add:
+        return "add";
+    case Program::Opcode::subtract:
+        return "sub";
+    case Program::Opcode::save_temp:
+        return "save";
+    case Program::Opcode::load_temp:
+        return "temp";
+    case Program::Opcode::jump:
+        return "jump";
+    case Program::Opcode::jump_if_zero:
+        return "jz";
+    case Program::Opcode::call:
+        return "call";
+    case Program::Opcode::recurse:
+        return "recurse";
+    case Program::Opcode::tail_recurse:
+        return "tailrecurse";
+    case Program::Opcode::reduce:
+        return "reduce";
+    }
+    return "?";
+}
+}
+
+bool Program::straight_line() const
+{
+    for (auto const& instruction : code)
+    {
+        switch (instruction.op)
+        {
+        case Opcode::jump:
+        case Opcode::jump_if_zero:
+        case Opcode::call:
+        case Opcode::recurse:
+        case Opcode::tail_recurse:
+        case Opcode::reduce:
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+char const* Program::name(Reduction reduction)
+{
+    switch (reduction)
+    {
+    case Reduction::sum:
+        return "sum";
+    case Reduction::product:
+        return "prod";
+    case Reduction::minimum:
+        return "min";
+    case Reduction::maximum:
+        return "max";
+    }
+    return "?";
+}
+
+template <typename Value>
+std::string BasicProgram<Value>::disassemble() const
+{
+    std::string text;
+    for (std::size_t i = 0; i < code.size(); i++)
+    {
+        Instruction const& instruction = code[i];
+        text += std::to_string(i) + ": " + mnemonic(instruction.op);
+        switch (instruction.op)
+        {
+        case Opcode::push_literal:
+            text += " " + Numeric<Value>::to_string(Numeric<Value>::decode(instruction.immediate));
+            break;
+        case Opcode::push_constant:
+            text += " " + Numeric<Value>::to_string(constants[instruction.slot]);
+            break;
+        case Opcode::load_symbol:
+            text += " " + AtomTable::name(symbols[instruction.slot]);
+            break;
+        case Opcode::save_temp:
+        case Opcode::load_temp:
+            text += " t" + std::to_string(instruction.slot);
+            break;
+        case Opcode::jump:
+        case Opcode::jump_if_zero:
+            text += " " + std::to_string(instruction.immediate);
+            break;
+        case Opcode::call:
+            text += " " + AtomTable::name(functions[instruction.slot]->name) + "/" +
+                std::to_string(instruction.immediate);
+            break;
+        case Opcode::recurse:
+        case Opcode::tail_recurse:
+            text += " /" + std::to_string(instruction.immediate);
+            break;
+        case Opcode::reduce:
+            text += " " + std::string(name(reductions[instruction.slot]->kind)) + " #" +
+                std::to_string(instruction.slot);
+            break;
+        default:
+            break;
+        }
+        text += "\n";
+    }
+    if (assigned_symbol.has_value())
+    {
+        text += (formula ? "bind " : "store ") + AtomTable::name(assigned_symbol.value()) + "\n";
+    }
+    for (std::size_t i = 0; i < reductions.size(); i++)
+    {
+        BasicReduction<Value> const& reduction = *reductions[i];
+        text += "#" + std::to_string(i) + ", " + name(reduction.kind) + " over " +
+            AtomTable::name(reduction.body.symbols.back());
+        if (reduction.degree.has_value())
+        {
+            text += ", closed form of degree " + std::to_string(reduction.degree.value());
+        }
+        text += ":\n" + reduction.body.disassemble();
+    }
+    return text;
+}
+
+#define INSTANTIATE(Value) template class BasicProgram<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
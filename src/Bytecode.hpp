@@ -0,0 +1,164 @@
+#ifndef GUARD_BYTECODE_HPP
+#define GUARD_BYTECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "AtomTable.hpp"
+
+// A line compiled to postfix code for the stack machine in
+// VirtualMachine.hpp. Symbols read by the line are referred to through slots:
+// indices into `symbols`, which the caller resolves into a frame of values
+// before running the program.
+//
+// Code runs straight through, except for `if`, which jumps forward, and
+// calls of functions (see Function.hpp) and reductions (see Reduction.hpp),
+// whose bodies are programs too.
+//
+// Program is the part of the code that doesn't depend on the type of
+// values, see BasicProgram. Its storage comes from the memory resource it is
+// constructed with; copies use the default one.
+class Program
+{
+public:
+    // Machine word of immediates. For a BasicProgram<Value> these encode
+    // values through Numeric<Value>::encode.
+    using value_type = long;
+    using slot_type = std::uint32_t;
+    using atom = AtomTable::atom;
+
+    enum class Opcode : std::uint8_t
+    {
+        push_literal,
+        // Pushes constants[slot].
+        push_constant,
+        load_symbol,
+        negate,
+        bit_not,
+        identity,
+        power,
+        multiply,
+        divide,
+        modulo,
+        add,
+        subtract,
+        // Copies the top of the stack into temporary `slot`, leaving it on
+        // the stack.
+        save_temp,
+        // Pushes temporary `slot`.
+        load_temp,
+        // Continues at instruction `immediate`, unconditionally or when the
+        // value it pops is zero.
+        jump,
+        jump_if_zero,
+        // Calls functions[slot] with the `immediate` values on top of the
+        // stack as arguments, replacing them with its result.
+        call,
+        // The same for the function whose body is running, and its tail
+        // call: the arguments replace the frame and the body starts over.
+        recurse,
+        tail_recurse,
+        // Combines the values of reductions[slot] for every index from the
+        // value below the top of the stack to the top one, replacing both.
+        reduce
+    };
+
+    // How a reduction combines the values of its body.
+    enum class Reduction : std::uint8_t
+    {
+        sum,
+        product,
+        minimum,
+        maximum
+    };
+
+    struct Instruction
+    {
+        Opcode op;
+        slot_type slot;
+        value_type immediate;
+    };
+
+public:
+    std::pmr::vector<Instruction> code;
+    std::pmr::vector<atom> symbols;
+
+    // Symbol that receives the result when the line is an assignment. Such a
+    // line produces no value.
+    std::optional<atom> assigned_symbol;
+    // The assignment binds the expression itself (":="), not its value.
+    bool formula = false;
+
+    std::size_t max_stack = 0;
+
+    // Values computed once and reused by the line (common subexpressions).
+    // They live right after the stack, so a caller provides scratch_size()
+    // values for both.
+    std::size_t temporaries = 0;
+
+public:
+    Program() = default;
+    explicit Program(std::pmr::memory_resource* memory)
+        : code(memory)
+        , symbols(memory)
+    {
+    }
+
+    std::size_t scratch_size() const
+    {
+        return max_stack + temporaries;
+    }
+
+    // Whether the code runs from the first instruction to the last, without
+    // jumps or calls.
+    bool straight_line() const;
+
+    // The name of the built-in computing `reduction`, such as "sum".
+    static char const* name(Reduction reduction);
+};
+
+template <typename Value>
+struct BasicFunction;
+template <typename Value>
+struct BasicReduction;
+
+// A Program computing with `Value`. Literals are immediates in the
+// instructions; the rare ones with no 64 bit encoding are kept in
+// `constants` instead.
+template <typename Value>
+class BasicProgram : public Program
+{
+public:
+    using function_pointer = std::shared_ptr<BasicFunction<Value> const>;
+    using reduction_pointer = std::shared_ptr<BasicReduction<Value> const>;
+
+public:
+    std::pmr::vector<Value> constants;
+    // Functions the code calls, as they were when it was compiled.
+    std::pmr::vector<function_pointer> functions;
+    std::pmr::vector<reduction_pointer> reductions;
+
+    // Set for a line defining a function, which has no code.
+    function_pointer definition;
+
+public:
+    BasicProgram() = default;
+    explicit BasicProgram(std::pmr::memory_resource* memory)
+        : Program(memory)
+        , constants(memory)
+        , functions(memory)
+        , reductions(memory)
+    {
+    }
+
+    // One instruction per line, for :explain, followed by the bodies of
+    // the reductions.
+    std::string disassemble() const;
+};
+
+#endif
@@ -1,426 +1,881 @@
 #include <algorithm>
-#include <cctype>
-#include <cmath>
+#include <cstdint>
+#include <filesystem>
 #include <functional>
 #include <iostream>
 #include <list>
 #include <map>
+#include <memory>
 #include <optional>
-#include <regex>
-#include <sstream>
-#include <stack>
-#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_set>
-#include <variant>
+#include <utility>
 #include <vector>
 
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
 #include "Calculator.hpp"
+#include "CompiledExpression.hpp"
+#include "Compiler.hpp"
+#include "Diagnostic.hpp"
+#include "FormulaGraph.hpp"
+#include "Journal.hpp"
+#include "Lexer.hpp"
+#include "Numeric.hpp"
+#include "ResultCache.hpp"
+#include "SharedScope.hpp"
+#include "Snapshot.hpp"
+#include "Stats.hpp"
+#include "VirtualMachine.hpp"
 
 #include "prettyprint.hpp"
 
-Calculator::Calculator(Calculator const& other)
-    : symbol_table(other.symbol_table)
+// The words of a command's arguments.
+static std::vector<std::string> words(std::string const& arguments)
 {
+    std::vector<std::string> found;
+    std::size_t end = 0;
+    while (true)
+    {
+        std::size_t begin = arguments.find_first_not_of(" \t", end);
+        if (begin == std::string::npos)
+        {
+            return found;
+        }
+        end = arguments.find_first_of(" \t", begin);
+        found.push_back(arguments.substr(begin, end - begin));
+    }
+}
+
+template <typename Value>
+BasicCalculator<Value>::BasicCalculator()
+    : scratch(scratch_buffer.data(), scratch_buffer.size(), &memory), cache(&memory)
+{
+}
+
+template <typename Value>
+BasicCalculator<Value>::BasicCalculator(std::shared_ptr<SharedScope<Value>> globals)
+    : scratch(scratch_buffer.data(), scratch_buffer.size(), &memory), cache(&memory), globals(std::move(globals))
+{
+    shared_symbols = this->globals->read(shared_generation);
 }
 
-Calculator& Calculator::operator=(const Calculator &other)
+template <typename Value>
+BasicCalculator<Value>::BasicCalculator(BasicCalculator const& other)
+    : scratch(scratch_buffer.data(), scratch_buffer.size(), &memory),
+      symbol_table(other.symbol_table), formulas(other.formulas), cache(&memory), functions(other.functions),
+      definitions(other.definitions), globals(other.globals), shared_symbols(other.shared_symbols), shared_generation(other.shared_generation),
+      confined(other.confined)
 {
+    STATS_COUNT(calculator_copies);
+}
+
+template <typename Value>
+BasicCalculator<Value>& BasicCalculator<Value>::operator=(const BasicCalculator &other)
+{
+    STATS_COUNT(calculator_copies);
     symbol_table = other.symbol_table;
+    formulas = other.formulas;
+    functions = other.functions;
+    definitions = other.definitions;
+    globals = other.globals;
+    shared_symbols = other.shared_symbols;
+    shared_generation = other.shared_generation;
+    confined = other.confined;
+    cache.clear();
     return *this;
 }
 
-std::vector<std::map<std::string, std::function<Calculator::calc_option(Calculator&, std::string)>>> const Calculator::unary_ops = {
-    {
-        // TODO: Maybe factor this out.
-        {"-",
-         [](Calculator& calc, std::string a) {
-             return calc_option(std::to_string(-calc.get_value(a)));
+template <typename Value>
+std::map<std::string, std::function<Calculator::calc_option(BasicCalculator<Value>&, std::string const&)>> const BasicCalculator<Value>::commands = {
+    {"checkpoint",
+     [](BasicCalculator& calc, std::string const&) {
+         calc.symbol_table.checkpoint();
+         calc.log(":checkpoint");
+         return calc_option();
+     }
+    },
+    {"rollback",
+     [](BasicCalculator& calc, std::string const&) {
+         if (!calc.symbol_table.rollback())
+         {
+             throw calculator_error(Diagnostic::Code::command, "There is no checkpoint to roll back to.");
          }
-        },
-        {"~",
-         [](Calculator& calc, std::string a) {
-             return calc_option(std::to_string(~calc.get_value(a)));
-            }
-        },
-        {"+",
-         [](Calculator& calc, std::string a) {
-             return calc_option(std::to_string(+calc.get_value(a)));
-            }
-        }
-    }
-};
-
-std::vector<std::map<std::string, std::function<Calculator::calc_option(Calculator &, std::string, std::string)>>> const Calculator::binary_ops = {
-    {
-        {"**",
-         [](Calculator &calc, std::string const a, std::string const b) {
-             return calc_option(std::to_string(calc_type(std::pow(calc.get_value(a), calc.get_value(b)))));
+         // Formulas aren't part of checkpoints: they stay, and are evaluated
+         // again with the restored values.
+         if (!calc.formulas.empty())
+         {
+             calc.recompute(calc.formulas.all());
          }
-        }
+         calc.log(":rollback");
+         return calc_option();
+     }
     },
-    {
-        {"*",
-         [](Calculator &calc, std::string const a, std::string const b) {
-             return calc_option(std::to_string(calc.get_value(a) * calc.get_value(b)));
-         }
-        },
-        {"/",
-         [](Calculator &calc, std::string const a, std::string const b) {
-             return calc_option(std::to_string(calc.get_value(a) / calc.get_value(b)));
+    {"cache",
+     [](BasicCalculator& calc, std::string const& arguments) {
+         if (arguments == "clear")
+         {
+             calc.cache.clear();
+             return calc_option();
          }
-        },
-        {"%",
-         [](Calculator &calc, std::string const a, std::string const b) {
-             return calc_option(std::to_string(calc.get_value(a) % calc.get_value(b)));
+         if (!arguments.empty())
+         {
+             throw calculator_error(Diagnostic::Code::command, "Usage: :cache [clear]");
          }
-        }
+         auto const& stats = calc.cache.stats;
+         return calc_option("hits " + std::to_string(stats.hits) +
+                            ", misses " + std::to_string(stats.misses) +
+                            ", evictions " + std::to_string(stats.evictions) +
+                            ", entries " + std::to_string(calc.cache.size()) +
+                            "/" + std::to_string(calc.cache.max_size()));
+     }
     },
-    {
-        {"+",
-         [](Calculator &calc, std::string a, std::string b) {
-             return calc_option(std::to_string(calc.get_value(a) + calc.get_value(b)));
+    {"stats",
+     [](BasicCalculator& calc, std::string const& arguments) {
+         // The statistics are those of the whole process.
+         calc.check_confined("stats");
+         if (!Stats::enabled)
+         {
+             throw calculator_error(Diagnostic::Code::command, "Statistics are compiled out.");
          }
-        },
-        {"-",
-         [](Calculator &calc, std::string a, std::string b) {
-             return calc_option(std::to_string(calc.get_value(a) - calc.get_value(b)));
+         if (arguments == "reset")
+         {
+             Stats::reset();
+             return calc_option();
          }
-        }
+         if (!arguments.empty())
+         {
+             throw calculator_error(Diagnostic::Code::command, "Usage: :stats [reset]");
+         }
+         return calc_option(Stats::report());
+     }
     },
-    {
-        {"=",
-         [](Calculator &calc, std::string a, std::string b) {
-             if (!is_symbol(a))
+    {"publish",
+     [](BasicCalculator& calc, std::string const& arguments) {
+         // What one session publishes, every other one reads.
+         calc.check_confined("publish");
+         if (calc.globals == nullptr)
+         {
+             throw calculator_error(Diagnostic::Code::command, "There is no shared scope to publish to.");
+         }
+         std::vector<AtomTable::atom> symbols;
+         for (auto const& name : words(arguments))
+         {
+             auto id = AtomTable::find(name);
+             if (!id.has_value() || calc.symbol_table.find(id.value()) == nullptr)
              {
-                 throw Calculator::calculator_error(a + " is not a valid symbol"
-                                                      " name. symbols can only contain "
-                                                      "alphabetic characters.");
+                 throw calculator_error(Diagnostic::Code::command, name + " is not defined.");
              }
-             calc.symbol_table[a] = calc.get_value(b);
+             if (calc.formulas.find(id.value()) != nullptr)
+             {
+                 throw calculator_error(Diagnostic::Code::command, name + " is a formula, which can't be published.");
+             }
+             symbols.push_back(id.value());
+         }
+         calc.publish(symbols);
+         calc.log(":publish " + arguments);
+         return calc_option();
+     }
+    },
+    {"save",
+     [](BasicCalculator& calc, std::string const& arguments) {
+         calc.check_confined("save");
+         auto file = words(arguments);
+         if (file.size() != 1)
+         {
+             throw calculator_error(Diagnostic::Code::command, "Usage: :save FILE");
+         }
+         calc.save(file.front());
+         return calc_option();
+     }
+    },
+    {"load",
+     [](BasicCalculator& calc, std::string const& arguments) {
+         calc.check_confined("load");
+         auto names = words(arguments);
+         if (names.empty())
+         {
+             throw calculator_error(Diagnostic::Code::command, "Usage: :load FILE [SYMBOL...]");
+         }
+         if (names.size() == 1)
+         {
+             calc.restore(names.front());
              return calc_option();
          }
-        }
+
+         // Only the symbols named, found through the snapshot's index.
+         Snapshot<Value> snapshot(names.front());
+         std::vector<std::pair<AtomTable::atom, calc_type>> loaded;
+         for (auto name = std::next(names.begin()); name != names.end(); ++name)
+         {
+             auto found = snapshot.find(*name);
+             if (!found.has_value())
+             {
+                 throw calculator_error(Diagnostic::Code::command, *name + " is not in " + names.front() + ".");
+             }
+             loaded.emplace_back(AtomTable::intern(*name), snapshot.value(found.value()));
+         }
+         for (auto const& [symbol, value] : loaded)
+         {
+             calc.assign(symbol, value);
+         }
+         return calc_option();
+     }
+    },
+    {"explain",
+     [](BasicCalculator& calc, std::string const& expression) {
+         return calc_option(Compiler<Value>::explain(expression, &calc.functions));
+     }
     }
 };
 
-std::unordered_set<std::string> Calculator::operators_tokens = [](){
-    std::unordered_set<std::string> ret;
+std::string strip(std::string stripping, std::string to_strip)
+{
+    std::unordered_set<char> strip_set(to_strip.begin(), to_strip.end());
+
+    std::string ret;
+    std::copy_if(stripping.begin(), stripping.end(), back_inserter(ret),
+            [&strip_set](char s) {
+                return strip_set.count(s) == 0;
+            });
+    return ret;
+}
+
+template <typename Value>
+Calculator::calc_option BasicCalculator<Value>::execute(std::string command)
+{
+    auto text = evaluate(command);
+    if (!text.has_value())
+    {
+        std::cerr << text.error().message << std::endl;
+        return calc_option();
+    }
+    return text.value();
+}
 
-    for (auto const& priority_level : unary_ops)
+template <typename Value>
+Calculator::calc_option BasicCalculator<Value>::execute(std::list<std::string> parts)
+{
+    // Tokens are lexed again from their text, which also checks them.
+    std::string line;
+    for (auto const& part : parts)
     {
-        for (auto const& op : priority_level)
+        line += part;
+        line += ' ';
+    }
+    return execute(line);
+}
+
+template <typename Value>
+std::optional<Value> BasicCalculator<Value>::execute_value(std::string const& command)
+{
+    auto value = evaluate_value(command);
+    if (!value.has_value())
+    {
+        std::cerr << value.error().message << std::endl;
+        return std::nullopt;
+    }
+    return value.value();
+}
+
+template <typename Value>
+Expected<Calculator::calc_option> BasicCalculator<Value>::evaluate(std::string const& line)
+{
+    if (is_command(line))
+    {
+        try
         {
-            ret.insert(op.first);
+            return run_command(line);
+        }
+        catch (calculator_error const& ce)
+        {
+            return ce.diagnostic();
         }
     }
 
-    for (auto const& priority_level : binary_ops)
+    auto value = evaluate_value(line);
+    if (!value.has_value())
     {
-        for (auto const& op : priority_level)
+        return value.error();
+    }
+    if (!value.value().has_value())
+    {
+        return calc_option();
+    }
+    return calc_option(Numeric<Value>::to_string(value.value().value()));
+}
+
+template <typename Value>
+Expected<std::optional<Value>> BasicCalculator<Value>::evaluate_value(std::string const& line)
+{
+    // Malformed lines and undefined symbols come back from run() as
+    // diagnostics; what is still thrown comes from evaluating, such as
+    // dividing by zero.
+    try
+    {
+        if (is_command(line))
         {
-            ret.insert(op.first);
+            run_command(line);
+            return std::optional<calc_type>();
         }
+        return run(line);
     }
+    catch (calculator_error const& ce)
+    {
+        return ce.diagnostic();
+    }
+}
 
-    // Parenthesis are not operators but should be reserved nonetheless.
-    ret.insert("(");
-    ret.insert(")");
+bool Calculator::is_command(std::string const& command)
+{
+    auto first = command.find_first_not_of(" \t");
+    return first != std::string::npos && command[first] == ':';
+}
 
-    return ret;
-}();
+bool Calculator::is_definition(std::string const& line)
+{
+    auto first = line.find_first_not_of(" \t");
+    return first != std::string::npos && line.compare(first, 3, "def") == 0 && first + 3 < line.size() &&
+        (line[first + 3] == ' ' || line[first + 3] == '\t');
+}
 
-std::string strip(std::string stripping, std::string to_strip)
+template <typename Value>
+Calculator::calc_option BasicCalculator<Value>::run_command(std::string const& command)
 {
-    std::unordered_set<char> strip_set(to_strip.begin(), to_strip.end());
+    auto name_begin = command.find(':') + 1;
+    auto name_end = command.find_first_of(" \t", name_begin);
+    std::string name = command.substr(name_begin, name_end - name_begin);
 
-    std::string ret;
-    std::copy_if(stripping.begin(), stripping.end(), back_inserter(ret),
-            [&strip_set](char s) {
-                return strip_set.count(s) == 0;
-            });
-    return ret;
+    std::string arguments;
+    if (name_end != std::string::npos)
+    {
+        auto arguments_begin = command.find_first_not_of(" \t", name_end);
+        auto arguments_end = command.find_last_not_of(" \t");
+        if (arguments_begin != std::string::npos)
+        {
+            arguments = command.substr(arguments_begin, arguments_end - arguments_begin + 1);
+        }
+    }
+
+    auto found = commands.find(name);
+    if (found == commands.end())
+    {
+        throw calculator_error(Diagnostic::Code::command, ":" + name + " is not a command.");
+    }
+    refresh();
+    return found->second(*this, arguments);
 }
 
-Calculator::calc_option Calculator::execute(std::string command)
+template <typename Value>
+Value const* BasicCalculator<Value>::find_symbol(AtomTable::atom symbol) const
 {
-    std::list<std::string> tokenized;
-    try
+    calc_type const* found = symbol_table.find(symbol);
+    if (found == nullptr && shared_symbols != nullptr)
     {
-        tokenized = tokenize(command);
+        found = shared_symbols->find(symbol);
     }
-    catch (calculator_error const& ce)
+    return found;
+}
+
+template <typename Value>
+std::uint64_t BasicCalculator<Value>::symbol_version(AtomTable::atom symbol) const
+{
+    if (symbol_table.find(symbol) == nullptr && shared_symbols != nullptr && shared_symbols->find(symbol) != nullptr)
     {
-        std::cerr << ce.what() << std::endl;
-        return calc_option();
+        return shared_symbols->version(symbol) | shared_version;
     }
-    return execute(tokenized);
+    return symbol_table.version(symbol);
 }
 
-Calculator::calc_option Calculator::execute(std::list<std::string> parts)
+template <typename Value>
+void BasicCalculator<Value>::refresh()
 {
-    Calculator new_state(*this);
-    calc_option ret;
+    if (globals == nullptr || globals->get_generation() == shared_generation)
+    {
+        return;
+    }
+    shared_symbols = globals->read(shared_generation);
+    // Formulas may read shared symbols that changed.
+    if (!formulas.empty())
+    {
+        recompute(formulas.all());
+    }
+}
 
-    try
+template <typename Value>
+void BasicCalculator<Value>::publish(std::vector<AtomTable::atom> const& symbols)
+{
+    std::vector<AtomTable::atom> moving = symbols;
+    if (moving.empty())
     {
-        std::stack<std::list<std::string>::iterator> parenthesis;
-        auto it = parts.begin();
-        while (it != parts.end())
-        {
-            if (*it == "(")
+        symbol_table.for_each([this, &moving](AtomTable::atom symbol, calc_type const&) {
+            if (formulas.find(symbol) == nullptr)
             {
-                parenthesis.push(it);
+                moving.push_back(symbol);
             }
-            else if (*it == ")")
-            {
-                if (parenthesis.empty())
-                {
-                    throw calculator_error("Unbalanced parenthesis");
-                }
-
-                auto temp = execute(std::list<std::string>(std::next(parenthesis.top()), it));
-                it = parts.erase(parenthesis.top(), std::next(it));
-                parenthesis.pop();
-
-                if (!temp.has_value())
-                {
-                    if (parts.empty())
-                    {
-                        ret = calc_option();
-                        goto exit_execution;
-                    }
-                    throw calculator_error("Invalid operation.");
-                }
+        });
+    }
 
-                it = parts.insert(it, temp.value());
-            }
-            it++;
-        }
-        // There must be no parenthesis left to match
-        if (!parenthesis.empty())
+    globals->update([this, &moving](SymbolTable<Value>& shared) {
+        for (AtomTable::atom symbol : moving)
         {
-            throw calculator_error("Unbalanced parenthesis");
+            shared.set(symbol, *symbol_table.find(symbol));
         }
+    });
+    for (AtomTable::atom symbol : moving)
+    {
+        symbol_table.erase(symbol);
+    }
+    refresh();
+}
 
-        // First check if any unary operation is present. Unary operations have
-        // higuer priority than binary ones.
-        for (auto const& priorities : unary_ops)
-        {
-            if (parts.size() < 2)
-            {
-                break;
-            }
+template <typename Value>
+void BasicCalculator<Value>::save(std::string const& path)
+{
+    Snapshot<Value>::save(path, symbol_table, formulas);
+    // What the journal held is in the snapshot now.
+    restart_journal(path);
+}
 
-            // All of our unary operations take the argument to the right of
-            // them.
-            for (auto it = std::prev(parts.end());; it--)
-            {
-                // We must make sure that the argument to the left (if any) is
-                // not a symbol or literal.
-                if (priorities.find(*it) != priorities.end() &&
-                    (it == parts.begin() || is_operator(*std::prev(it))))
-                {
-                    calc_option result = priorities.at(*it)(new_state, *std::next(it));
-                    it = parts.erase(it, std::next(it, 2));
-                    if (result.has_value())
-                    {
-                        it = parts.insert(it, result.value());
-                    }
-                    else
-                    {
-                        // Operations that don't return value must be the last
-                        // ones.
-                        if (!parts.empty())
-                        {
-                            throw calculator_error("Invalid command.");
-                        }
-                        ret = calc_option();
-                        goto exit_execution;
-                    }
-                }
+template <typename Value>
+void BasicCalculator<Value>::restore(std::string const& path)
+{
+    // Built aside, so a damaged file leaves the session as it was.
+    Snapshot<Value> snapshot(path);
+    std::vector<std::string_view> names;
+    names.reserve(snapshot.size());
+    for (std::size_t i = 0; i < snapshot.size(); i++)
+    {
+        names.push_back(snapshot.name(i));
+    }
+    std::vector<AtomTable::atom> atoms = AtomTable::intern(names);
+    SymbolTable<Value> restored_symbols;
+    for (std::size_t i = 0; i < snapshot.size(); i++)
+    {
+        restored_symbols.set(atoms[i], snapshot.value(i));
+    }
+    FormulaGraph<Value> restored_formulas;
+    for (std::size_t i = 0; i < snapshot.formula_count(); i++)
+    {
+        auto [target, program] = snapshot.formula(i);
+        restored_formulas.define(target, std::move(program));
+    }
 
-                if (it == parts.begin())
-                {
-                    break;
-                }
-            }
-        }
+    symbol_table = std::move(restored_symbols);
+    formulas = std::move(restored_formulas);
+    // Versions start over with the new table, so cached results can't be
+    // told from fresh ones.
+    cache.clear();
+    if (!formulas.empty())
+    {
+        recompute(formulas.all());
+    }
+    restart_journal(path);
+}
 
+template <typename Value>
+void BasicCalculator<Value>::confine()
+{
+    confined = true;
+}
 
-        for (auto const& priorities : binary_ops)
+template <typename Value>
+void BasicCalculator<Value>::restart_journal(std::string const& path)
+{
+    if (journal != nullptr)
+    {
+        journal->restart(std::filesystem::absolute(path));
+        for (auto const& line : definitions)
         {
-            if (parts.size() < 3)
-            {
-                break;
-            }
-
-            // Binary operations take two arguments around them.
-            for (auto it = std::next(parts.begin());
-                std::distance(parts.begin(), it) >= 1 &&
-                std::distance(it, parts.end()) >= 2;
-                it++)
-            {
-                if (priorities.find(*it) != priorities.end())
-                {
-                    calc_option result = priorities.at(*it)(new_state, *std::prev(it), *std::next(it));
-                    it = parts.erase(std::prev(it), std::next(it, 2));
-                    if (result.has_value())
-                    {
-                        it = parts.insert(it, result.value());
-                    }
-                    else
-                    {
-                        // Operations that don't return value must be the last
-                        // ones.
-                        if (!parts.empty())
-                        {
-                            throw calculator_error("Invalid command.");
-                        }
-                        ret = calc_option();
-                        goto exit_execution;
-                    }
-                }
-            }
+            journal->line(line);
         }
+    }
+}
 
-        if (parts.size() != 1)
+template <typename Value>
+void BasicCalculator<Value>::recover(std::string const& path, std::string const& snapshot)
+{
+    if (!snapshot.empty())
+    {
+        // The changes of a journal only apply to the snapshot it names.
+        std::size_t records = Journal::read(path, [](Journal::Record const&) {});
+        if (records > 1)
         {
-            throw calculator_error("Something went wrong.");
+            throw calculator_error(Diagnostic::Code::file,
+                                   path + " holds changes to recover, which need the snapshot it names.");
         }
+        journal = std::make_shared<Journal>(path, Numeric<Value>::name);
+        restore(snapshot);
+        return;
+    }
 
-        std::string result = parts.front();
-        if (is_symbol(result))
+    Journal::read(path, [this, &path](Journal::Record const& record) {
+        switch (record.kind)
         {
-            if (symbol_table.count(result) != 0)
+        case Journal::Kind::base:
+            if (record.name != Numeric<Value>::name)
             {
-                ret = calc_option(std::to_string(symbol_table.at(result)));
+                throw calculator_error(Diagnostic::Code::file,
+                                       path + " doesn't hold " + Numeric<Value>::name + " values.");
             }
-            else
+            if (!record.data.empty())
             {
-                throw calculator_error(" is not defined" );
+                restore(std::string(record.data));
             }
-
+            break;
+        case Journal::Kind::assign:
+        {
+            auto value = Numeric<Value>::from_bytes(record.data);
+            if (!value.has_value())
+            {
+                throw calculator_error(Diagnostic::Code::file, path + " is damaged.");
+            }
+            assign(AtomTable::intern(record.name), value.value());
+            break;
         }
-        else if (is_literal(result))
+        case Journal::Kind::line:
+            // Lines that failed when logged fail the same way again.
+            evaluate(std::string(record.data));
+            break;
+        }
+    });
+    journal = std::make_shared<Journal>(path, Numeric<Value>::name);
+}
+
+template <typename Value>
+void BasicCalculator<Value>::commit()
+{
+    if (journal != nullptr)
+    {
+        journal->commit();
+    }
+}
+
+template <typename Value>
+void BasicCalculator<Value>::log(std::string const& line)
+{
+    if (journal != nullptr)
+    {
+        journal->line(line);
+    }
+}
+
+template <typename Value>
+void BasicCalculator<Value>::check_confined(std::string const& name) const
+{
+    if (confined)
+    {
+        throw calculator_error(Diagnostic::Code::command, ":" + name + " is not allowed in this session.");
+    }
+}
+
+template <typename Value>
+std::optional<Value> BasicCalculator<Value>::lookup(std::string const& symbol) const
+{
+    auto id = AtomTable::find(symbol);
+    if (!id.has_value())
+    {
+        return std::nullopt;
+    }
+    return lookup(id.value());
+}
+
+template <typename Value>
+std::optional<Value> BasicCalculator<Value>::lookup(AtomTable::atom symbol) const
+{
+    calc_type const* found = find_symbol(symbol);
+    if (found == nullptr)
+    {
+        return std::nullopt;
+    }
+    return *found;
+}
+
+template <typename Value>
+void BasicCalculator<Value>::assign(std::string const& symbol, calc_type const& value)
+{
+    if (!Compiler<Value>::is_symbol(symbol))
+    {
+        throw calculator_error(Diagnostic::Code::invalid_symbol, symbol + " is not a valid symbol name.");
+    }
+    assign(AtomTable::intern(symbol), value);
+}
+
+template <typename Value>
+void BasicCalculator<Value>::assign(AtomTable::atom symbol, calc_type const& value)
+{
+    symbol_table.set(symbol, value);
+    if (journal != nullptr)
+    {
+        thread_local std::string bytes;
+        bytes.clear();
+        Numeric<Value>::to_bytes(bytes, value);
+        journal->assign(AtomTable::name(symbol), bytes);
+    }
+    if (!formulas.empty() && formulas.involves(symbol))
+    {
+        // A value assigned over a formula replaces it.
+        formulas.remove(symbol);
+        recompute(formulas.affected({symbol}));
+    }
+}
+
+template <typename Value>
+bool BasicCalculator<Value>::drives_formulas(AtomTable::atom symbol) const
+{
+    return formulas.involves(symbol);
+}
+
+template <typename Value>
+bool BasicCalculator<Value>::has_formulas() const
+{
+    return !formulas.empty();
+}
+
+template <typename Value>
+FunctionTable<Value> const& BasicCalculator<Value>::function_table() const
+{
+    return functions;
+}
+
+template <typename Value>
+Calculator::calculator_error BasicCalculator<Value>::undefined(AtomTable::atom symbol) const
+{
+    std::string const* error = formulas.error(symbol);
+    if (error != nullptr)
+    {
+        return calculator_error(Diagnostic::Code::formula_failed,
+                                AtomTable::name(symbol) + " could not be computed: " + *error);
+    }
+    return calculator_error(Diagnostic::Code::undefined, AtomTable::name(symbol) + " is not defined.");
+}
+
+template <typename Value>
+CompiledExpression BasicCalculator<Value>::compile(std::string const& expression) const
+{
+    auto program = Compiler<CompiledExpression::value_type>::compile(expression);
+    if (program.assigned_symbol.has_value())
+    {
+        throw calculator_error(Diagnostic::Code::invalid_argument, "Assignments can't be compiled into an expression.");
+    }
+    // Columns are computed an operation at a time, all rows together, which
+    // leaves no room for rows taking different branches.
+    if (program.definition != nullptr)
+    {
+        throw calculator_error(Diagnostic::Code::invalid_argument, "Definitions can't be compiled into an expression.");
+    }
+    if (!program.straight_line())
+    {
+        throw calculator_error(Diagnostic::Code::invalid_argument, "Conditions can't be compiled into an expression.");
+    }
+
+    std::vector<std::optional<CompiledExpression::value_type>> defaults;
+    defaults.reserve(program.symbols.size());
+    for (auto const& symbol : program.symbols)
+    {
+        calc_type const* found = find_symbol(symbol);
+        if (found != nullptr)
         {
-            ret = calc_option(result);
+            auto word = Numeric<Value>::to_word(*found);
+            if (!word.has_value())
+            {
+                throw calculator_error(Diagnostic::Code::invalid_argument,
+                                       AtomTable::name(symbol) + " is not a 64 bit integer.");
+            }
+            defaults.push_back(word.value());
         }
         else
         {
-            throw calculator_error(result + " is not a symbol or literal.");
+            defaults.push_back(std::nullopt);
         }
     }
-    catch (calculator_error const& ce)
-    {
-        std::cerr << ce.what() << std::endl;
-        return calc_option();
-    }
 
-    exit_execution:
-    *this = new_state;
-    return ret;
+    return CompiledExpression(std::move(program), std::move(defaults));
 }
 
-std::list<std::string> Calculator::tokenize(std::string s)
+template <typename Value>
+Expected<std::optional<Value>> BasicCalculator<Value>::run(std::string const& line)
 {
-    std::list<std::string> ret;
+    STATS_COUNT(lines);
+    scratch.release();
+    refresh();
+    thread_local std::vector<Lexer::Token> tokens;
+    {
+        STATS_TIME(tokenize);
+        if (auto error = Lexer::tokenize(line, tokens))
+        {
+            return std::move(error.value());
+        }
+    }
 
-    auto it = s.begin();
-    while (it != s.end())
+    // A line just compiled has no result yet, so only a line found in the
+    // cache can be fresh.
+    typename ResultCache<Value>::Entry* entry;
+    bool fresh;
+    {
+        STATS_TIME(cache);
+        entry = cache.find(tokens);
+        fresh = entry != nullptr && entry->result.has_value() &&
+            std::equal(entry->program.symbols.begin(), entry->program.symbols.end(), entry->versions.begin(),
+                       [this](AtomTable::atom symbol, std::uint64_t version) {
+                           return symbol_version(symbol) == version;
+                       });
+    }
+    if (entry == nullptr)
     {
-        // Skip whitespace
-        if (isspace(*it))
+        // Only kept until it is copied into the cache.
+        auto program = [this, &line] {
+            STATS_TIME(compile);
+            return Compiler<Value>::try_compile(line, tokens, &scratch, &functions);
+        }();
+        if (!program.has_value())
         {
-            it = std::find_if_not(it, s.end(),
-                                  [](char c){
-                                      return isspace(c);
-                                  });
+            return program.error();
         }
-        else if (std::isalpha(*it))
+        if (program.value().definition != nullptr)
         {
-            auto temp = std::find_if_not(it, s.end(),
-                                         [](char c){
-                                             return std::isalnum(c);
-                                         });
-            ret.push_back(std::string(it, temp));
-            it = temp;
+            define_function(line, program.value());
+            return std::optional<calc_type>();
         }
-        else if (std::ispunct(*it))
+        // Defining a formula has no result to reuse.
+        if (program.value().formula)
         {
-            auto temp = std::find_if_not(it, s.end(),
-                                         [](char c){
-                                             return std::ispunct(c);
-                                         });
-            while (operators_tokens.count(std::string(it, temp)) == 0 && it != temp)
+            define(line, program.value());
+            return std::optional<calc_type>();
+        }
+        entry = &cache.insert(program.value());
+    }
+
+    BasicProgram<Value> const& program = entry->program;
+    calc_type result;
+    if (fresh)
+    {
+        cache.stats.hits++;
+        result = entry->result.value();
+    }
+    else
+    {
+        cache.stats.misses++;
+        entry->result.reset();
+
+        // Kept between lines so their storage is reused.
+        thread_local std::vector<calc_type> frame;
+        thread_local std::vector<calc_type> stack;
+        {
+            STATS_TIME(lookup);
+            if (auto missing = resolve(program, frame))
             {
-                temp--;
+                Diagnostic error = undefined(missing.value()).diagnostic();
+                // The symbol's first appearance in the line.
+                for (auto const& token : tokens)
+                {
+                    if (token.kind == Lexer::Kind::symbol && token.text == AtomTable::name(missing.value()))
+                    {
+                        error.offset = std::size_t(token.text.data() - line.data());
+                        break;
+                    }
+                }
+                return error;
             }
-            if (temp == it)
+            entry->versions.clear();
+            for (auto const& symbol : program.symbols)
             {
-                throw calculator_error("Invalid operator used.");
+                entry->versions.push_back(symbol_version(symbol));
             }
-
-            ret.push_back(std::string(it, temp));
-            it = temp;
         }
-        else if (std::isdigit(*it))
-        {
-            auto temp = std::find_if_not(it, s.end(),
-                                         [](char c){
-                                             return std::isdigit(c);
-                                         });
-            ret.push_back(std::string(it, temp));
-            it = temp;
-        }
-        else
+
         {
-            throw calculator_error("Invalid command");
+            STATS_TIME(evaluate);
+            stack.resize(program.scratch_size());
+            result = VirtualMachine::run(program, frame.data(), stack.data());
         }
+        entry->result = result;
     }
 
-    return ret;
+    if (program.assigned_symbol.has_value())
+    {
+        assign(program.assigned_symbol.value(), result);
+        return std::optional<calc_type>();
+    }
+    return std::optional<calc_type>(std::move(result));
 }
 
-bool Calculator::is_symbol(std::string s)
+template <typename Value>
+std::optional<AtomTable::atom> BasicCalculator<Value>::resolve(Program const& program,
+                                                               std::vector<calc_type>& frame) const
 {
-    std::regex symbol("[a-zA-Z]\\w*");
-    return std::regex_match(s, symbol);
+    frame.clear();
+    frame.reserve(program.symbols.size());
+    for (auto const& symbol : program.symbols)
+    {
+        calc_type const* found = find_symbol(symbol);
+        if (found == nullptr)
+        {
+            return symbol;
+        }
+        frame.push_back(*found);
+    }
+    return std::nullopt;
 }
 
-bool Calculator::is_literal(std::string s)
+template <typename Value>
+void BasicCalculator<Value>::define(std::string const& line, BasicProgram<Value> const& program)
 {
-    std::regex literal("-?\\d+");
-    return std::regex_match(s, literal);
+    AtomTable::atom target = program.assigned_symbol.value();
+    formulas.define(target, program);
+    log(line);
+    recompute(formulas.affected({target}));
+
+    std::string const* error = formulas.error(target);
+    if (error != nullptr)
+    {
+        throw calculator_error(Diagnostic::Code::formula_failed, *error);
+    }
 }
 
-bool Calculator::is_operator(std::string s)
+template <typename Value>
+void BasicCalculator<Value>::define_function(std::string const& line, BasicProgram<Value> const& program)
 {
-    return operators_tokens.count(s) != 0;
+    auto const& function = program.definition;
+    auto inserted = functions.emplace(function->name, function);
+    if (!inserted.second)
+    {
+        inserted.first->second = function;
+        // Cached lines call the function they were compiled with.
+        cache.clear();
+    }
+    definitions.push_back(line);
+    log(line);
 }
 
-Calculator::calc_type Calculator::get_value(std::string s) const
+template <typename Value>
+void BasicCalculator<Value>::recompute(std::vector<AtomTable::atom> const& order)
 {
-    if (is_symbol(s))
+    STATS_TIME(formulas);
+    std::vector<calc_type> frame;
+    std::vector<calc_type> stack;
+    for (AtomTable::atom target : order)
     {
+        BasicProgram<Value> const& program = *formulas.find(target);
         try
         {
-            return symbol_table.at(s);
+            if (auto missing = resolve(program, frame))
+            {
+                throw undefined(missing.value());
+            }
+            stack.resize(program.scratch_size());
+            symbol_table.set(target, VirtualMachine::run(program, frame.data(), stack.data()));
+            formulas.set_error(target, std::string());
         }
-        catch (std::out_of_range const&)
+        catch (calculator_error const& ce)
         {
-            throw Calculator::calculator_error(s + " is not defined.");
+            symbol_table.erase(target);
+            formulas.set_error(target, ce.what());
         }
     }
-    else if (is_literal(s))
-    {
-        Calculator::calc_type ret;
-        std::istringstream in(s);
-        in >> ret;
-        return ret;
-    }
-    else
-    {
-        throw Calculator::calculator_error(s + " is not a literal or symbol");
-    }
 }
+
+#define INSTANTIATE(Value) template class BasicCalculator<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
@@ -3,27 +3,49 @@
 
 #include <functional>
 #include <list>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <stdexcept>
 #include <string>
-#include <unordered_set>
-#include <utility>
 #include <vector>
 
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "CompiledExpression.hpp"
+#include "Diagnostic.hpp"
+#include "FormulaGraph.hpp"
+#include "Function.hpp"
+#include "Journal.hpp"
+#include "ResultCache.hpp"
+#include "SharedScope.hpp"
+#include "SymbolTable.hpp"
+
+// The part of a calculator that doesn't depend on the type of its values:
+// the error every stage throws, and telling commands from expressions.
+// The calculator itself is BasicCalculator.
 class Calculator
 {
 public:
     class calculator_error : public std::runtime_error
     {
+private:
+        Diagnostic::Code error_code;
+        std::size_t error_offset;
+
 public:
-        calculator_error(char const* msg)
-            : std::runtime_error(msg)
+        calculator_error(Diagnostic::Code code, std::string const& msg,
+                         std::size_t offset = Diagnostic::no_offset)
+            : std::runtime_error(msg), error_code(code), error_offset(offset)
         {
         }
 
-        calculator_error(std::string const& msg)
-            : std::runtime_error(msg)
+        explicit calculator_error(Diagnostic const& diagnostic)
+            : calculator_error(diagnostic.code, diagnostic.message, diagnostic.offset)
         {
         }
 
@@ -31,41 +53,181 @@ public:
         {
             return std::runtime_error::what();;
         }
+
+        Diagnostic::Code code() const
+        {
+            return error_code;
+        }
+
+        Diagnostic diagnostic() const
+        {
+            return {error_code, what(), error_offset};
+        }
     };
 
-private:
-    using calc_type = long;
+public:
+    static bool is_command(std::string const& command);
+    // Whether `line` defines a function, "def f(x) = ...".
+    static bool is_definition(std::string const& line);
+
+protected:
     using calc_option = std::optional<std::string>;
 
 private:
-    // All unary operators have more precedence than the binary_ones
-    static std::vector<std::map<std::string, std::function<calc_option(Calculator&, std::string)>>> const unary_ops;
-    static std::vector<std::map<std::string, std::function<calc_option(Calculator&, std::string, std::string)>>> const binary_ops;
+    static std::string strip(std::string stripping, std::string to_strip);
+};
+
+// A calculator computing with `Value`, one of the types listed by
+// FOR_EACH_NUMERIC_TYPE in Numeric.hpp, for which the members are
+// instantiated in Calculator.cpp. Every stage is specialized for the type
+// at compile time: nothing dispatches on it at run time.
+template <typename Value>
+class BasicCalculator : public Calculator
+{
+public:
+    using calc_type = Value;
+
+private:
+    // REPL commands, written as ":name arguments". Each returns the text to
+    // show, if any.
+    static std::map<std::string, std::function<calc_option(BasicCalculator&, std::string const&)>> const commands;
+
+    static constexpr std::size_t scratch_size = 16 * 1024;
 
-    static std::unordered_set<std::string> operators_tokens;
+    // Set in the versions of shared symbols, so they never equal versions
+    // of the calculator's own.
+    static constexpr std::uint64_t shared_version = std::uint64_t(1) << 63;
 
 private:
-    std::map<std::string, calc_type> symbol_table;
+    // Memory of this calculator alone, so calculators in one process don't
+    // contend for the global allocator. The pool holds the result cache;
+    // `scratch` holds whatever a line needs only while it is evaluated, and
+    // is reset before each line, giving back the buffer and anything taken
+    // from the pool past it.
+    std::pmr::unsynchronized_pool_resource memory;
+    std::array<std::byte, scratch_size> scratch_buffer;
+    std::pmr::monotonic_buffer_resource scratch;
+
+    SymbolTable<Value> symbol_table;
+    FormulaGraph<Value> formulas;
+    ResultCache<Value> cache;
+
+    // The functions defined so far, and the lines defining them, in order.
+    // Snapshots don't hold functions, so a journal starting over from one
+    // logs the lines again.
+    FunctionTable<Value> functions;
+    std::vector<std::string> definitions;
+
+    // Symbols shared with other calculators, read where symbol_table has
+    // none, and the snapshot of them in use.
+    std::shared_ptr<SharedScope<Value>> globals;
+    typename SharedScope<Value>::snapshot shared_symbols;
+    std::uint64_t shared_generation = 0;
+
+    // Where changes are logged, if anywhere. Copies don't log theirs.
+    std::shared_ptr<Journal> journal;
+
+    // Set for a session serving clients other than its own user, which
+    // must not touch files or see what other sessions do.
+    bool confined = false;
 
 public:
-    Calculator() = default;
-    Calculator(Calculator const& other);
-    ~Calculator() = default;
+    BasicCalculator();
+    explicit BasicCalculator(std::shared_ptr<SharedScope<Value>> globals);
+    // A copy starts with an empty result cache of its own.
+    BasicCalculator(BasicCalculator const& other);
+    ~BasicCalculator() = default;
 
-    Calculator& operator=(Calculator const& other);
+    BasicCalculator& operator=(BasicCalculator const& other);
 
     calc_option execute(std::list<std::string> parts);
     calc_option execute(std::string command);
 
+    // Same as execute, but hands back the value instead of its text.
+    // Commands produce no value.
+    std::optional<calc_type> execute_value(std::string const& command);
+
+    // Same as execute and execute_value, but errors are returned instead of
+    // printed, so they can be told apart from lines without output.
+    // Nothing is thrown.
+    Expected<calc_option> evaluate(std::string const& line);
+    Expected<std::optional<calc_type>> evaluate_value(std::string const& line);
+
+    std::optional<calc_type> lookup(std::string const& symbol) const;
+    std::optional<calc_type> lookup(AtomTable::atom symbol) const;
+    void assign(std::string const& symbol, calc_type const& value);
+    void assign(AtomTable::atom symbol, calc_type const& value);
+
+    // Whether assigning `symbol` does more than store a value: it replaces a
+    // formula, or formulas read it and are evaluated again.
+    bool drives_formulas(AtomTable::atom symbol) const;
+    bool has_formulas() const;
+
+    // The functions lines are compiled with.
+    FunctionTable<Value> const& function_table() const;
+
+    // The error for reading `symbol` when it has no value.
+    calculator_error undefined(AtomTable::atom symbol) const;
+
+    // Writes the symbols and formulas of this calculator, not those of the
+    // shared scope, to a snapshot file, and replaces them with those of
+    // one. Restoring drops checkpoints. Both throw calculator_error.
+    void save(std::string const& path);
+    void restore(std::string const& path);
+    // Makes the commands reaching past this session fail, for sessions of
+    // a Server: :save and :load, :stats, and :publish. The API above still
+    // works.
+    void confine();
+
+    // Recovers the session logged in the journal at `path`, from the
+    // snapshot it starts from, and logs every change from now on. With a
+    // `snapshot`, the journal must hold no changes, and starts from it.
+    // Throws calculator_error.
+    void recover(std::string const& path, std::string const& snapshot);
+    // Waits until the changes logged so far are on disk, if there is a
+    // journal. Throws calculator_error if they can't be written.
+    void commit();
+
+    // Parses `expression` once for repeated evaluation. Variables that are
+    // never bound take the value they have in this calculator right now,
+    // which must be an integer that fits in 64 bits.
+    CompiledExpression compile(std::string const& expression) const;
+
 private:
-    static std::list<std::string> tokenize(std::string s);
-    static std::string strip(std::string stripping, std::string to_strip);
+    calc_option run_command(std::string const& command);
+
+    // The value of a symbol of this calculator, or else of the shared scope.
+    calc_type const* find_symbol(AtomTable::atom symbol) const;
+    std::uint64_t symbol_version(AtomTable::atom symbol) const;
+    // Moves to the latest snapshot of the shared scope, if there is a newer
+    // one, evaluating formulas again.
+    void refresh();
+    // Moves `symbols` to the shared scope, or every symbol that isn't a
+    // formula when there are none.
+    void publish(std::vector<AtomTable::atom> const& symbols);
 
-    static bool is_symbol(std::string s);
-    static bool is_literal(std::string s);
-    static bool is_operator(std::string s);
+    // Evaluates a line that is not a command, reusing its program, and if
+    // no symbol it reads changed its result, from the cache. Returns the
+    // errors of reading the line and of undefined symbols; those of
+    // evaluating it are thrown.
+    Expected<std::optional<calc_type>> run(std::string const& line);
+    // Fills `frame` with the values of the symbols `program` reads, and
+    // returns the first that has none, if any.
+    std::optional<AtomTable::atom> resolve(Program const& program, std::vector<calc_type>& frame) const;
 
-    calc_type get_value(std::string s) const;
+    // Binds a formula defined by `line`.
+    void define(std::string const& line, BasicProgram<Value> const& program);
+    // Adds or replaces the function defined by `line`.
+    void define_function(std::string const& line, BasicProgram<Value> const& program);
+    // Starts the journal, if any, over from the snapshot at `path`.
+    void restart_journal(std::string const& path);
+    // Logs a line to evaluate again on recovery, if there is a journal.
+    void log(std::string const& line);
+    // Throws if confined, for the command `name`.
+    void check_confined(std::string const& name) const;
+    // Evaluates the formulas in `order`, as given by FormulaGraph. A formula
+    // that fails is left without value.
+    void recompute(std::vector<AtomTable::atom> const& order);
 };
 
 #endif
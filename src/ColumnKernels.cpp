@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "ColumnKernels.hpp"
+#include "Numeric.hpp"
+
+namespace
+{
+
+using value_type = ColumnKernels::value_type;
+
+// Same wrap around semantics as Numeric<long>.
+value_type wrap(unsigned long value)
+{
+    return static_cast<value_type>(value);
+}
+
+struct Negate
+{
+    static value_type scalar(value_type a)
+    {
+        return wrap(0ul - static_cast<unsigned long>(a));
+    }
+
+#if defined(__x86_64__)
+    static __m128i sse2(__m128i a)
+    {
+        return _mm_sub_epi64(_mm_setzero_si128(), a);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i avx2(__m256i a)
+    {
+        return _mm256_sub_epi64(_mm256_setzero_si256(), a);
+    }
+#endif
+};
+
+struct BitNot
+{
+    static value_type scalar(value_type a)
+    {
+        return ~a;
+    }
+
+#if defined(__x86_64__)
+    static __m128i sse2(__m128i a)
+    {
+        return _mm_xor_si128(a, _mm_set1_epi64x(-1));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i avx2(__m256i a)
+    {
+        return _mm256_xor_si256(a, _mm256_set1_epi64x(-1));
+    }
+#endif
+};
+
+struct Multiply
+{
+    static value_type scalar(value_type a, value_type b)
+    {
+        return wrap(static_cast<unsigned long>(a) * static_cast<unsigned long>(b));
+    }
+
+#if defined(__x86_64__)
+    // Neither instruction set has a 64 bit multiply, so the low half of the
+    // product is built from three 32x32 bit ones.
+    static __m128i sse2(__m128i a, __m128i b)
+    {
+        __m128i low = _mm_mul_epu32(a, b);
+        __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b),
+                                      _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+        return _mm_add_epi64(low, _mm_slli_epi64(cross, 32));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i avx2(__m256i a, __m256i b)
+    {
+        __m256i low = _mm256_mul_epu32(a, b);
+        __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                         _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+        return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+    }
+#endif
+};
+
+struct Add
+{
+    static value_type scalar(value_type a, value_type b)
+    {
+        return wrap(static_cast<unsigned long>(a) + static_cast<unsigned long>(b));
+    }
+
+#if defined(__x86_64__)
+    static __m128i sse2(__m128i a, __m128i b)
+    {
+        return _mm_add_epi64(a, b);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i avx2(__m256i a, __m256i b)
+    {
+        return _mm256_add_epi64(a, b);
+    }
+#endif
+};
+
+struct Subtract
+{
+    static value_type scalar(value_type a, value_type b)
+    {
+        return wrap(static_cast<unsigned long>(a) - static_cast<unsigned long>(b));
+    }
+
+#if defined(__x86_64__)
+    static __m128i sse2(__m128i a, __m128i b)
+    {
+        return _mm_sub_epi64(a, b);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i avx2(__m256i a, __m256i b)
+    {
+        return _mm256_sub_epi64(a, b);
+    }
+#endif
+};
+
+template <typename Op>
+void portable_unary(value_type const* a, value_type* out, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++)
+    {
+        out[i] = Op::scalar(a[i]);
+    }
+}
+
+template <typename Op>
+void portable_binary(value_type const* a, value_type const* b, value_type* out, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++)
+    {
+        out[i] = Op::scalar(a[i], b[i]);
+    }
+}
+
+// Operations that can fail or have no vector instruction go through the
+// interpreter's own implementation one element at a time.
+template <Program::Opcode op>
+void checked_binary(value_type const* a, value_type const* b, value_type* out, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++)
+    {
+        out[i] = Numeric<value_type>::apply(op, a[i], b[i]);
+    }
+}
+
+#if defined(__x86_64__)
+template <typename Op>
+void sse2_unary(value_type const* a, value_type* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), Op::sse2(x));
+    }
+    portable_unary<Op>(a + i, out + i, n - i);
+}
+
+template <typename Op>
+void sse2_binary(value_type const* a, value_type const* b, value_type* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), Op::sse2(x, y));
+    }
+    portable_binary<Op>(a + i, b + i, out + i, n - i);
+}
+
+template <typename Op>
+__attribute__((target("avx2")))
+void avx2_unary(value_type const* a, value_type* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), Op::avx2(x));
+    }
+    portable_unary<Op>(a + i, out + i, n - i);
+}
+
+template <typename Op>
+__attribute__((target("avx2")))
+void avx2_binary(value_type const* a, value_type const* b, value_type* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), Op::avx2(x, y));
+    }
+    portable_binary<Op>(a + i, b + i, out + i, n - i);
+}
+#endif
+
+ColumnKernels const portable_kernels = {
+    "portable",
+    portable_unary<Negate>,
+    portable_unary<BitNot>,
+    checked_binary<Program::Opcode::power>,
+    portable_binary<Multiply>,
+    checked_binary<Program::Opcode::divide>,
+    checked_binary<Program::Opcode::modulo>,
+    portable_binary<Add>,
+    portable_binary<Subtract>
+};
+
+#if defined(__x86_64__)
+ColumnKernels const sse2_kernels = {
+    "sse2",
+    sse2_unary<Negate>,
+    sse2_unary<BitNot>,
+    checked_binary<Program::Opcode::power>,
+    sse2_binary<Multiply>,
+    checked_binary<Program::Opcode::divide>,
+    checked_binary<Program::Opcode::modulo>,
+    sse2_binary<Add>,
+    sse2_binary<Subtract>
+};
+
+ColumnKernels const avx2_kernels = {
+    "avx2",
+    avx2_unary<Negate>,
+    avx2_unary<BitNot>,
+    checked_binary<Program::Opcode::power>,
+    avx2_binary<Multiply>,
+    checked_binary<Program::Opcode::divide>,
+    checked_binary<Program::Opcode::modulo>,
+    avx2_binary<Add>,
+    avx2_binary<Subtract>
+};
+#endif
+
+}
+
+ColumnKernels const& ColumnKernels::best()
+{
+#if defined(__x86_64__)
+    // SSE2 is part of x86-64 itself; AVX2 has to be asked for.
+    static ColumnKernels const& chosen = __builtin_cpu_supports("avx2") ? avx2_kernels : sse2_kernels;
+    return chosen;
+#else
+    return portable_kernels;
+#endif
+}
+
+ColumnKernels const& ColumnKernels::portable()
+{
+    return portable_kernels;
+}
+
+std::vector<ColumnKernels const*> ColumnKernels::supported()
+{
+    std::vector<ColumnKernels const*> kernels{&portable_kernels};
+#if defined(__x86_64__)
+    kernels.push_back(&sse2_kernels);
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.push_back(&avx2_kernels);
+    }
+#endif
+    return kernels;
+}
+
+void ColumnKernels::apply(Program::Opcode op, value_type const* a, value_type* out, std::size_t n) const
+{
+    switch (op)
+    {
+    case Program::Opcode::negate:
+        negate(a, out, n);
+        break;
+    case Program::Opcode::bit_not:
+        bit_not(a, out, n);
+        break;
+    case Program::Opcode::identity:
+        if (out != a)
+        {
+            std::copy(a, a + n, out);
+        }
+        break;
+    default:
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_operation, "Invalid operation.");
+    }
+}
+
+void ColumnKernels::apply(Program::Opcode op, value_type const* a, value_type const* b, value_type* out, std::size_t n) const
+{
+    switch (op)
+    {
+    case Program::Opcode::power:
+        power(a, b, out, n);
+        break;
+    case Program::Opcode::multiply:
+        multiply(a, b, out, n);
+        break;
+    case Program::Opcode::divide:
+        divide(a, b, out, n);
+        break;
+    case Program::Opcode::modulo:
+        modulo(a, b, out, n);
+        break;
+    case Program::Opcode::add:
+        add(a, b, out, n);
+        break;
+    case Program::Opcode::subtract:
+        subtract(a, b, out, n);
+        break;
+    default:
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_operation, "Invalid operation.");
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef GUARD_COLUMN_KERNELS_HPP
+#define GUARD_COLUMN_KERNELS_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "Bytecode.hpp"
+
+// Element-wise loops used to evaluate an expression over whole columns. The
+// output may alias either input. Which implementation fills each entry is
+// decided once, at run time, from what the CPU supports.
+class ColumnKernels
+{
+public:
+    using value_type = Program::value_type;
+    using unary_kernel = void (*)(value_type const* a, value_type* out, std::size_t n);
+    using binary_kernel = void (*)(value_type const* a, value_type const* b, value_type* out, std::size_t n);
+
+public:
+    char const* name;
+
+    unary_kernel negate;
+    unary_kernel bit_not;
+
+    binary_kernel power;
+    binary_kernel multiply;
+    binary_kernel divide;
+    binary_kernel modulo;
+    binary_kernel add;
+    binary_kernel subtract;
+
+public:
+    static ColumnKernels const& best();
+    static ColumnKernels const& portable();
+    // Every implementation this CPU can run, portable() first, so they can
+    // be checked against each other.
+    static std::vector<ColumnKernels const*> supported();
+
+    void apply(Program::Opcode op, value_type const* a, value_type* out, std::size_t n) const;
+    void apply(Program::Opcode op, value_type const* a, value_type const* b, value_type* out, std::size_t n) const;
+};
+
+#endif
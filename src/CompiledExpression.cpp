@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "ColumnKernels.hpp"
+#include "CompiledExpression.hpp"
+#include "NativeCode.hpp"
+#include "VirtualMachine.hpp"
+
+namespace
+{
+
+std::size_t find_variable(std::vector<std::string> const& variables, std::string const& name)
+{
+    auto found = std::find(variables.begin(), variables.end(), name);
+    if (found == variables.end())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_argument,
+                                           name + " is not a variable of the expression.");
+    }
+    return std::size_t(std::distance(variables.begin(), found));
+}
+
+}
+
+CompiledExpression::CompiledExpression(BasicProgram<value_type> program, std::vector<std::optional<value_type>> defaults)
+    : program(std::move(program)), defaults(std::move(defaults)), native(std::make_shared<Native>())
+{
+    for (auto symbol : this->program.symbols)
+    {
+        names.push_back(AtomTable::name(symbol));
+    }
+}
+
+std::vector<std::string> const& CompiledExpression::variables() const
+{
+    return names;
+}
+
+std::size_t CompiledExpression::index_of(std::string const& name) const
+{
+    return find_variable(names, name);
+}
+
+CompiledExpression::Bindings CompiledExpression::bindings() const
+{
+    return Bindings(*this);
+}
+
+CompiledExpression::value_type CompiledExpression::evaluate(Bindings& bindings) const
+{
+    if (bindings.values.size() != program.symbols.size() ||
+        bindings.stack.size() < program.scratch_size())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_argument,
+                                           "Bindings belong to a different expression.");
+    }
+    if (bindings.unbound != 0)
+    {
+        auto missing = std::find(bindings.bound.begin(), bindings.bound.end(), false);
+        throw Calculator::calculator_error(Diagnostic::Code::undefined,
+            names[std::size_t(std::distance(bindings.bound.begin(), missing))] +
+            " is not defined.");
+    }
+
+    NativeCode const* code = native->code.load(std::memory_order_acquire);
+    if (code == nullptr && native->evaluations.fetch_add(1, std::memory_order_relaxed) + 1 == native_threshold)
+    {
+        code = promote();
+    }
+    if (code != nullptr)
+    {
+        return code->run(bindings.values.data(), bindings.stack.data());
+    }
+    return VirtualMachine::run(program, bindings.values.data(), bindings.stack.data());
+}
+
+NativeCode const* CompiledExpression::promote() const
+{
+    // Only the evaluation reaching the threshold gets here, so nothing else
+    // writes `storage`; others see the code once `code` is published.
+    native->storage = NativeCode::compile(program);
+    if (!native->storage.has_value())
+    {
+        return nullptr;
+    }
+    NativeCode const* code = &native->storage.value();
+    native->code.store(code, std::memory_order_release);
+    return code;
+}
+
+CompiledExpression::ColumnBindings CompiledExpression::columns() const
+{
+    return ColumnBindings(*this);
+}
+
+std::vector<CompiledExpression::value_type> CompiledExpression::evaluate(ColumnBindings const& columns) const
+{
+    if (columns.columns.size() != program.symbols.size())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_argument,
+                                           "Bindings belong to a different expression.");
+    }
+
+    std::optional<std::size_t> rows;
+    for (std::size_t i = 0; i < columns.columns.size(); i++)
+    {
+        if (columns.columns[i].has_value())
+        {
+            if (rows.has_value() && rows.value() != columns.columns[i]->size)
+            {
+                throw Calculator::calculator_error(Diagnostic::Code::invalid_argument,
+                                                   "Columns have different lengths.");
+            }
+            rows = columns.columns[i]->size;
+        }
+        else if (!defaults[i].has_value())
+        {
+            throw Calculator::calculator_error(Diagnostic::Code::undefined, names[i] + " is not defined.");
+        }
+    }
+    if (!rows.has_value())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_argument, "No column is bound.");
+    }
+
+    ColumnKernels const& kernels = ColumnKernels::best();
+    std::vector<value_type> result(rows.value());
+
+    // Stack position k works in scratch[k * column_block, (k + 1) *
+    // column_block) and operands[k] points at its current values, which may
+    // still be the caller's column. Temporaries follow the stack positions.
+    std::vector<value_type> scratch(program.scratch_size() * column_block);
+    std::vector<value_type const*> operands(program.max_stack);
+
+    for (std::size_t row = 0; row < rows.value(); row += column_block)
+    {
+        std::size_t n = std::min(column_block, rows.value() - row);
+        std::size_t depth = 0;
+
+        for (auto const& instruction : program.code)
+        {
+            switch (instruction.op)
+            {
+            case Program::Opcode::push_literal:
+            {
+                value_type* out = scratch.data() + depth * column_block;
+                std::fill_n(out, n, instruction.immediate);
+                operands[depth++] = out;
+                break;
+            }
+            case Program::Opcode::push_constant:
+            {
+                value_type* out = scratch.data() + depth * column_block;
+                std::fill_n(out, n, program.constants[instruction.slot]);
+                operands[depth++] = out;
+                break;
+            }
+            case Program::Opcode::load_symbol:
+            {
+                auto const& column = columns.columns[instruction.slot];
+                if (column.has_value())
+                {
+                    operands[depth++] = column->data + row;
+                }
+                else
+                {
+                    value_type* out = scratch.data() + depth * column_block;
+                    std::fill_n(out, n, defaults[instruction.slot].value());
+                    operands[depth++] = out;
+                }
+                break;
+            }
+            case Program::Opcode::identity:
+                break;
+            case Program::Opcode::negate:
+            case Program::Opcode::bit_not:
+            {
+                value_type* out = scratch.data() + (depth - 1) * column_block;
+                kernels.apply(instruction.op, operands[depth - 1], out, n);
+                operands[depth - 1] = out;
+                break;
+            }
+            case Program::Opcode::power:
+            case Program::Opcode::multiply:
+            case Program::Opcode::divide:
+            case Program::Opcode::modulo:
+            case Program::Opcode::add:
+            case Program::Opcode::subtract:
+            {
+                value_type* out = scratch.data() + (depth - 2) * column_block;
+                kernels.apply(instruction.op, operands[depth - 2], operands[depth - 1], out, n);
+                operands[depth - 2] = out;
+                depth--;
+                break;
+            }
+            case Program::Opcode::save_temp:
+            {
+                value_type* out = scratch.data() + (program.max_stack + instruction.slot) * column_block;
+                std::copy_n(operands[depth - 1], n, out);
+                break;
+            }
+            case Program::Opcode::load_temp:
+                operands[depth++] = scratch.data() + (program.max_stack + instruction.slot) * column_block;
+                break;
+            case Program::Opcode::jump:
+            case Program::Opcode::jump_if_zero:
+            case Program::Opcode::call:
+            case Program::Opcode::recurse:
+            case Program::Opcode::tail_recurse:
+            case Program::Opcode::reduce:
+                // Refused by BasicCalculator::compile.
+                break;
+            }
+        }
+
+        std::copy_n(operands[0], n, result.data() + row);
+    }
+
+    return result;
+}
+
+CompiledExpression::Bindings::Bindings(CompiledExpression const& expression)
+    : variables(expression.names),
+      values(expression.defaults.size()),
+      bound(expression.defaults.size()),
+      unbound(0),
+      stack(expression.program.scratch_size())
+{
+    for (std::size_t i = 0; i < values.size(); i++)
+    {
+        bound[i] = expression.defaults[i].has_value();
+        if (bound[i])
+        {
+            values[i] = expression.defaults[i].value();
+        }
+        else
+        {
+            unbound++;
+        }
+    }
+}
+
+void CompiledExpression::Bindings::set(std::size_t index, value_type value)
+{
+    if (index >= values.size())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_argument, "Variable index out of range.");
+    }
+    if (!bound[index])
+    {
+        bound[index] = true;
+        unbound--;
+    }
+    values[index] = value;
+}
+
+void CompiledExpression::Bindings::set(std::string const& name, value_type value)
+{
+    set(find_variable(variables, name), value);
+}
+
+CompiledExpression::value_type CompiledExpression::Bindings::get(std::size_t index) const
+{
+    return values.at(index);
+}
+
+CompiledExpression::ColumnBindings::ColumnBindings(CompiledExpression const& expression)
+    : variables(expression.names),
+      columns(expression.program.symbols.size())
+{
+}
+
+void CompiledExpression::ColumnBindings::set(std::size_t index, Column column)
+{
+    if (index >= columns.size())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::invalid_argument, "Variable index out of range.");
+    }
+    columns[index] = column;
+}
+
+void CompiledExpression::ColumnBindings::set(std::string const& name, Column column)
+{
+    set(find_variable(variables, name), column);
+}
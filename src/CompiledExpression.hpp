@@ -0,0 +1,118 @@
+#ifndef GUARD_COMPILED_EXPRESSION_HPP
+#define GUARD_COMPILED_EXPRESSION_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "NativeCode.hpp"
+
+// An expression parsed once by BasicCalculator::compile and evaluated any number
+// of times with different values for its variables. Once it has been
+// evaluated often enough it runs as NativeCode where that is supported.
+//
+// Whatever the type of the calculator, compiled expressions compute with
+// 64 bit machine words that wrap around on overflow (Numeric<long>).
+class CompiledExpression
+{
+public:
+    using value_type = Program::value_type;
+
+    // Values for the variables of one expression. Reusing a Bindings object
+    // keeps CompiledExpression::evaluate free of parsing and allocations.
+    class Bindings
+    {
+    public:
+        void set(std::size_t index, value_type value);
+        void set(std::string const& name, value_type value);
+
+        value_type get(std::size_t index) const;
+
+    private:
+        friend class CompiledExpression;
+
+        Bindings(CompiledExpression const& expression);
+
+        std::vector<std::string> variables;
+        std::vector<value_type> values;
+        std::vector<bool> bound;
+        std::size_t unbound;
+        std::vector<value_type> stack;
+    };
+
+    // Read-only view of a column of values, like std::span<value_type const>.
+    struct Column
+    {
+        value_type const* data;
+        std::size_t size;
+    };
+
+    // Whole columns of values for the variables of one expression. Variables
+    // left unbound take their default value on every row.
+    class ColumnBindings
+    {
+    public:
+        void set(std::size_t index, Column column);
+        void set(std::string const& name, Column column);
+
+    private:
+        friend class CompiledExpression;
+
+        ColumnBindings(CompiledExpression const& expression);
+
+        std::vector<std::string> variables;
+        std::vector<std::optional<Column>> columns;
+    };
+
+private:
+    // Rows evaluated per step of the columnar interpreter, small enough for
+    // the working columns to stay in cache.
+    static constexpr std::size_t column_block = 1024;
+
+    // Evaluations through Bindings after which the expression is compiled
+    // to native code.
+    static constexpr std::size_t native_threshold = 64;
+
+    // Shared by copies of an expression, which may be evaluated from several
+    // threads at once.
+    struct Native
+    {
+        std::atomic<std::size_t> evaluations{0};
+        std::atomic<NativeCode const*> code{nullptr};
+        std::optional<NativeCode> storage;
+    };
+
+private:
+    BasicProgram<value_type> program;
+    std::vector<std::string> names;
+
+    // Value of each variable in the calculator when the expression was
+    // compiled, used for variables that are never bound.
+    std::vector<std::optional<value_type>> defaults;
+
+    std::shared_ptr<Native> native;
+
+public:
+    std::vector<std::string> const& variables() const;
+    std::size_t index_of(std::string const& name) const;
+
+    Bindings bindings() const;
+    value_type evaluate(Bindings& bindings) const;
+
+    ColumnBindings columns() const;
+    std::vector<value_type> evaluate(ColumnBindings const& columns) const;
+
+private:
+    template <typename Value>
+    friend class BasicCalculator;
+
+    CompiledExpression(BasicProgram<value_type> program, std::vector<std::optional<value_type>> defaults);
+
+    NativeCode const* promote() const;
+};
+
+#endif
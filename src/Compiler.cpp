@@ -0,0 +1,1109 @@
+#include <algorithm>
+#include <cstddef>
+#include <cctype>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Ast.hpp"
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "Compiler.hpp"
+#include "Function.hpp"
+#include "Lexer.hpp"
+#include "Numeric.hpp"
+#include "Operators.hpp"
+#include "Optimizer.hpp"
+#include "Reduction.hpp"
+
+template <typename Value>
+Compiler<Value>::Compiler(std::string_view source, token_iterator begin, token_iterator end, Workspace& work,
+                          std::pmr::memory_resource* memory, FunctionTable<Value> const* functions)
+    : source(source), it(begin), end(end), tree(work.tree), program(memory), functions(functions), uses(work.uses),
+      temps(work.temps), saved(work.saved)
+{
+    tree.clear();
+}
+
+template <typename Value>
+BasicProgram<Value> Compiler<Value>::compile(std::string_view line, std::pmr::memory_resource* memory)
+{
+    thread_local std::vector<Lexer::Token> tokens;
+    if (auto error = Lexer::tokenize(line, tokens))
+    {
+        throw Calculator::calculator_error(error.value());
+    }
+
+    auto program = try_compile(line, tokens, memory);
+    if (!program.has_value())
+    {
+        throw Calculator::calculator_error(program.error());
+    }
+    return std::move(program.value());
+}
+
+template <typename Value>
+Expected<BasicProgram<Value>> Compiler<Value>::try_compile(std::string_view line,
+                                                           std::vector<Lexer::Token> const& tokens,
+                                                           std::pmr::memory_resource* memory,
+                                                           FunctionTable<Value> const* functions)
+{
+    thread_local Workspace work;
+    Compiler compiler = parse(line, tokens, work, memory, functions);
+    if (compiler.error.has_value())
+    {
+        return std::move(compiler.error.value());
+    }
+    return std::move(compiler.program);
+}
+
+template <typename Value>
+std::string Compiler<Value>::explain(std::string_view line, FunctionTable<Value> const* functions)
+{
+    std::vector<Lexer::Token> tokens;
+    if (auto error = Lexer::tokenize(line, tokens))
+    {
+        throw Calculator::calculator_error(error.value());
+    }
+    Workspace work;
+    Compiler compiler = parse(line, tokens, work, std::pmr::get_default_resource(), functions);
+    if (compiler.error.has_value())
+    {
+        throw Calculator::calculator_error(compiler.error.value());
+    }
+
+    std::string text;
+    if (auto const& function = compiler.program.definition)
+    {
+        text += "def " + AtomTable::name(function->name) + "(";
+        for (auto parameter : function->body.symbols)
+        {
+            text += AtomTable::name(parameter) + ", ";
+        }
+        if (function->arity() != 0)
+        {
+            text.resize(text.size() - 2);
+        }
+        text += ") = " + compiler.tree.to_string(compiler.root, function->body.symbols) + "\n";
+        text += function->body.disassemble();
+        text.pop_back();
+        return text;
+    }
+    if (compiler.program.assigned_symbol.has_value())
+    {
+        text += AtomTable::name(compiler.program.assigned_symbol.value());
+        text += compiler.program.formula ? " := " : " = ";
+    }
+    text += compiler.tree.to_string(compiler.root, compiler.program.symbols) + "\n";
+    text += compiler.program.disassemble();
+    text.pop_back();
+    return text;
+}
+
+template <typename Value>
+Compiler<Value> Compiler<Value>::parse(std::string_view line, std::vector<Lexer::Token> const& tokens, Workspace& work,
+                                       std::pmr::memory_resource* memory, FunctionTable<Value> const* functions)
+{
+    if (tokens.empty())
+    {
+        Compiler compiler(line, nullptr, nullptr, work, memory, functions);
+        compiler.error = Diagnostic{Diagnostic::Code::empty_line, "Empty command."};
+        return compiler;
+    }
+
+    // Parenthesis around the whole line don't change its meaning, and an
+    // assignment is allowed inside them.
+    token_iterator begin = tokens.data();
+    token_iterator end = tokens.data() + tokens.size();
+    while (end - begin >= 2 && begin->kind == Lexer::Kind::open_paren &&
+           std::prev(end)->kind == Lexer::Kind::close_paren)
+    {
+        int open = 0;
+        auto closing = begin;
+        for (; closing != end; closing++)
+        {
+            if (closing->kind == Lexer::Kind::open_paren)
+            {
+                open++;
+            }
+            else if (closing->kind == Lexer::Kind::close_paren && --open == 0)
+            {
+                break;
+            }
+        }
+        if (closing != std::prev(end))
+        {
+            break;
+        }
+        begin++;
+        end--;
+    }
+
+    Compiler compiler(line, begin, end, work, memory, functions);
+    compiler.root = compiler.parse_statement();
+    if (!compiler.error.has_value())
+    {
+        compiler.generate();
+        if (compiler.defining.has_value())
+        {
+            compiler.finish_definition();
+        }
+    }
+    return compiler;
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::parse_statement()
+{
+    constexpr std::uint8_t below_assignment = Operators::assignment_precedence + 1;
+
+    node_id result = 0;
+    if (it != end && it->kind == Lexer::Kind::symbol && it->text == "def" && std::next(it) != end &&
+        std::next(it)->kind == Lexer::Kind::symbol)
+    {
+        it++;
+        result = parse_definition();
+    }
+    else if (it != end && it->kind == Lexer::Kind::symbol && std::next(it) != end &&
+        std::next(it)->infix != Operators::none &&
+        Operators::table[std::next(it)->infix].assignment != Operators::Assignment::none)
+    {
+        program.assigned_symbol = AtomTable::intern(it->text);
+        program.formula = Operators::table[std::next(it)->infix].assignment == Operators::Assignment::formula;
+        std::advance(it, 2);
+        result = parse_expression(below_assignment);
+    }
+    else
+    {
+        auto lhs_begin = it;
+        result = parse_expression(below_assignment);
+        if (!error.has_value() && at_assignment())
+        {
+            std::string lhs;
+            for (auto jt = lhs_begin; jt != it; jt++)
+            {
+                lhs += jt->text;
+            }
+            return fail(Diagnostic::Code::invalid_symbol, lhs + " is not a valid symbol"
+                                                          " name. symbols can only contain "
+                                                          "alphabetic characters.", lhs_begin);
+        }
+    }
+    if (error.has_value())
+    {
+        return result;
+    }
+
+    // Operations that don't return value must be the last ones.
+    if (at_assignment())
+    {
+        return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+    }
+
+    if (it != end)
+    {
+        if (it->kind == Lexer::Kind::close_paren)
+        {
+            return fail(Diagnostic::Code::unbalanced_parenthesis, "Unbalanced parenthesis", it);
+        }
+        return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+    }
+
+    return result;
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::parse_definition()
+{
+    token_iterator name = it++;
+    if (name->text == "def" || name->text == "if" || reduction(name->text).has_value())
+    {
+        return fail(Diagnostic::Code::invalid_symbol, std::string(name->text) + " can't name a function.", name);
+    }
+    if (it == end || it->kind != Lexer::Kind::open_paren)
+    {
+        return fail(Diagnostic::Code::syntax, "Expected the parameters of " + std::string(name->text) + ".", it);
+    }
+
+    // The parameters are the first symbols of the body, in order, so the
+    // arguments of a call are its frame.
+    token_iterator open = it++;
+    while (it != end && it->kind != Lexer::Kind::close_paren)
+    {
+        if (!program.symbols.empty())
+        {
+            if (it->kind != Lexer::Kind::comma)
+            {
+                return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+            }
+            it++;
+        }
+        if (it == end || it->kind != Lexer::Kind::symbol)
+        {
+            return fail(Diagnostic::Code::syntax, "Expected a parameter.", it);
+        }
+        Program::atom parameter = AtomTable::intern(it->text);
+        if (std::find(program.symbols.begin(), program.symbols.end(), parameter) != program.symbols.end())
+        {
+            return fail(Diagnostic::Code::invalid_symbol, std::string(it->text) + " is already a parameter.", it);
+        }
+        program.symbols.push_back(parameter);
+        it++;
+    }
+    if (it == end)
+    {
+        return fail(Diagnostic::Code::unbalanced_parenthesis, "Unbalanced parenthesis", open);
+    }
+    it++;
+
+    if (it == end || it->infix == Operators::none ||
+        Operators::table[it->infix].assignment != Operators::Assignment::value)
+    {
+        return fail(Diagnostic::Code::syntax, "Expected = after the parameters of " + std::string(name->text) + ".",
+                    it);
+    }
+    it++;
+
+    defining = AtomTable::intern(name->text);
+    return parse_expression(Operators::assignment_precedence + 1);
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::parse_expression(std::uint8_t min_precedence)
+{
+    node_id lhs = parse_operand();
+
+    while (!error.has_value() && it != end && it->infix != Operators::none)
+    {
+        auto const& op = Operators::table[it->infix];
+        if (op.assignment != Operators::Assignment::none || op.precedence < min_precedence)
+        {
+            break;
+        }
+        it++;
+
+        // A right associative operator lets the operand to its right grab
+        // operators of its own precedence.
+        node_id rhs = parse_expression(op.associativity == Operators::Associativity::left
+                                            ? std::uint8_t(op.precedence + 1)
+                                            : op.precedence);
+        if (error.has_value())
+        {
+            break;
+        }
+        lhs = Optimizer<Value>::binary(tree, op.opcode, lhs, rhs);
+    }
+
+    return lhs;
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::parse_operand()
+{
+    if (it == end)
+    {
+        return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+    }
+
+    Lexer::Token const& token = *it;
+    switch (token.kind)
+    {
+    case Lexer::Kind::op:
+    {
+        if (token.prefix == Operators::none)
+        {
+            return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+        }
+        auto const& op = Operators::table[token.prefix];
+        it++;
+        node_id operand = parse_expression(op.precedence);
+        if (error.has_value())
+        {
+            return operand;
+        }
+        return Optimizer<Value>::unary(tree, op.opcode, operand);
+    }
+    case Lexer::Kind::open_paren:
+    {
+        token_iterator open = it++;
+        node_id inner = parse_expression(Operators::assignment_precedence + 1);
+        if (error.has_value())
+        {
+            return inner;
+        }
+        if (at_assignment())
+        {
+            return fail(Diagnostic::Code::syntax, "Invalid operation.", it);
+        }
+        if (it == end || it->kind != Lexer::Kind::close_paren)
+        {
+            return fail(Diagnostic::Code::unbalanced_parenthesis, "Unbalanced parenthesis", open);
+        }
+        it++;
+        return inner;
+    }
+    case Lexer::Kind::close_paren:
+        return fail(Diagnostic::Code::unbalanced_parenthesis, "Unbalanced parenthesis", it);
+    case Lexer::Kind::comma:
+        return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+    case Lexer::Kind::symbol:
+    {
+        if (std::next(it) != end && std::next(it)->kind == Lexer::Kind::open_paren)
+        {
+            return parse_call();
+        }
+        Program::atom symbol = AtomTable::intern(token.text);
+        // The innermost index of that name hides the others, and symbols.
+        for (std::size_t depth = indices.size(); depth-- > 0;)
+        {
+            if (indices[depth] == symbol)
+            {
+                it++;
+                return tree.index(symbol, depth);
+            }
+        }
+        if (defining.has_value())
+        {
+            auto found = std::find(program.symbols.begin(), program.symbols.end(), symbol);
+            if (found == program.symbols.end())
+            {
+                return fail(Diagnostic::Code::undefined,
+                            std::string(token.text) + " is not a parameter of " +
+                                AtomTable::name(defining.value()) + ".",
+                            it);
+            }
+        }
+        // The slot is taken while parsing, so a symbol the optimizer drops
+        // is still resolved, and still reported when undefined.
+        it++;
+        return tree.symbol(slot_for(symbol));
+    }
+    case Lexer::Kind::literal:
+        it++;
+        return tree.number(Numeric<Value>::from_word(token.value));
+    case Lexer::Kind::numeral:
+        // Only numerals the type can't hold throw, and those are rare.
+        try
+        {
+            node_id number = tree.number(Numeric<Value>::parse(token.text));
+            it++;
+            return number;
+        }
+        catch (Calculator::calculator_error const& ce)
+        {
+            return fail(ce.code(), ce.what(), it);
+        }
+    }
+    return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::parse_call()
+{
+    if (auto built_in = reduction(it->text))
+    {
+        return parse_reduction(built_in.value());
+    }
+
+    token_iterator name = it;
+    token_iterator open = std::next(it);
+    it += 2;
+
+    std::vector<node_id> arguments;
+    while (it != end && it->kind != Lexer::Kind::close_paren)
+    {
+        if (!arguments.empty())
+        {
+            if (it->kind != Lexer::Kind::comma)
+            {
+                return fail(Diagnostic::Code::syntax, "Invalid command.", it);
+            }
+            it++;
+        }
+        node_id argument = parse_expression(Operators::assignment_precedence + 1);
+        if (error.has_value())
+        {
+            return argument;
+        }
+        if (at_assignment())
+        {
+            return fail(Diagnostic::Code::syntax, "Invalid operation.", it);
+        }
+        arguments.push_back(argument);
+    }
+    if (it == end)
+    {
+        return fail(Diagnostic::Code::unbalanced_parenthesis, "Unbalanced parenthesis", open);
+    }
+    it++;
+
+    if (name->text == "if")
+    {
+        if (arguments.size() != 3)
+        {
+            return fail(Diagnostic::Code::syntax, "if takes 3 arguments.", name);
+        }
+        return Optimizer<Value>::condition(tree, arguments[0], arguments[1], arguments[2]);
+    }
+
+    auto arity_error = [&](std::size_t arity) {
+        return fail(Diagnostic::Code::syntax,
+                    std::string(name->text) + " takes " + std::to_string(arity) +
+                        (arity == 1 ? " argument." : " arguments."),
+                    name);
+    };
+    auto chain = [&] {
+        node_id next = Tree::none;
+        for (auto argument = arguments.rbegin(); argument != arguments.rend(); argument++)
+        {
+            next = tree.argument(*argument, next);
+        }
+        return next;
+    };
+
+    auto id = AtomTable::find(name->text);
+    if (defining.has_value() && id == defining)
+    {
+        if (arguments.size() != program.symbols.size())
+        {
+            return arity_error(program.symbols.size());
+        }
+        recursive = true;
+        return tree.recurse(defining.value(), chain());
+    }
+
+    if (functions == nullptr || !id.has_value() || functions->count(id.value()) == 0)
+    {
+        return fail(Diagnostic::Code::undefined, std::string(name->text) + " is not a function.", name);
+    }
+    auto const& pointer = functions->at(id.value());
+    BasicFunction<Value> const& function = *pointer;
+    if (arguments.size() != function.arity())
+    {
+        return arity_error(function.arity());
+    }
+
+    // A copy of the body may leave an argument out, which is only right if
+    // evaluating it can't fail.
+    bool copy = function.tree.has_value();
+    for (std::size_t i = 0; copy && i < arguments.size(); i++)
+    {
+        copy = function.strict[i] || Optimizer<Value>::cannot_fail(tree, arguments[i]);
+    }
+    if (copy)
+    {
+        return inline_body(function, arguments);
+    }
+    return tree.call(function_slot(pointer), id.value(), chain());
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::parse_reduction(Program::Reduction reduction)
+{
+    token_iterator name = it;
+    token_iterator open = std::next(it);
+    it += 2;
+    std::string usage = std::string(name->text) + " takes an index, its bounds and a body.";
+
+    if (it == end || it->kind != Lexer::Kind::symbol || std::next(it) == end ||
+        std::next(it)->kind != Lexer::Kind::comma)
+    {
+        return fail(Diagnostic::Code::syntax, usage, name);
+    }
+    Program::atom index = AtomTable::intern(it->text);
+    it += 2;
+
+    // The bounds, then the body, each ended by a comma but the last.
+    node_id operands[3];
+    for (std::size_t i = 0; i < 3; i++)
+    {
+        if (i == 2)
+        {
+            indices.push_back(index);
+        }
+        operands[i] = parse_expression(Operators::assignment_precedence + 1);
+        if (i == 2)
+        {
+            indices.pop_back();
+        }
+        if (error.has_value())
+        {
+            return operands[i];
+        }
+        if (at_assignment())
+        {
+            return fail(Diagnostic::Code::syntax, "Invalid operation.", it);
+        }
+        if (it == end)
+        {
+            return fail(Diagnostic::Code::unbalanced_parenthesis, "Unbalanced parenthesis", open);
+        }
+        if (it->kind != (i < 2 ? Lexer::Kind::comma : Lexer::Kind::close_paren))
+        {
+            return fail(Diagnostic::Code::syntax, usage, name);
+        }
+        it++;
+    }
+    return tree.reduce(reduction, index, operands[2], operands[0], operands[1]);
+}
+
+template <typename Value>
+std::optional<Program::Reduction> Compiler<Value>::reduction(std::string_view name)
+{
+    for (auto candidate : {Program::Reduction::sum, Program::Reduction::product, Program::Reduction::minimum,
+                           Program::Reduction::maximum})
+    {
+        if (name == Program::name(candidate))
+        {
+            return candidate;
+        }
+    }
+    return std::nullopt;
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::inline_body(BasicFunction<Value> const& function,
+                                                               std::vector<node_id> const& arguments)
+{
+    // Operands come before their users, so one pass in id order rebuilds the
+    // body through the Optimizer, which folds it with the arguments.
+    Tree const& body = function.tree.value();
+    std::vector<node_id> copied(function.root + 1, Tree::none);
+    for (node_id id = 0; id <= function.root; id++)
+    {
+        typename Tree::Node const& node = body[id];
+        switch (node.kind)
+        {
+        case Tree::Kind::literal:
+            copied[id] = tree.literal(node.value);
+            break;
+        case Tree::Kind::constant:
+            copied[id] = tree.constant(body.number_at(id));
+            break;
+        case Tree::Kind::symbol:
+            copied[id] = arguments[node.slot];
+            break;
+        case Tree::Kind::unary:
+            copied[id] = Optimizer<Value>::unary(tree, node.op, copied[node.lhs]);
+            break;
+        case Tree::Kind::binary:
+            copied[id] = Optimizer<Value>::binary(tree, node.op, copied[node.lhs], copied[node.rhs]);
+            break;
+        case Tree::Kind::call:
+            copied[id] = tree.call(function_slot(function.body.functions[node.slot]), Program::atom(node.value),
+                                   node.lhs != Tree::none ? copied[node.lhs] : Tree::none);
+            break;
+        case Tree::Kind::argument:
+            copied[id] = tree.argument(copied[node.lhs], node.rhs != Tree::none ? copied[node.rhs] : Tree::none);
+            break;
+        case Tree::Kind::condition:
+        {
+            typename Tree::Node const& choices = body[node.rhs];
+            copied[id] = Optimizer<Value>::condition(tree, copied[node.lhs], copied[choices.lhs], copied[choices.rhs]);
+            break;
+        }
+        case Tree::Kind::index:
+            // Nested in the reductions around the call.
+            copied[id] = tree.index(Program::atom(node.value), node.slot + indices.size());
+            break;
+        case Tree::Kind::reduce:
+        {
+            typename Tree::Node const& bounds = body[node.rhs];
+            copied[id] = tree.reduce(Program::Reduction(node.slot), Program::atom(node.value), copied[node.lhs],
+                                     copied[bounds.lhs], copied[body[bounds.rhs].lhs]);
+            break;
+        }
+        case Tree::Kind::recurse:
+        case Tree::Kind::alternatives:
+            // Bodies calling themselves aren't copied, and conditions read
+            // their alternatives directly.
+            break;
+        }
+    }
+    return copied[function.root];
+}
+
+template <typename Value>
+void Compiler<Value>::finish_definition()
+{
+    // Copying the body out of the line's memory lets the function outlive
+    // the line.
+    auto function = std::make_shared<BasicFunction<Value>>();
+    function->name = defining.value();
+    function->body = BasicProgram<Value>(program);
+    function->source = std::string(source);
+    if (!recursive && tree.size() <= inline_limit)
+    {
+        function->tree = tree;
+        function->root = root;
+        function->strict = strict_parameters();
+    }
+
+    program.code.clear();
+    program.symbols.clear();
+    program.constants.clear();
+    program.functions.clear();
+    program.reductions.clear();
+    program.max_stack = 0;
+    program.temporaries = 0;
+    program.definition = std::move(function);
+}
+
+template <typename Value>
+std::vector<bool> Compiler<Value>::strict_parameters() const
+{
+    // The parameters read on every path from each node: those of all its
+    // operands, except that a condition only reads those both its
+    // alternatives read.
+    std::size_t arity = program.symbols.size();
+    std::vector<std::vector<bool>> reads(root + 1, std::vector<bool>(arity, false));
+    for (node_id id = 0; id <= root; id++)
+    {
+        typename Tree::Node const& node = tree[id];
+        auto merge = [&](node_id operand) {
+            for (std::size_t i = 0; operand != Tree::none && i < arity; i++)
+            {
+                reads[id][i] = reads[id][i] || reads[operand][i];
+            }
+        };
+        switch (node.kind)
+        {
+        case Tree::Kind::literal:
+        case Tree::Kind::constant:
+        case Tree::Kind::index:
+            break;
+        case Tree::Kind::symbol:
+            reads[id][node.slot] = true;
+            break;
+        case Tree::Kind::reduce:
+            // The body may run for no index at all.
+            merge(node.rhs);
+            break;
+        case Tree::Kind::unary:
+        case Tree::Kind::call:
+        case Tree::Kind::recurse:
+            merge(node.lhs);
+            break;
+        case Tree::Kind::binary:
+        case Tree::Kind::argument:
+            merge(node.lhs);
+            merge(node.rhs);
+            break;
+        case Tree::Kind::alternatives:
+            for (std::size_t i = 0; i < arity; i++)
+            {
+                reads[id][i] = reads[node.lhs][i] && reads[node.rhs][i];
+            }
+            break;
+        case Tree::Kind::condition:
+            merge(node.lhs);
+            merge(node.rhs);
+            break;
+        }
+    }
+    return reads[root];
+}
+
+template <typename Value>
+bool Compiler<Value>::at_assignment() const
+{
+    return it != end && it->infix != Operators::none &&
+        Operators::table[it->infix].assignment != Operators::Assignment::none;
+}
+
+template <typename Value>
+typename Compiler<Value>::node_id Compiler<Value>::fail(Diagnostic::Code code, std::string message, token_iterator at)
+{
+    if (!error.has_value())
+    {
+        // Past the last token, the error is where the line ends.
+        std::size_t offset = at != end ? std::size_t(at->text.data() - source.data())
+            : std::size_t(std::prev(at)->text.data() + std::prev(at)->text.size() - source.data());
+        error = Diagnostic{code, std::move(message), offset};
+    }
+    return 0;
+}
+
+template <typename Value>
+void Compiler<Value>::generate()
+{
+    target = &program;
+    generate_code(root, defining.has_value());
+    target = nullptr;
+}
+
+template <typename Value>
+void Compiler<Value>::generate_code(node_id top, bool tail)
+{
+    // A node reached through more than one edge is computed once and kept in
+    // a temporary. Leaves are as cheap to reload as a temporary. Operands are
+    // always created before the node using them, so walking ids downwards
+    // from the root sees every user of a node before the node itself.
+    uses.assign(top + 1, 0);
+    temps.assign(top + 1, none);
+    uses[top] = 1;
+    std::size_t reachable = 0;
+    for (node_id id = top + 1; id-- > 0;)
+    {
+        typename Tree::Node const& node = tree[id];
+        if (uses[id] != 0)
+        {
+            reachable++;
+        }
+        if (uses[id] == 0 || node.kind == Tree::Kind::literal || node.kind == Tree::Kind::constant ||
+            node.kind == Tree::Kind::symbol || node.kind == Tree::Kind::index)
+        {
+            continue;
+        }
+        // Calls without arguments have no operands, and the body of a
+        // reduction is a program of its own.
+        if (node.lhs != Tree::none && node.kind != Tree::Kind::reduce)
+        {
+            uses[node.lhs]++;
+        }
+        if ((node.kind == Tree::Kind::binary || node.kind == Tree::Kind::argument ||
+             node.kind == Tree::Kind::condition || node.kind == Tree::Kind::alternatives ||
+             node.kind == Tree::Kind::reduce) &&
+            node.rhs != Tree::none)
+        {
+            uses[node.rhs]++;
+        }
+    }
+
+    // Shared nodes add a save and loads, so this is only a first guess.
+    target->code.reserve(reachable);
+    target->constants.assign(tree.constants().begin(), tree.constants().end());
+    saved.clear();
+    generate(top, tail);
+}
+
+template <typename Value>
+void Compiler<Value>::generate(node_id id, bool tail)
+{
+    if (temps[id] != none)
+    {
+        emit(Program::Opcode::load_temp, temps[id]);
+        return;
+    }
+
+    typename Tree::Node const& node = tree[id];
+    switch (node.kind)
+    {
+    case Tree::Kind::literal:
+        emit(Program::Opcode::push_literal, 0, node.value);
+        return;
+    case Tree::Kind::constant:
+        emit(Program::Opcode::push_constant, node.slot);
+        return;
+    case Tree::Kind::symbol:
+        emit(Program::Opcode::load_symbol, node.slot);
+        return;
+    case Tree::Kind::index:
+        // Indexes follow the symbols in the frame of a reduction's body.
+        emit(Program::Opcode::load_symbol, Program::slot_type(program.symbols.size() + node.slot));
+        return;
+    case Tree::Kind::unary:
+        generate(node.lhs, false);
+        emit(node.op);
+        break;
+    case Tree::Kind::binary:
+        generate(node.lhs, false);
+        generate(node.rhs, false);
+        emit(node.op);
+        break;
+    case Tree::Kind::call:
+    case Tree::Kind::recurse:
+    {
+        Program::value_type arity = 0;
+        for (node_id argument = node.lhs; argument != Tree::none; argument = tree[argument].rhs)
+        {
+            generate(tree[argument].lhs, false);
+            arity++;
+        }
+        if (node.kind == Tree::Kind::call)
+        {
+            emit(Program::Opcode::call, slot_in(target->functions, program.functions[node.slot]), arity);
+        }
+        else
+        {
+            emit(tail ? Program::Opcode::tail_recurse : Program::Opcode::recurse, 0, arity);
+        }
+        break;
+    }
+    case Tree::Kind::condition:
+    {
+        // The jumps are patched once their targets are known.
+        typename Tree::Node const& choices = tree[node.rhs];
+        generate(node.lhs, false);
+        std::size_t skip = target->code.size();
+        emit(Program::Opcode::jump_if_zero);
+        generate_branch(choices.lhs, tail);
+        std::size_t done = target->code.size();
+        emit(Program::Opcode::jump);
+        // Only one of the branches leaves its value on the stack.
+        stack_size--;
+        target->code[skip].immediate = Program::value_type(target->code.size());
+        generate_branch(choices.rhs, tail);
+        target->code[done].immediate = Program::value_type(target->code.size());
+        break;
+    }
+    case Tree::Kind::reduce:
+    {
+        typename Tree::Node const& bounds = tree[node.rhs];
+        generate(bounds.lhs, false);
+        generate(tree[bounds.rhs].lhs, false);
+        emit(Program::Opcode::reduce, generate_reduction(id));
+        break;
+    }
+    case Tree::Kind::argument:
+    case Tree::Kind::alternatives:
+        // Read by their users, never generated on their own.
+        return;
+    }
+
+    if (uses[id] > 1)
+    {
+        temps[id] = Program::slot_type(target->temporaries++);
+        saved.push_back(id);
+        emit(Program::Opcode::save_temp, temps[id]);
+    }
+}
+
+template <typename Value>
+void Compiler<Value>::generate_branch(node_id id, bool tail)
+{
+    std::size_t mark = saved.size();
+    generate(id, tail);
+    for (std::size_t i = mark; i < saved.size(); i++)
+    {
+        temps[saved[i]] = none;
+    }
+    saved.resize(mark);
+}
+
+template <typename Value>
+void Compiler<Value>::emit(Program::Opcode op, Program::slot_type slot, Program::value_type immediate)
+{
+    target->code.push_back({op, slot, immediate});
+
+    switch (op)
+    {
+    case Program::Opcode::push_literal:
+    case Program::Opcode::push_constant:
+    case Program::Opcode::load_symbol:
+    case Program::Opcode::load_temp:
+        stack_size++;
+        break;
+    case Program::Opcode::negate:
+    case Program::Opcode::bit_not:
+    case Program::Opcode::identity:
+    case Program::Opcode::save_temp:
+        break;
+    case Program::Opcode::power:
+    case Program::Opcode::multiply:
+    case Program::Opcode::divide:
+    case Program::Opcode::modulo:
+    case Program::Opcode::add:
+    case Program::Opcode::subtract:
+    case Program::Opcode::jump_if_zero:
+    case Program::Opcode::reduce:
+        stack_size--;
+        break;
+    case Program::Opcode::jump:
+        break;
+    case Program::Opcode::call:
+    case Program::Opcode::recurse:
+    case Program::Opcode::tail_recurse:
+        stack_size = stack_size - std::size_t(immediate) + 1;
+        break;
+    }
+    target->max_stack = std::max(target->max_stack, stack_size);
+}
+
+template <typename Value>
+Program::slot_type Compiler<Value>::generate_reduction(node_id id)
+{
+    typename Tree::Node const& node = tree[id];
+    std::size_t depth = indices.size();
+    auto reduction = std::make_shared<BasicReduction<Value>>();
+    reduction->kind = Program::Reduction(node.slot);
+
+    // The body reads the frame of the program running it, followed by the
+    // index.
+    indices.push_back(Program::atom(node.value));
+    auto& body = reduction->body;
+    body.symbols.assign(program.symbols.begin(), program.symbols.end());
+    body.symbols.insert(body.symbols.end(), indices.begin(), indices.end());
+
+    // The body is generated like a line of its own, from its own counts of
+    // uses.
+    BasicProgram<Value>* outer = target;
+    std::size_t outer_stack = stack_size;
+    std::vector<std::size_t> outer_uses;
+    std::vector<Program::slot_type> outer_temps;
+    std::vector<node_id> outer_saved;
+    outer_uses.swap(uses);
+    outer_temps.swap(temps);
+    outer_saved.swap(saved);
+    target = &body;
+    stack_size = 0;
+    generate_code(node.lhs, false);
+    target = outer;
+    stack_size = outer_stack;
+    outer_uses.swap(uses);
+    outer_temps.swap(temps);
+    outer_saved.swap(saved);
+    indices.pop_back();
+
+    // The closed forms need the exact arithmetic of integers. Sums and
+    // products wrap around the same way as the loop, but a line that wraps
+    // isn't monotonic, so the ends of one only bound it without wrapping.
+    if (Numeric<Value>::integral)
+    {
+        auto degree = polynomial_degree(node.lhs, depth);
+        bool closed = degree.has_value() &&
+            (reduction->kind == Program::Reduction::sum ||
+             (reduction->kind == Program::Reduction::product && degree.value() == 0) ||
+             ((reduction->kind == Program::Reduction::minimum || reduction->kind == Program::Reduction::maximum) &&
+              degree.value() <= (Numeric<Value>::wraps ? 0 : 1)));
+        if (closed)
+        {
+            reduction->degree = degree;
+        }
+    }
+    return slot_in(target->reductions, typename BasicProgram<Value>::reduction_pointer(std::move(reduction)));
+}
+
+template <typename Value>
+std::optional<std::size_t> Compiler<Value>::polynomial_degree(node_id body, std::size_t depth) const
+{
+    constexpr std::size_t not_polynomial = std::size_t(-1);
+    constexpr std::size_t max_degree = BasicReduction<Value>::max_degree;
+
+    // Bottom up, as operands come before their users. What isn't a sum or
+    // product of polynomials must at least not depend on the index.
+    std::vector<std::size_t> degrees(body + 1, 0);
+    for (node_id id = 0; id <= body; id++)
+    {
+        typename Tree::Node const& node = tree[id];
+        std::size_t lhs = node.lhs != Tree::none && node.lhs < id ? degrees[node.lhs] : 0;
+        std::size_t rhs = node.rhs != Tree::none && node.rhs < id ? degrees[node.rhs] : 0;
+        std::size_t degree = not_polynomial;
+        switch (node.kind)
+        {
+        case Tree::Kind::literal:
+        case Tree::Kind::constant:
+        case Tree::Kind::symbol:
+            degree = 0;
+            break;
+        case Tree::Kind::index:
+            degree = node.slot == depth ? 1 : 0;
+            break;
+        case Tree::Kind::unary:
+            if (node.op != Program::Opcode::bit_not || lhs == 0)
+            {
+                degree = lhs;
+            }
+            break;
+        case Tree::Kind::binary:
+            if (lhs == not_polynomial || rhs == not_polynomial)
+            {
+                break;
+            }
+            switch (node.op)
+            {
+            case Program::Opcode::add:
+            case Program::Opcode::subtract:
+                degree = std::max(lhs, rhs);
+                break;
+            case Program::Opcode::multiply:
+                degree = lhs + rhs;
+                break;
+            case Program::Opcode::power:
+                if (rhs == 0 && lhs == 0)
+                {
+                    degree = 0;
+                }
+                else if (rhs == 0 && tree.is_number(node.rhs))
+                {
+                    auto exponent = Numeric<Value>::to_word(tree.number_at(node.rhs));
+                    if (exponent.has_value() && exponent.value() >= 0 &&
+                        std::size_t(exponent.value()) <= max_degree)
+                    {
+                        degree = lhs * std::size_t(exponent.value());
+                    }
+                }
+                break;
+            default:
+                if (lhs == 0 && rhs == 0)
+                {
+                    degree = 0;
+                }
+                break;
+            }
+            break;
+        case Tree::Kind::call:
+        case Tree::Kind::recurse:
+        case Tree::Kind::argument:
+        case Tree::Kind::condition:
+        case Tree::Kind::alternatives:
+        case Tree::Kind::reduce:
+            if (lhs == 0 && rhs == 0)
+            {
+                degree = 0;
+            }
+            break;
+        }
+        degrees[id] = degree <= max_degree ? degree : not_polynomial;
+    }
+    if (degrees[body] == not_polynomial)
+    {
+        return std::nullopt;
+    }
+    return degrees[body];
+}
+
+template <typename Value>
+Program::slot_type Compiler<Value>::slot_for(Program::atom symbol)
+{
+    return slot_in(program.symbols, symbol);
+}
+
+template <typename Value>
+Program::slot_type Compiler<Value>::function_slot(typename BasicProgram<Value>::function_pointer const& function)
+{
+    return slot_in(program.functions, function);
+}
+
+template <typename Value>
+template <typename Item>
+Program::slot_type Compiler<Value>::slot_in(std::pmr::vector<Item>& items, Item const& item)
+{
+    auto found = std::find(items.begin(), items.end(), item);
+    if (found != items.end())
+    {
+        return Program::slot_type(std::distance(items.begin(), found));
+    }
+    items.push_back(item);
+    return Program::slot_type(items.size() - 1);
+}
+
+template <typename Value>
+bool Compiler<Value>::is_symbol(std::string_view s)
+{
+    return !s.empty() && std::isalpha(static_cast<unsigned char>(s.front())) &&
+        std::all_of(s.begin(), s.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        });
+}
+
+#define INSTANTIATE(Value) template class Compiler<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
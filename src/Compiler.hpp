@@ -0,0 +1,166 @@
+#ifndef GUARD_COMPILER_HPP
+#define GUARD_COMPILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Ast.hpp"
+#include "Bytecode.hpp"
+#include "Diagnostic.hpp"
+#include "Function.hpp"
+#include "Lexer.hpp"
+#include "Operators.hpp"
+
+// Turns a tokenized line into a Program with a single left to right
+// precedence climbing (Pratt) pass over the tokens, driven by
+// Operators::table. The pass builds an Ast through the Optimizer's
+// constructors, and code is generated from the optimized tree. Evaluation
+// never sees the tokens again.
+//
+// Literals are read, and folded, as `Value`s.
+//
+// A line "def f(x, y) = ..." compiles to a BasicFunction, and calls of it
+// are resolved in the table of functions given, when the line is compiled:
+// small functions are copied into the caller's tree and the rest called.
+// if(test, a, b) is built in, and only evaluates the value it takes. So
+// are the reductions sum, prod, min and max, "sum(i, 1, n, i * i)", whose
+// body is compiled to a program of its own (see Reduction.hpp).
+//
+// A malformed line is reported as a Diagnostic: the parser records the
+// first error, and every step returns as soon as there is one, so nothing
+// is thrown.
+template <typename Value>
+class Compiler
+{
+public:
+    // Lexes into a token buffer kept per thread, so repeated calls don't
+    // allocate for tokens. The program is allocated from `memory`. Errors
+    // are thrown as calculator_error.
+    static BasicProgram<Value> compile(std::string_view line,
+                                       std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+    // Compiles `tokens`, the tokens of `line`, without throwing.
+    static Expected<BasicProgram<Value>> try_compile(
+        std::string_view line, std::vector<Lexer::Token> const& tokens,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource(),
+        FunctionTable<Value> const* functions = nullptr);
+
+    // The optimized form of `line` followed by its code, one instruction
+    // per line.
+    static std::string explain(std::string_view line, FunctionTable<Value> const* functions = nullptr);
+
+    static bool is_symbol(std::string_view s);
+
+private:
+    using token_iterator = Lexer::Token const*;
+    using Tree = Ast<Value>;
+    using node_id = typename Tree::node_id;
+
+    static constexpr Program::slot_type none = ~Program::slot_type(0);
+
+    // Nodes of the largest body copied into callers.
+    static constexpr std::size_t inline_limit = 32;
+
+    // Storage that only lives while a line is compiled, kept between lines
+    // so compiling doesn't allocate once it has grown.
+    struct Workspace
+    {
+        Tree tree;
+        std::vector<std::size_t> uses;
+        std::vector<Program::slot_type> temps;
+        // Nodes given a temporary, in order, so those of a branch are
+        // forgotten after it.
+        std::vector<node_id> saved;
+    };
+
+private:
+    std::string_view source;
+    token_iterator it;
+    token_iterator end;
+    std::optional<Diagnostic> error;
+    Tree& tree;
+    node_id root = 0;
+    BasicProgram<Value> program;
+    std::size_t stack_size = 0;
+
+    FunctionTable<Value> const* functions;
+    // The indexes of the reductions whose body is being parsed or
+    // generated, outermost first.
+    std::vector<Program::atom> indices;
+    // The program code is generated into: the line's, or the body of a
+    // reduction. Only set while generating.
+    BasicProgram<Value>* target = nullptr;
+    // The function a "def" line defines, whose body only reads its
+    // parameters, and whether the body calls itself.
+    std::optional<Program::atom> defining;
+    bool recursive = false;
+
+    // Indexed by node of `tree`: how many operations read it, and the
+    // temporary holding its value once computed.
+    std::vector<std::size_t>& uses;
+    std::vector<Program::slot_type>& temps;
+    std::vector<node_id>& saved;
+
+private:
+    Compiler(std::string_view source, token_iterator begin, token_iterator end, Workspace& work,
+             std::pmr::memory_resource* memory, FunctionTable<Value> const* functions);
+
+    // Leaves `error` set if `tokens` don't make a statement.
+    static Compiler parse(std::string_view line, std::vector<Lexer::Token> const& tokens, Workspace& work,
+                          std::pmr::memory_resource* memory, FunctionTable<Value> const* functions);
+
+    node_id parse_statement();
+    // "def f(x, y) = ...", from after "def".
+    node_id parse_definition();
+    node_id parse_expression(std::uint8_t min_precedence);
+    node_id parse_operand();
+    // A call, or if(), from its name.
+    node_id parse_call();
+    // sum(), prod(), min() or max(), from its name.
+    node_id parse_reduction(Program::Reduction reduction);
+    // The reduction `name` calls, if it is one.
+    static std::optional<Program::Reduction> reduction(std::string_view name);
+
+    // The body of `function` with `arguments` for its parameters, copied
+    // into this line's tree.
+    node_id inline_body(BasicFunction<Value> const& function, std::vector<node_id> const& arguments);
+    // Turns the compiled body into the BasicFunction the line defines.
+    void finish_definition();
+    // BasicFunction::strict for the body.
+    std::vector<bool> strict_parameters() const;
+
+    bool at_assignment() const;
+
+    // Records an error at `at`, unless there is one already, and returns
+    // a node to go on with: callers return as soon as `error` is set.
+    node_id fail(Diagnostic::Code code, std::string message, token_iterator at);
+
+    void generate();
+    // Generates the value of `top` into `target`.
+    void generate_code(node_id top, bool tail);
+    // `tail` tells whether the value of `id` is the value of the function
+    // being defined, so a call of it can be a tail call.
+    void generate(node_id id, bool tail);
+    // Generates one of the values a condition chooses from, forgetting the
+    // temporaries it computes: the other branch doesn't have them.
+    void generate_branch(node_id id, bool tail);
+    // Compiles the body of the reduction `id` and returns its slot in
+    // `target`.
+    Program::slot_type generate_reduction(node_id id);
+    // The degree of `body` as a polynomial in the index of the reduction
+    // `depth` levels in, if it is one of at most BasicReduction::max_degree.
+    std::optional<std::size_t> polynomial_degree(node_id body, std::size_t depth) const;
+
+    void emit(Program::Opcode op, Program::slot_type slot = 0, Program::value_type immediate = 0);
+    Program::slot_type slot_for(Program::atom symbol);
+    Program::slot_type function_slot(typename BasicProgram<Value>::function_pointer const& function);
+    // The slot of `item` in `items`, added if it isn't there.
+    template <typename Item>
+    static Program::slot_type slot_in(std::pmr::vector<Item>& items, Item const& item);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "Calculator.hpp"
+#include "Decimal.hpp"
+
+std::optional<Decimal> Decimal::parse(std::string_view text)
+{
+    std::size_t point = text.find('.');
+    std::string_view integer = text.substr(0, point);
+    std::string_view fraction = point == std::string_view::npos ? std::string_view() : text.substr(point + 1);
+
+    units_type units = 0;
+    for (char c : integer)
+    {
+        if (__builtin_mul_overflow(units, 10, &units) || __builtin_add_overflow(units, c - '0', &units))
+        {
+            return std::nullopt;
+        }
+    }
+    for (int i = 0; i < places; i++)
+    {
+        int digit = std::size_t(i) < fraction.size() ? fraction[std::size_t(i)] - '0' : 0;
+        if (__builtin_mul_overflow(units, 10, &units) || __builtin_add_overflow(units, digit, &units))
+        {
+            return std::nullopt;
+        }
+    }
+
+    // Round half to even on the digits that don't fit.
+    if (fraction.size() > std::size_t(places))
+    {
+        int first = fraction[places] - '0';
+        bool rest = fraction.find_first_not_of('0', std::size_t(places) + 1) != std::string_view::npos;
+        if (first > 5 || (first == 5 && (rest || units % 2 != 0)))
+        {
+            if (__builtin_add_overflow(units, 1, &units))
+            {
+                return std::nullopt;
+            }
+        }
+    }
+    return from_units(units);
+}
+
+std::string Decimal::to_string() const
+{
+    // Digits of the absolute value, least significant first. Negating
+    // could overflow, so each digit is taken from the signed remainder.
+    std::string digits;
+    units_type rest = units;
+    do
+    {
+        int digit = int(rest % 10);
+        digits.push_back(char('0' + (digit < 0 ? -digit : digit)));
+        rest /= 10;
+    } while (rest != 0);
+    digits.resize(std::max<std::size_t>(digits.size(), places + 1), '0');
+
+    // Trailing zeros of the fraction are dropped, and the point with them.
+    std::size_t zeros = digits.find_first_not_of('0');
+    std::size_t drop = std::min<std::size_t>(zeros == std::string::npos ? places : zeros, places);
+
+    std::string text = units < 0 ? "-" : "";
+    for (std::size_t i = digits.size(); i-- > std::size_t(places);)
+    {
+        text += digits[i];
+    }
+    if (drop < std::size_t(places))
+    {
+        text += '.';
+        for (std::size_t i = places; i-- > drop;)
+        {
+            text += digits[i];
+        }
+    }
+    return text;
+}
+
+Decimal Decimal::pow(Decimal base, units_type exponent)
+{
+    if (exponent < 0)
+    {
+        return from_integer(1) / pow(base, -exponent);
+    }
+
+    Decimal result = from_integer(1);
+    while (exponent != 0)
+    {
+        if (exponent & 1)
+        {
+            result = result * base;
+        }
+        exponent >>= 1;
+        if (exponent != 0)
+        {
+            base = base * base;
+        }
+    }
+    return result;
+}
+
+void Decimal::too_large()
+{
+    throw Calculator::calculator_error(Diagnostic::Code::too_large, "Result too large.");
+}
@@ -0,0 +1,157 @@
+#ifndef GUARD_DECIMAL_HPP
+#define GUARD_DECIMAL_HPP
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Fixed point number with `places` decimal digits after the point, stored
+// as a count of units of 10^-places in a 128 bit integer. Addition and
+// subtraction are exact; multiplication and division round the last place
+// half to even, as is usual for money.
+//
+// Overflowing operations throw; dividing by zero is left to the caller to
+// rule out, as with the built-in integers.
+class Decimal
+{
+public:
+    __extension__ typedef __int128 units_type;
+
+    static constexpr int places = 6;
+    static constexpr units_type scale = 1000000;
+
+private:
+    units_type units = 0;
+
+public:
+    Decimal() = default;
+
+    static Decimal from_units(units_type units)
+    {
+        Decimal result;
+        result.units = units;
+        return result;
+    }
+
+    static Decimal from_integer(long value)
+    {
+        return from_units(units_type(value) * scale);
+    }
+
+    // Digits with an optional fraction, such as "12.5". Digits past `places`
+    // are rounded. Returns nothing when the value is too large.
+    static std::optional<Decimal> parse(std::string_view text);
+
+    units_type raw() const
+    {
+        return units;
+    }
+
+    bool is_integer() const
+    {
+        return units % scale == 0;
+    }
+
+    bool is_zero() const
+    {
+        return units == 0;
+    }
+
+    bool is_negative() const
+    {
+        return units < 0;
+    }
+
+    std::string to_string() const;
+
+    friend Decimal operator+(Decimal a, Decimal b)
+    {
+        units_type result;
+        if (__builtin_add_overflow(a.units, b.units, &result))
+        {
+            too_large();
+        }
+        return from_units(result);
+    }
+
+    friend Decimal operator-(Decimal a, Decimal b)
+    {
+        units_type result;
+        if (__builtin_sub_overflow(a.units, b.units, &result))
+        {
+            too_large();
+        }
+        return from_units(result);
+    }
+
+    friend Decimal operator*(Decimal a, Decimal b)
+    {
+        units_type product;
+        if (__builtin_mul_overflow(a.units, b.units, &product))
+        {
+            too_large();
+        }
+        return from_units(round(product, scale));
+    }
+
+    // The divisor must not be zero.
+    friend Decimal operator/(Decimal a, Decimal b)
+    {
+        units_type scaled;
+        if (__builtin_mul_overflow(a.units, scale, &scaled))
+        {
+            too_large();
+        }
+        return from_units(round(scaled, b.units));
+    }
+
+    // a - b * trunc(a / b), which is exact. The divisor must not be zero.
+    friend Decimal operator%(Decimal a, Decimal b)
+    {
+        return from_units(a.units % b.units);
+    }
+
+    Decimal operator-() const
+    {
+        return Decimal() - *this;
+    }
+
+    // Exponentiation by squaring, rounding after every multiplication. A
+    // negative exponent divides 1 by the power, so `base` must not be zero
+    // then.
+    static Decimal pow(Decimal base, units_type exponent);
+
+    friend bool operator==(Decimal a, Decimal b)
+    {
+        return a.units == b.units;
+    }
+
+    friend bool operator!=(Decimal a, Decimal b)
+    {
+        return a.units != b.units;
+    }
+
+    friend bool operator<(Decimal a, Decimal b)
+    {
+        return a.units < b.units;
+    }
+
+private:
+    // n / d rounded half to even.
+    static units_type round(units_type n, units_type d)
+    {
+        units_type quotient = n / d;
+        units_type remainder = n % d;
+        units_type left = remainder < 0 ? -remainder : remainder;
+        units_type right = (d < 0 ? -d : d) - left;
+        if (left > right || (left == right && quotient % 2 != 0))
+        {
+            quotient += (n < 0) == (d < 0) ? 1 : -1;
+        }
+        return quotient;
+    }
+
+    [[noreturn]] static void too_large();
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef GUARD_DIAGNOSTIC_HPP
+#define GUARD_DIAGNOSTIC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <variant>
+
+// Why a line failed, and where. The stages that reject malformed lines,
+// the Lexer and the Compiler, return these instead of throwing, so bad
+// input costs no more than good input; calculator_error carries one too.
+struct Diagnostic
+{
+    enum class Code : std::uint8_t
+    {
+        // Reading the line.
+        empty_line,
+        invalid_character,
+        invalid_operator,
+        syntax,
+        unbalanced_parenthesis,
+        invalid_symbol,
+
+        // Evaluating it.
+        undefined,
+        formula_failed,
+        circular_formula,
+        division_by_zero,
+        invalid_operation,
+        out_of_range,
+        not_integer,
+        too_large,
+        // Calls nested deeper than VirtualMachine::max_depth.
+        too_deep,
+
+        // Commands, and calls the API doesn't allow.
+        command,
+        invalid_argument,
+        // Reading or writing a file, such as a snapshot.
+        file
+    };
+
+    // Offset of errors that aren't about one place in the line.
+    static constexpr std::size_t no_offset = std::size_t(-1);
+
+    Code code;
+    std::string message;
+    // Offset in the line of the token at fault, or of its end when the line
+    // ended too early.
+    std::size_t offset = no_offset;
+};
+
+// Either a value or the Diagnostic of why there is none, like C++23's
+// std::expected.
+template <typename T>
+class Expected
+{
+private:
+    std::variant<T, Diagnostic> content;
+
+public:
+    Expected(T value)
+        : content(std::in_place_index<0>, std::move(value))
+    {
+    }
+
+    Expected(Diagnostic error)
+        : content(std::in_place_index<1>, std::move(error))
+    {
+    }
+
+    bool has_value() const
+    {
+        return content.index() == 0;
+    }
+
+    explicit operator bool() const
+    {
+        return has_value();
+    }
+
+    // Only for an Expected holding a value, or an error, respectively.
+    T& value()
+    {
+        return *std::get_if<0>(&content);
+    }
+
+    T const& value() const
+    {
+        return *std::get_if<0>(&content);
+    }
+
+    Diagnostic const& error() const
+    {
+        return *std::get_if<1>(&content);
+    }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include <cerrno>
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Files.hpp"
+
+namespace files
+{
+
+int sync_directory(std::string const& path)
+{
+    std::size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno;
+    }
+    int error = ::fsync(fd) < 0 ? errno : 0;
+    ::close(fd);
+    return error;
+}
+
+}
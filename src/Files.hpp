@@ -0,0 +1,17 @@
+#ifndef GUARD_FILES_HPP
+#define GUARD_FILES_HPP
+
+#include <string>
+
+namespace files
+{
+
+// Syncs the directory holding `path`. Syncing a file only makes its
+// contents durable: its entry in the directory, made by creating it or by
+// renaming it into place, is lost in a crash until the directory is synced
+// too. Returns 0, or the errno of the failure.
+int sync_directory(std::string const& path);
+
+}
+
+#endif
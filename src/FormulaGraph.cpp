@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "FormulaGraph.hpp"
+#include "Numeric.hpp"
+
+template <typename Value>
+void FormulaGraph<Value>::define(atom target, BasicProgram<Value> program)
+{
+    if (reaches(program.symbols, target))
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::circular_formula,
+                                           AtomTable::name(target) + " can't depend on its own value.");
+    }
+
+    remove(target);
+    for (atom symbol : program.symbols)
+    {
+        readers[symbol].push_back(target);
+    }
+    formulas[target].program = std::move(program);
+}
+
+template <typename Value>
+bool FormulaGraph<Value>::remove(atom target)
+{
+    auto found = formulas.find(target);
+    if (found == formulas.end())
+    {
+        return false;
+    }
+    unlink(target, found->second.program.symbols);
+    formulas.erase(found);
+    return true;
+}
+
+template <typename Value>
+BasicProgram<Value> const* FormulaGraph<Value>::find(atom target) const
+{
+    auto found = formulas.find(target);
+    return found != formulas.end() ? &found->second.program : nullptr;
+}
+
+template <typename Value>
+bool FormulaGraph<Value>::empty() const
+{
+    return formulas.empty();
+}
+
+template <typename Value>
+bool FormulaGraph<Value>::involves(atom symbol) const
+{
+    return formulas.count(symbol) != 0 || readers.count(symbol) != 0;
+}
+
+template <typename Value>
+std::vector<typename FormulaGraph<Value>::atom> const& FormulaGraph<Value>::affected(std::vector<atom> const& changed)
+{
+    // Depth first search along readers. A formula is finished after every
+    // formula reading it, so the reversed finishing order is topological.
+    search++;
+    order.clear();
+    for (atom start : changed)
+    {
+        auto formula = formulas.find(start);
+        if (formula != formulas.end())
+        {
+            if (formula->second.visited == search)
+            {
+                continue;
+            }
+            formula->second.visited = search;
+        }
+
+        pending.push_back({start, 0});
+        while (!pending.empty())
+        {
+            atom symbol = pending.back().first;
+            std::size_t next = pending.back().second;
+
+            auto found = readers.find(symbol);
+            if (found != readers.end() && next < found->second.size())
+            {
+                pending.back().second++;
+                Formula& reader = formulas.at(found->second[next]);
+                if (reader.visited != search)
+                {
+                    reader.visited = search;
+                    pending.push_back({found->second[next], 0});
+                }
+                continue;
+            }
+
+            if (formulas.count(symbol) != 0)
+            {
+                order.push_back(symbol);
+            }
+            pending.pop_back();
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+template <typename Value>
+std::vector<typename FormulaGraph<Value>::atom> const& FormulaGraph<Value>::all()
+{
+    std::vector<atom> targets;
+    targets.reserve(formulas.size());
+    for (auto const& formula : formulas)
+    {
+        targets.push_back(formula.first);
+    }
+    return affected(targets);
+}
+
+template <typename Value>
+void FormulaGraph<Value>::set_error(atom target, std::string error)
+{
+    auto found = formulas.find(target);
+    if (found != formulas.end())
+    {
+        found->second.error = std::move(error);
+    }
+}
+
+template <typename Value>
+std::string const* FormulaGraph<Value>::error(atom target) const
+{
+    auto found = formulas.find(target);
+    if (found == formulas.end() || found->second.error.empty())
+    {
+        return nullptr;
+    }
+    return &found->second.error;
+}
+
+template <typename Value>
+bool FormulaGraph<Value>::reaches(std::pmr::vector<atom> const& symbols, atom target)
+{
+    // Marks the formulas reading `target`, directly or not. Searching
+    // downstream is cheap when defining new formulas, which nothing reads
+    // yet.
+    search++;
+    pending.push_back({target, 0});
+    while (!pending.empty())
+    {
+        atom symbol = pending.back().first;
+        pending.pop_back();
+
+        auto found = readers.find(symbol);
+        if (found == readers.end())
+        {
+            continue;
+        }
+        for (atom reader : found->second)
+        {
+            Formula& formula = formulas.at(reader);
+            if (formula.visited != search)
+            {
+                formula.visited = search;
+                pending.push_back({reader, 0});
+            }
+        }
+    }
+
+    return std::any_of(symbols.begin(), symbols.end(), [this, target](atom symbol) {
+        auto found = formulas.find(symbol);
+        return symbol == target || (found != formulas.end() && found->second.visited == search);
+    });
+}
+
+template <typename Value>
+void FormulaGraph<Value>::unlink(atom target, std::pmr::vector<atom> const& symbols)
+{
+    for (atom symbol : symbols)
+    {
+        auto found = readers.find(symbol);
+        auto& list = found->second;
+        list.erase(std::find(list.begin(), list.end(), target));
+        if (list.empty())
+        {
+            readers.erase(found);
+        }
+    }
+}
+
+#define INSTANTIATE(Value) template class FormulaGraph<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,77 @@
+#ifndef GUARD_FORMULA_GRAPH_HPP
+#define GUARD_FORMULA_GRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+
+// Symbols bound with ":=" and the programs computing them, plus for every
+// symbol the formulas reading it. When symbols change, affected() gives the
+// formulas to evaluate again, each once and after every formula it reads,
+// like a spreadsheet. Evaluating them is left to the Calculator, which owns
+// the values.
+template <typename Value>
+class FormulaGraph
+{
+public:
+    using atom = AtomTable::atom;
+
+private:
+    struct Formula
+    {
+        BasicProgram<Value> program;
+        // Why the last evaluation failed, empty if it didn't.
+        std::string error;
+        // Last search (see `search`) that visited the formula.
+        std::uint32_t visited = 0;
+    };
+
+private:
+    std::unordered_map<atom, Formula> formulas;
+    std::unordered_map<atom, std::vector<atom>> readers;
+
+    // Scratch space of the searches, kept between them.
+    std::uint32_t search = 0;
+    std::vector<atom> order;
+    std::vector<std::pair<atom, std::size_t>> pending;
+
+public:
+    // Binds `target` to `program`, replacing its previous formula. Throws if
+    // the formula would end up reading its own value.
+    void define(atom target, BasicProgram<Value> program);
+    // Returns whether `target` was a formula.
+    bool remove(atom target);
+
+    BasicProgram<Value> const* find(atom target) const;
+    bool empty() const;
+
+    // Whether assigning `symbol` must go through the graph: it is a formula,
+    // or a formula reads it.
+    bool involves(atom symbol) const;
+
+    // The formulas depending on any of `changed`, in an order where each
+    // comes after every formula it reads. Formulas in `changed` are part of
+    // the result. The returned vector is reused by the next call.
+    std::vector<atom> const& affected(std::vector<atom> const& changed);
+
+    // Every formula, in the same order as affected().
+    std::vector<atom> const& all();
+
+    void set_error(atom target, std::string error);
+    std::string const* error(atom target) const;
+
+private:
+    // Whether any of `symbols` is `target` or a formula reading it,
+    // directly or not.
+    bool reaches(std::pmr::vector<atom> const& symbols, atom target);
+    void unlink(atom target, std::pmr::vector<atom> const& symbols);
+};
+
+#endif
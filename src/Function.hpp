@@ -0,0 +1,57 @@
+#ifndef GUARD_FUNCTION_HPP
+#define GUARD_FUNCTION_HPP
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Ast.hpp"
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+
+// A function defined by a line such as "def f(x, y) = x * y + 1", compiled
+// once. Its body is a program whose symbols are the parameters, so a call
+// hands its arguments over as the frame (see VirtualMachine). The body
+// only reads its parameters, and may call itself and the functions
+// defined before it.
+//
+// Functions are bound when a line is compiled: redefining one changes the
+// lines compiled afterwards, not the functions and formulas already
+// calling it.
+//
+// A small body is kept as a tree too, which the Compiler copies into its
+// callers instead of calling it, so the Optimizer folds it together with
+// the arguments.
+template <typename Value>
+struct BasicFunction
+{
+    AtomTable::atom name;
+    BasicProgram<Value> body;
+
+    // The optimized tree of the body, with `root` its value, unless the
+    // body is too large to copy into callers or calls itself.
+    std::optional<Ast<Value>> tree;
+    typename Ast<Value>::node_id root = 0;
+    // For each parameter, whether the body reads it whichever way its
+    // conditions go. A copy of the body may only drop an argument that is
+    // read this way, or can't fail, so it doesn't hide the argument's
+    // error.
+    std::vector<bool> strict;
+
+    // The line defining it.
+    std::string source;
+
+    std::size_t arity() const
+    {
+        return body.symbols.size();
+    }
+};
+
+// The functions of a calculator, by name.
+template <typename Value>
+using FunctionTable = std::unordered_map<AtomTable::atom, std::shared_ptr<BasicFunction<Value> const>>;
+
+#endif
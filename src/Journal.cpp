@@ -0,0 +1,383 @@
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Calculator.hpp"
+#include "Diagnostic.hpp"
+#include "Files.hpp"
+#include "Journal.hpp"
+
+namespace
+{
+
+[[noreturn]] void fail(std::string const& path, int error)
+{
+    throw Calculator::calculator_error(Diagnostic::Code::file,
+                                       path + ": " + std::generic_category().message(error));
+}
+
+// FNV-1a, over the kind and the payload of a record.
+std::uint32_t checksum(char kind, std::string_view payload)
+{
+    std::uint32_t value = 2166136261u;
+    value = (value ^ static_cast<unsigned char>(kind)) * 16777619u;
+    for (char c : payload)
+    {
+        value = (value ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return value;
+}
+
+template <typename Plain>
+Plain load(char const* bytes)
+{
+    Plain value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+template <typename Plain>
+void store(std::string& bytes, Plain value)
+{
+    bytes.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+// Returns 0, or the errno of the failure.
+int write_all(int fd, std::string_view bytes)
+{
+    while (!bytes.empty())
+    {
+        ssize_t count = ::write(fd, bytes.data(), bytes.size());
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        bytes.remove_prefix(std::size_t(count));
+    }
+    return 0;
+}
+
+// Appends a record to `bytes`.
+void encode(std::string& bytes, Journal::Kind kind, std::string_view name, std::string_view data)
+{
+    std::size_t start = bytes.size();
+    store(bytes, std::uint32_t(sizeof(std::uint32_t) + name.size() + data.size()));
+    store(bytes, std::uint32_t(0));
+    bytes += char(kind);
+    std::size_t payload = bytes.size();
+    store(bytes, std::uint32_t(name.size()));
+    bytes += name;
+    bytes += data;
+    auto sum = checksum(char(kind), std::string_view(bytes).substr(payload));
+    std::memcpy(&bytes[start + sizeof(std::uint32_t)], &sum, sizeof(sum));
+}
+
+std::string encode(Journal::Kind kind, std::string_view name, std::string_view data)
+{
+    std::string bytes;
+    encode(bytes, kind, name, data);
+    return bytes;
+}
+
+// The whole file at `path`, empty if there is none.
+std::string contents(std::string const& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return std::string();
+        }
+        fail(path, errno);
+    }
+
+    std::string bytes;
+    struct stat status;
+    if (::fstat(fd, &status) == 0)
+    {
+        bytes.reserve(std::size_t(status.st_size));
+    }
+    char block[1 << 16];
+    while (true)
+    {
+        ssize_t count = ::read(fd, block, sizeof(block));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            int error = errno;
+            ::close(fd);
+            fail(path, error);
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        bytes.append(block, std::size_t(count));
+    }
+    ::close(fd);
+    return bytes;
+}
+
+// Calls `callback`, if any, with the intact records at the start of `bytes`.
+// Returns their size, and counts them in `count`.
+std::size_t parse(std::string_view bytes, Journal::record_callback const* callback, std::size_t& count)
+{
+    constexpr std::size_t header = Journal::record_header;
+    std::size_t offset = 0;
+    count = 0;
+    while (bytes.size() - offset >= header)
+    {
+        char const* record = bytes.data() + offset;
+        auto size = load<std::uint32_t>(record);
+        auto sum = load<std::uint32_t>(record + sizeof(std::uint32_t));
+        char kind = record[2 * sizeof(std::uint32_t)];
+        if (bytes.size() - offset - header < size ||
+            static_cast<unsigned char>(kind) > static_cast<unsigned char>(Journal::Kind::line))
+        {
+            break;
+        }
+        std::string_view payload(record + header, size);
+        if (checksum(kind, payload) != sum)
+        {
+            break;
+        }
+
+        if (payload.size() < sizeof(std::uint32_t) ||
+            payload.size() - sizeof(std::uint32_t) < load<std::uint32_t>(payload.data()))
+        {
+            break;
+        }
+        auto name_size = load<std::uint32_t>(payload.data());
+        Journal::Record parsed{Journal::Kind(kind), payload.substr(sizeof(std::uint32_t), name_size),
+                               payload.substr(sizeof(std::uint32_t) + name_size)};
+        if (callback != nullptr)
+        {
+            (*callback)(parsed);
+        }
+        offset += header + size;
+        count++;
+    }
+    return offset;
+}
+
+}
+
+Journal::Journal(std::string path, std::string type, std::chrono::milliseconds window)
+    : path(std::move(path)), type(std::move(type)), window(window)
+{
+    std::size_t count;
+    std::size_t intact = parse(contents(this->path), nullptr, count);
+
+    fd = ::open(this->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fail(this->path, errno);
+    }
+    // Whatever follows the intact records was being written when the
+    // process stopped.
+    if (::ftruncate(fd, off_t(intact)) < 0)
+    {
+        int error = errno;
+        ::close(fd);
+        fail(this->path, error);
+    }
+    if (intact == 0)
+    {
+        std::string record = encode(Kind::base, this->type, std::string_view());
+        int error = write_all(fd, record);
+        if (error == 0 && ::fdatasync(fd) < 0)
+        {
+            error = errno;
+        }
+        // The file may have just been created.
+        if (error == 0)
+        {
+            error = files::sync_directory(this->path);
+        }
+        if (error != 0)
+        {
+            ::close(fd);
+            fail(this->path, error);
+        }
+        appended = durable = record.size();
+    }
+
+    writer = std::thread([this] {
+        write_pending();
+    });
+}
+
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    ::close(fd);
+}
+
+void Journal::assign(std::string_view name, std::string_view value)
+{
+    append(Kind::assign, name, value);
+}
+
+void Journal::line(std::string_view text)
+{
+    append(Kind::line, std::string_view(), text);
+}
+
+void Journal::restart(std::string const& base)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    committers++;
+    wake.notify_one();
+    progress.wait(lock, [this] {
+        return durable == appended || !failure.empty();
+    });
+    committers--;
+    check_failure();
+
+    // The writer has nothing left and waits for the lock: the file is ours.
+    std::string record = encode(Kind::base, type, base);
+    if (::ftruncate(fd, 0) < 0)
+    {
+        failure = path + ": " + std::generic_category().message(errno);
+    }
+    else if (int error = write_all(fd, record))
+    {
+        failure = path + ": " + std::generic_category().message(error);
+    }
+    else if (::fdatasync(fd) < 0)
+    {
+        failure = path + ": " + std::generic_category().message(errno);
+    }
+    check_failure();
+    appended += record.size();
+    durable = appended;
+}
+
+void Journal::commit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    check_failure();
+    std::uint64_t target = appended;
+    if (durable >= target)
+    {
+        return;
+    }
+    committers++;
+    wake.notify_one();
+    progress.wait(lock, [this, target] {
+        return durable >= target || !failure.empty();
+    });
+    committers--;
+    check_failure();
+}
+
+std::size_t Journal::read(std::string const& path, record_callback const& callback)
+{
+    std::size_t count;
+    parse(contents(path), &callback, count);
+    return count;
+}
+
+void Journal::append(Kind kind, std::string_view name, std::string_view data)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    check_failure();
+    if (pending.size() >= max_pending)
+    {
+        wake.notify_one();
+        progress.wait(lock, [this] {
+            return pending.size() < max_pending || !failure.empty();
+        });
+        check_failure();
+    }
+
+    std::size_t start = pending.size();
+    encode(pending, kind, name, data);
+    appended += pending.size() - start;
+
+    // The writer only needs waking when it has nothing to do; otherwise it
+    // picks this record up with the rest of its window.
+    if (start == 0)
+    {
+        wake.notify_one();
+    }
+}
+
+void Journal::write_pending()
+{
+    std::string writing;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] {
+            return stopping || !pending.empty();
+        });
+        if (pending.empty())
+        {
+            return;
+        }
+        // Lets records gather for a window, unless someone waits for them.
+        if (!stopping && committers == 0)
+        {
+            wake.wait_for(lock, window, [this] {
+                return stopping || committers > 0 || pending.size() >= max_pending;
+            });
+        }
+
+        writing.swap(pending);
+        std::uint64_t target = appended;
+        lock.unlock();
+
+        int error = write_all(fd, writing);
+        if (error == 0 && ::fdatasync(fd) < 0)
+        {
+            error = errno;
+        }
+        writing.clear();
+
+        lock.lock();
+        if (error != 0)
+        {
+            failure = path + ": " + std::generic_category().message(error);
+            pending.clear();
+        }
+        else
+        {
+            durable = target;
+        }
+        progress.notify_all();
+    }
+}
+
+void Journal::check_failure() const
+{
+    if (!failure.empty())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::file, failure);
+    }
+}
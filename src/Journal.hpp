@@ -0,0 +1,121 @@
+#ifndef GUARD_JOURNAL_HPP
+#define GUARD_JOURNAL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Write-ahead log of the changes made to a calculator, so a session can be
+// recovered after a crash by restoring the snapshot the journal starts from
+// and replaying its records over it.
+//
+// Appending only copies a record into memory. A thread of the journal
+// writes what was appended and calls fdatasync once per commit window, for
+// every record appended meanwhile (group commit): durability costs one sync
+// per window, not one per line. commit() waits for everything appended so
+// far to be on disk, and is the only call that waits for a sync.
+//
+// Each record is its payload size (32 bits), a checksum of its kind and
+// payload (32 bits), its kind (8 bits) and the payload: the size of its
+// name (32 bits), the name and the data, in the byte order of the machine.
+// A crash can leave a torn record at the end: reading stops at the first
+// record that doesn't check out, and opening cuts it off.
+class Journal
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        // The type of values and the snapshot, if any, the records apply
+        // to. Always first.
+        base,
+        // A symbol and its value, in Numeric<Value>::to_bytes form.
+        assign,
+        // A line evaluated again on recovery, such as a formula definition
+        // or a command.
+        line
+    };
+
+    struct Record
+    {
+        Kind kind;
+        // The type of a base record, the symbol of an assign record.
+        std::string_view name;
+        // The snapshot path, the value or the line.
+        std::string_view data;
+    };
+
+    using record_callback = std::function<void(Record const&)>;
+
+    static constexpr std::chrono::milliseconds default_window{10};
+    // Bytes of a record before its payload.
+    static constexpr std::size_t record_header = 2 * sizeof(std::uint32_t) + 1;
+
+private:
+    // Appending waits for the writer past this much unwritten data.
+    static constexpr std::size_t max_pending = 64 << 20;
+
+private:
+    std::string path;
+    std::string type;
+    int fd;
+    std::chrono::milliseconds window;
+
+    std::mutex mutex;
+    // Signals the writer that there is data, or someone waiting for it.
+    std::condition_variable wake;
+    // Signals appenders and committers that the writer made progress.
+    std::condition_variable progress;
+
+    // Appended but not handed to the writer yet.
+    std::string pending;
+    // Bytes appended, and bytes known to be on disk, since opening.
+    std::uint64_t appended = 0;
+    std::uint64_t durable = 0;
+    std::size_t committers = 0;
+    bool stopping = false;
+    // Why writing failed, after which nothing more is written.
+    std::string failure;
+
+    std::thread writer;
+
+public:
+    // Opens or creates the journal at `path` of a calculator of `type`
+    // values, for appending after the records it holds. Throws
+    // calculator_error if it can't.
+    Journal(std::string path, std::string type, std::chrono::milliseconds window = default_window);
+    Journal(Journal const&) = delete;
+    // Writes and syncs what is left.
+    ~Journal();
+
+    Journal& operator=(Journal const&) = delete;
+
+    void assign(std::string_view name, std::string_view value);
+    void line(std::string_view text);
+
+    // Empties the journal and starts it over from the snapshot at `base`,
+    // or from nothing, once written and synced. Throws calculator_error if
+    // it can't.
+    void restart(std::string const& base);
+
+    // Waits for everything appended so far to be on disk. Throws
+    // calculator_error if it can't be written.
+    void commit();
+
+    // Calls `callback` with every intact record of the journal at `path`,
+    // in order, and returns how many there were: none if there is no file.
+    static std::size_t read(std::string const& path, record_callback const& callback);
+
+private:
+    void append(Kind kind, std::string_view name, std::string_view data);
+    void write_pending();
+    // Throws calculator_error with the failure, if writing failed.
+    void check_failure() const;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "Diagnostic.hpp"
+#include "Lexer.hpp"
+#include "Operators.hpp"
+
+std::optional<Diagnostic> Lexer::tokenize(std::string_view line, std::vector<Token>& tokens)
+{
+    tokens.clear();
+
+    auto const& table = classes();
+    auto class_of = [&table](char c) {
+        return table[static_cast<unsigned char>(c)];
+    };
+
+    std::size_t i = 0;
+    while (i < line.size())
+    {
+        std::size_t start = i;
+        switch (class_of(line[i]))
+        {
+        case CharClass::space:
+            i++;
+            break;
+        case CharClass::alpha:
+            while (i < line.size() && (class_of(line[i]) == CharClass::alpha ||
+                                       class_of(line[i]) == CharClass::digit))
+            {
+                i++;
+            }
+            tokens.push_back({Kind::symbol, line.substr(start, i - start), 0, Operators::none, Operators::none});
+            break;
+        case CharClass::digit:
+        {
+            while (i < line.size() && class_of(line[i]) == CharClass::digit)
+            {
+                i++;
+            }
+            bool fraction = i + 1 < line.size() && line[i] == '.' && class_of(line[i + 1]) == CharClass::digit;
+            if (fraction)
+            {
+                i++;
+                while (i < line.size() && class_of(line[i]) == CharClass::digit)
+                {
+                    i++;
+                }
+            }
+            Token token{Kind::literal, line.substr(start, i - start), 0, Operators::none, Operators::none};
+            if (fraction || std::from_chars(line.data() + start, line.data() + i, token.value).ec != std::errc())
+            {
+                token.kind = Kind::numeral;
+            }
+            tokens.push_back(token);
+            break;
+        }
+        case CharClass::punct:
+        {
+            // Longest operator that is a prefix of the remaining input.
+            auto const& trie = operator_trie();
+            std::size_t node = 0;
+            std::size_t matched = start;
+            std::size_t matched_node = 0;
+            while (i < line.size())
+            {
+                auto c = static_cast<unsigned char>(line[i]);
+                if (c >= 128 || trie[node].next[c] == 0)
+                {
+                    break;
+                }
+                node = trie[node].next[c];
+                i++;
+                if (trie[node].terminal)
+                {
+                    matched = i;
+                    matched_node = node;
+                }
+            }
+            if (matched == start)
+            {
+                return Diagnostic{Diagnostic::Code::invalid_operator, "Invalid operator used.", start};
+            }
+            i = matched;
+
+            TrieNode const& found = trie[matched_node];
+            tokens.push_back({found.kind, line.substr(start, i - start), 0, found.prefix, found.infix});
+            break;
+        }
+        case CharClass::other:
+            return Diagnostic{Diagnostic::Code::invalid_character, "Invalid command", start};
+        }
+    }
+    return std::nullopt;
+}
+
+std::array<Lexer::CharClass, 256> const& Lexer::classes()
+{
+    static std::array<CharClass, 256> const table = [](){
+        std::array<CharClass, 256> ret{};
+        for (int c = 0; c < 256; c++)
+        {
+            if (std::isspace(c))
+            {
+                ret[c] = CharClass::space;
+            }
+            else if (std::isalpha(c))
+            {
+                ret[c] = CharClass::alpha;
+            }
+            else if (std::isdigit(c))
+            {
+                ret[c] = CharClass::digit;
+            }
+            else if (std::ispunct(c))
+            {
+                ret[c] = CharClass::punct;
+            }
+        }
+        return ret;
+    }();
+    return table;
+}
+
+std::vector<Lexer::TrieNode> const& Lexer::operator_trie()
+{
+    static std::vector<TrieNode> const trie = [](){
+        std::vector<TrieNode> ret(1);
+        auto insert = [&ret](std::string_view spelling) -> TrieNode& {
+            std::size_t node = 0;
+            for (char c : spelling)
+            {
+                auto index = static_cast<unsigned char>(c);
+                if (ret[node].next[index] == 0)
+                {
+                    ret[node].next[index] = std::uint16_t(ret.size());
+                    ret.emplace_back();
+                }
+                node = ret[node].next[index];
+            }
+            ret[node].terminal = true;
+            return ret[node];
+        };
+
+        for (std::size_t i = 0; i < Operators::table.size(); i++)
+        {
+            TrieNode& node = insert(Operators::table[i].spelling);
+            if (Operators::table[i].arity == Operators::Arity::prefix)
+            {
+                node.prefix = Operators::index_type(i);
+            }
+            else
+            {
+                node.infix = Operators::index_type(i);
+            }
+        }
+
+        // Parenthesis are not operators but should be reserved nonetheless.
+        insert("(").kind = Kind::open_paren;
+        insert(")").kind = Kind::close_paren;
+        insert(",").kind = Kind::comma;
+
+        return ret;
+    }();
+    return trie;
+}
@@ -0,0 +1,78 @@
+#ifndef GUARD_LEXER_HPP
+#define GUARD_LEXER_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "Diagnostic.hpp"
+#include "Operators.hpp"
+
+// Splits a line into tokens that point back into it. Characters are
+// classified through a table and operators are matched, longest first,
+// against a trie built from Operators::table, so lexing neither allocates
+// (once the token buffer has grown) nor builds any regex.
+class Lexer
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        symbol,
+        literal,
+        // Digits that don't make a machine word: too many of them, or with
+        // a fraction ("2.5"). What they mean depends on the type of values,
+        // so they are left to the Compiler.
+        numeral,
+        op,
+        open_paren,
+        close_paren,
+        // Separates the arguments of calls and the parameters of functions.
+        comma
+    };
+
+    struct Token
+    {
+        Kind kind;
+        std::string_view text;
+        // Only meaningful for literals.
+        Program::value_type value;
+        // Entries of Operators::table this operator token can stand for.
+        Operators::index_type prefix;
+        Operators::index_type infix;
+    };
+
+private:
+    enum class CharClass : std::uint8_t
+    {
+        other,
+        space,
+        alpha,
+        digit,
+        punct
+    };
+
+    struct TrieNode
+    {
+        // Index of the child for each ASCII character, 0 if there is none
+        // (the root is never a child).
+        std::array<std::uint16_t, 128> next{};
+        bool terminal = false;
+        Kind kind = Kind::op;
+        Operators::index_type prefix = Operators::none;
+        Operators::index_type infix = Operators::none;
+    };
+
+public:
+    // Replaces the contents of `tokens`, reusing its storage. A character
+    // that starts no token stops it, and is reported.
+    static std::optional<Diagnostic> tokenize(std::string_view line, std::vector<Token>& tokens);
+
+private:
+    static std::array<CharClass, 256> const& classes();
+    static std::vector<TrieNode> const& operator_trie();
+};
+
+#endif
@@ -0,0 +1,373 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define NATIVE_CODE_X86_64 1
+#endif
+
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "NativeCode.hpp"
+#include "Numeric.hpp"
+
+#ifdef NATIVE_CODE_X86_64
+
+namespace
+{
+
+// Called from generated code, which has no unwind information, so it must
+// not throw: the one failing case (0 to a negative power) is checked before
+// the call.
+NativeCode::value_type power(NativeCode::value_type base, NativeCode::value_type exponent) noexcept
+{
+    return Numeric<NativeCode::value_type>::power(base, exponent);
+}
+
+// Machine code for the System V calling convention: the frame comes in rdi,
+// the scratch area in rsi and the result pointer in rdx, which is moved to
+// r8 since idiv overwrites rdx. With `depth` values on the stack, the top
+// one is in rax and value i < depth - 1 in scratch[i].
+class Assembler
+{
+public:
+    std::vector<std::uint8_t> code;
+
+private:
+    // Positions of rel32 fields that must point at the error exit.
+    std::vector<std::size_t> error_jumps;
+
+public:
+    Assembler()
+    {
+        // mov r8, rdx
+        bytes({0x49, 0x89, 0xd0});
+    }
+
+    void bytes(std::initializer_list<std::uint8_t> list)
+    {
+        code.insert(code.end(), list);
+    }
+
+    void imm32(std::int32_t value)
+    {
+        auto bits = static_cast<std::uint32_t>(value);
+        for (int i = 0; i < 4; i++)
+        {
+            code.push_back(std::uint8_t(bits >> (8 * i)));
+        }
+    }
+
+    void imm64(std::uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            code.push_back(std::uint8_t(value >> (8 * i)));
+        }
+    }
+
+    // Opcode bytes followed by a [base + disp32] operand, with `modrm`
+    // holding the register and base fields.
+    void memory(std::initializer_list<std::uint8_t> opcode, std::uint8_t modrm, std::size_t index)
+    {
+        bytes(opcode);
+        code.push_back(std::uint8_t(0x80 | modrm));
+        imm32(std::int32_t(index * sizeof(NativeCode::value_type)));
+    }
+
+    // mov rax, [rsi + 8 * index] and friends.
+    void load_scratch(std::size_t index)
+    {
+        memory({0x48, 0x8b}, 0x06, index);
+    }
+
+    void store_scratch(std::size_t index)
+    {
+        memory({0x48, 0x89}, 0x06, index);
+    }
+
+    void load_frame(std::size_t index)
+    {
+        memory({0x48, 0x8b}, 0x07, index);
+    }
+
+    // Jump with a rel32 to be patched, `opcode` being the bytes before it.
+    std::size_t jump(std::initializer_list<std::uint8_t> opcode)
+    {
+        bytes(opcode);
+        std::size_t at = code.size();
+        imm32(0);
+        return at;
+    }
+
+    void jump_to_error(std::initializer_list<std::uint8_t> opcode)
+    {
+        error_jumps.push_back(jump(opcode));
+    }
+
+    // Points the jump at `at` to the current position.
+    void land(std::size_t at)
+    {
+        auto offset = std::int32_t(code.size() - (at + 4));
+        auto bits = static_cast<std::uint32_t>(offset);
+        for (int i = 0; i < 4; i++)
+        {
+            code[at + std::size_t(i)] = std::uint8_t(bits >> (8 * i));
+        }
+    }
+
+    void finish()
+    {
+        // mov [r8], rax; xor eax, eax; ret
+        bytes({0x49, 0x89, 0x00, 0x31, 0xc0, 0xc3});
+        for (std::size_t at : error_jumps)
+        {
+            land(at);
+        }
+        // mov eax, 1; ret
+        bytes({0xb8, 0x01, 0x00, 0x00, 0x00, 0xc3});
+    }
+};
+
+// Displacements are 32 bit, which bounds the slots that can be addressed.
+constexpr std::size_t max_index = std::size_t(std::numeric_limits<std::int32_t>::max()) / sizeof(NativeCode::value_type);
+
+std::optional<std::vector<std::uint8_t>> assemble(BasicProgram<NativeCode::value_type> const& program)
+{
+    if (program.code.empty() || program.scratch_size() > max_index || program.symbols.size() > max_index)
+    {
+        return std::nullopt;
+    }
+
+    Assembler a;
+    std::size_t depth = 0;
+    std::size_t temps = program.max_stack;
+
+    auto push = [&a, &depth]() {
+        if (depth > 0)
+        {
+            a.store_scratch(depth - 1);
+        }
+        depth++;
+    };
+
+    for (auto const& instruction : program.code)
+    {
+        switch (instruction.op)
+        {
+        case Program::Opcode::push_literal:
+            push();
+            // mov rax, imm64
+            a.bytes({0x48, 0xb8});
+            a.imm64(static_cast<std::uint64_t>(instruction.immediate));
+            break;
+        case Program::Opcode::push_constant:
+            push();
+            a.bytes({0x48, 0xb8});
+            a.imm64(static_cast<std::uint64_t>(program.constants[instruction.slot]));
+            break;
+        case Program::Opcode::load_symbol:
+            push();
+            a.load_frame(instruction.slot);
+            break;
+        case Program::Opcode::load_temp:
+            push();
+            a.load_scratch(temps + instruction.slot);
+            break;
+        case Program::Opcode::save_temp:
+            a.store_scratch(temps + instruction.slot);
+            break;
+        case Program::Opcode::identity:
+            break;
+        case Program::Opcode::negate:
+            a.bytes({0x48, 0xf7, 0xd8});
+            break;
+        case Program::Opcode::bit_not:
+            a.bytes({0x48, 0xf7, 0xd0});
+            break;
+        case Program::Opcode::add:
+            // add rax, [rsi + 8 * (depth - 2)]
+            a.memory({0x48, 0x03}, 0x06, depth - 2);
+            depth--;
+            break;
+        case Program::Opcode::multiply:
+            // imul rax, [rsi + 8 * (depth - 2)]
+            a.memory({0x48, 0x0f, 0xaf}, 0x06, depth - 2);
+            depth--;
+            break;
+        case Program::Opcode::subtract:
+            // mov rcx, rax; mov rax, lhs; sub rax, rcx
+            a.bytes({0x48, 0x89, 0xc1});
+            a.load_scratch(depth - 2);
+            a.bytes({0x48, 0x29, 0xc8});
+            depth--;
+            break;
+        case Program::Opcode::divide:
+        case Program::Opcode::modulo:
+        {
+            bool divide = instruction.op == Program::Opcode::divide;
+            // mov rcx, rax; test rcx, rcx; jz error
+            a.bytes({0x48, 0x89, 0xc1, 0x48, 0x85, 0xc9});
+            a.jump_to_error({0x0f, 0x84});
+            a.load_scratch(depth - 2);
+            // cmp rcx, -1; jne divide
+            a.bytes({0x48, 0x83, 0xf9, 0xff});
+            std::size_t not_minus_one = a.jump({0x0f, 0x85});
+            // Dividing by -1 is negation, which can't trap like idiv does.
+            if (divide)
+            {
+                a.bytes({0x48, 0xf7, 0xd8});
+            }
+            else
+            {
+                a.bytes({0x31, 0xc0});
+            }
+            std::size_t done = a.jump({0xe9});
+            a.land(not_minus_one);
+            // cqo; idiv rcx
+            a.bytes({0x48, 0x99, 0x48, 0xf7, 0xf9});
+            if (!divide)
+            {
+                // mov rax, rdx
+                a.bytes({0x48, 0x89, 0xd0});
+            }
+            a.land(done);
+            depth--;
+            break;
+        }
+        case Program::Opcode::power:
+        {
+            // mov rcx, rax; mov rax, base; test rax, rax; jnz call
+            a.bytes({0x48, 0x89, 0xc1});
+            a.load_scratch(depth - 2);
+            a.bytes({0x48, 0x85, 0xc0});
+            std::size_t nonzero = a.jump({0x0f, 0x85});
+            // test rcx, rcx; js error
+            a.bytes({0x48, 0x85, 0xc9});
+            a.jump_to_error({0x0f, 0x88});
+            a.land(nonzero);
+            // Three pushes realign the stack to 16 bytes for the call:
+            // push rdi; push rsi; push r8; mov rdi, rax; mov rsi, rcx
+            a.bytes({0x57, 0x56, 0x41, 0x50, 0x48, 0x89, 0xc7, 0x48, 0x89, 0xce});
+            // mov rax, power; call rax
+            a.bytes({0x48, 0xb8});
+            a.imm64(reinterpret_cast<std::uint64_t>(&power));
+            a.bytes({0xff, 0xd0});
+            // pop r8; pop rsi; pop rdi
+            a.bytes({0x41, 0x58, 0x5e, 0x5f});
+            depth--;
+            break;
+        }
+        case Program::Opcode::jump:
+        case Program::Opcode::jump_if_zero:
+        case Program::Opcode::call:
+        case Program::Opcode::recurse:
+        case Program::Opcode::tail_recurse:
+        case Program::Opcode::reduce:
+            // Expressions are straight line code, see BasicCalculator::compile.
+            return std::nullopt;
+        }
+    }
+
+    a.finish();
+    return std::move(a.code);
+}
+
+}
+
+bool NativeCode::supported()
+{
+    return true;
+}
+
+std::optional<NativeCode> NativeCode::compile(BasicProgram<value_type> const& program)
+{
+    auto code = assemble(program);
+    if (!code.has_value())
+    {
+        return std::nullopt;
+    }
+
+    auto page = std::size_t(sysconf(_SC_PAGESIZE));
+    std::size_t length = (code->size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        return std::nullopt;
+    }
+    std::memcpy(memory, code->data(), code->size());
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, length);
+        return std::nullopt;
+    }
+    return NativeCode(memory, length);
+}
+
+NativeCode::NativeCode(void* memory, std::size_t length)
+    : memory(memory), length(length), entry(reinterpret_cast<function_type>(memory))
+{
+}
+
+NativeCode::~NativeCode()
+{
+    if (memory != nullptr)
+    {
+        munmap(memory, length);
+    }
+}
+
+#else
+
+bool NativeCode::supported()
+{
+    return false;
+}
+
+std::optional<NativeCode> NativeCode::compile(BasicProgram<value_type> const&)
+{
+    return std::nullopt;
+}
+
+NativeCode::NativeCode(void* memory, std::size_t length)
+    : memory(memory), length(length)
+{
+}
+
+NativeCode::~NativeCode()
+{
+}
+
+#endif
+
+NativeCode::NativeCode(NativeCode&& other) noexcept
+    : memory(std::exchange(other.memory, nullptr)),
+      length(std::exchange(other.length, 0)),
+      entry(std::exchange(other.entry, nullptr))
+{
+}
+
+NativeCode& NativeCode::operator=(NativeCode&& other) noexcept
+{
+    std::swap(memory, other.memory);
+    std::swap(length, other.length);
+    std::swap(entry, other.entry);
+    return *this;
+}
+
+NativeCode::value_type NativeCode::run(value_type const* frame, value_type* scratch) const
+{
+    value_type result = 0;
+    if (entry(frame, scratch, &result) != 0)
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::division_by_zero, "Division by zero.");
+    }
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef GUARD_NATIVE_CODE_HPP
+#define GUARD_NATIVE_CODE_HPP
+
+#include <cstddef>
+#include <optional>
+
+#include "Bytecode.hpp"
+
+// A Program translated to x86-64 machine code, in memory of its own that is
+// made executable (and no longer writable) once the code is in place.
+// Symbol reads are loads from the frame, the top of the stack lives in a
+// register and the rest of it, along with temporaries, in the same scratch
+// area the VirtualMachine uses. Arithmetic is native (add, imul, idiv);
+// power calls back into Numeric<long>.
+//
+// On other architectures compile() always fails and callers keep using
+// the VirtualMachine.
+class NativeCode
+{
+public:
+    using value_type = Program::value_type;
+
+private:
+    // Returns 0 with the value in *result, or 1 on a division by zero.
+    using function_type = int (*)(value_type const* frame, value_type* scratch, value_type* result);
+
+private:
+    void* memory = nullptr;
+    std::size_t length = 0;
+    function_type entry = nullptr;
+
+public:
+    // Whether compile() can succeed on this machine.
+    static bool supported();
+    static std::optional<NativeCode> compile(BasicProgram<value_type> const& program);
+
+    NativeCode(NativeCode&& other) noexcept;
+    NativeCode& operator=(NativeCode&& other) noexcept;
+    NativeCode(NativeCode const& other) = delete;
+    NativeCode& operator=(NativeCode const& other) = delete;
+    ~NativeCode();
+
+    // Same contract as VirtualMachine::run.
+    value_type run(value_type const* frame, value_type* scratch) const;
+
+private:
+    NativeCode(void* memory, std::size_t length);
+};
+
+#endif
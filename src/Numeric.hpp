@@ -0,0 +1,723 @@
+#ifndef GUARD_NUMERIC_HPP
+#define GUARD_NUMERIC_HPP
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "BigInt.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "Decimal.hpp"
+#include "OutputBuffer.hpp"
+
+// 128 bit integers are a GCC and Clang extension.
+__extension__ typedef __int128 int128;
+__extension__ typedef unsigned __int128 uint128;
+
+// Expands X(type) for every type a BasicCalculator can compute with. Files
+// defining the members of a template over the value type use it to
+// instantiate them for all of these.
+#define FOR_EACH_NUMERIC_TYPE(X) \
+    X(long)                      \
+    X(int128)                    \
+    X(double)                    \
+    X(Decimal)                   \
+    X(BigInt)
+
+// Everything the engine needs to know about a type of value, one
+// specialization per type, all inline so each instantiation of the VM,
+// Optimizer and Compiler has its kernels compiled into it:
+//
+//   name          what --type calls it
+//   integral      whether integer identities (x - x = 0, ~~x = x, ...) and
+//                 reassociation hold
+//   wraps         whether integer overflow wraps around
+//   from_word     the value of an integer literal
+//   parse         the value of a numeral the Lexer couldn't read as a word
+//   encode        the 64 bit immediate standing for a value, if any
+//   decode        the inverse of encode
+//   to_word       the value as a 64 bit integer, if it is exactly one
+//   is_zero       whether the value is zero, which `if` takes as false
+//   to_string     text of a value, as printed
+//   write         the same, appended to an OutputBuffer
+//   to_bytes      binary form of a value, appended to a string, for
+//                 snapshots
+//   from_bytes    the inverse of to_bytes, nothing if the bytes aren't a
+//                 value
+//   apply         the Program operations
+//
+// Every type uses the same messages for the same errors.
+template <typename Value>
+struct Numeric;
+
+namespace numeric
+{
+
+[[noreturn]] inline void out_of_range(std::string_view numeral)
+{
+    throw Calculator::calculator_error(Diagnostic::Code::out_of_range, std::string(numeral) + " is out of range.");
+}
+
+[[noreturn]] inline void not_integer(std::string_view numeral)
+{
+    throw Calculator::calculator_error(Diagnostic::Code::not_integer, std::string(numeral) + " is not an integer.");
+}
+
+[[noreturn]] inline void division_by_zero()
+{
+    throw Calculator::calculator_error(Diagnostic::Code::division_by_zero, "Division by zero.");
+}
+
+[[noreturn]] inline void invalid()
+{
+    throw Calculator::calculator_error(Diagnostic::Code::invalid_operation, "Invalid operation.");
+}
+
+// Binary form of a type that is plain bytes.
+template <typename Plain>
+void append_bytes(std::string& bytes, Plain value)
+{
+    bytes.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+template <typename Plain>
+std::optional<Plain> read_bytes(std::string_view bytes)
+{
+    if (bytes.size() != sizeof(Plain))
+    {
+        return std::nullopt;
+    }
+    Plain value;
+    std::memcpy(&value, bytes.data(), sizeof(value));
+    return value;
+}
+
+// Wrapping arithmetic for the fixed width integers: overflow wraps around
+// instead of being undefined, division by -1 doesn't trap, and negative
+// powers truncate the real valued result.
+template <typename Integer, typename Unsigned>
+struct Wrapping
+{
+    static Integer wrap(Unsigned value)
+    {
+        return static_cast<Integer>(value);
+    }
+
+    static Integer power(Integer base, Integer exponent)
+    {
+        if (exponent < 0)
+        {
+            if (base == 0)
+            {
+                division_by_zero();
+            }
+            if (base == 1 || base == -1)
+            {
+                return (exponent % 2 == 0) ? 1 : base;
+            }
+            return 0;
+        }
+
+        // Exponentiation by squaring.
+        Unsigned result = 1;
+        Unsigned factor = static_cast<Unsigned>(base);
+        while (exponent != 0)
+        {
+            if (exponent & 1)
+            {
+                result *= factor;
+            }
+            factor *= factor;
+            exponent >>= 1;
+        }
+        return wrap(result);
+    }
+
+    static Integer apply(Program::Opcode op, Integer a, Integer b)
+    {
+        switch (op)
+        {
+        case Program::Opcode::power:
+            return power(a, b);
+        case Program::Opcode::multiply:
+            return wrap(static_cast<Unsigned>(a) * static_cast<Unsigned>(b));
+        case Program::Opcode::divide:
+        case Program::Opcode::modulo:
+            if (b == 0)
+            {
+                division_by_zero();
+            }
+            if (b == -1)
+            {
+                // Avoids trapping on the one quotient that doesn't fit.
+                return op == Program::Opcode::divide ? wrap(Unsigned(0) - static_cast<Unsigned>(a)) : 0;
+            }
+            return op == Program::Opcode::divide ? a / b : a % b;
+        case Program::Opcode::add:
+            return wrap(static_cast<Unsigned>(a) + static_cast<Unsigned>(b));
+        case Program::Opcode::subtract:
+            return wrap(static_cast<Unsigned>(a) - static_cast<Unsigned>(b));
+        default:
+            invalid();
+        }
+    }
+
+    static Integer apply(Program::Opcode op, Integer a)
+    {
+        switch (op)
+        {
+        case Program::Opcode::negate:
+            return wrap(Unsigned(0) - static_cast<Unsigned>(a));
+        case Program::Opcode::bit_not:
+            return ~a;
+        case Program::Opcode::identity:
+            return a;
+        default:
+            invalid();
+        }
+    }
+};
+
+}
+
+template <>
+struct Numeric<long> : numeric::Wrapping<long, unsigned long>
+{
+    static constexpr char const* name = "long";
+    static constexpr bool integral = true;
+    static constexpr bool wraps = true;
+
+    static long from_word(Program::value_type word)
+    {
+        return word;
+    }
+
+    // The Lexer reads every integer that fits, so this only sees the rest.
+    static long parse(std::string_view numeral)
+    {
+        if (numeral.find('.') != std::string_view::npos)
+        {
+            numeric::not_integer(numeral);
+        }
+        numeric::out_of_range(numeral);
+    }
+
+    static std::optional<Program::value_type> encode(long value)
+    {
+        return value;
+    }
+
+    static long decode(Program::value_type immediate)
+    {
+        return immediate;
+    }
+
+    static bool is_zero(long value)
+    {
+        return value == 0;
+    }
+
+    static std::optional<Program::value_type> to_word(long value)
+    {
+        return value;
+    }
+
+    static std::string to_string(long value)
+    {
+        return std::to_string(value);
+    }
+
+    static void to_bytes(std::string& bytes, long value)
+    {
+        numeric::append_bytes(bytes, value);
+    }
+
+    static std::optional<long> from_bytes(std::string_view bytes)
+    {
+        return numeric::read_bytes<long>(bytes);
+    }
+
+    static void write(OutputBuffer& output, long value)
+    {
+        output.append(value);
+    }
+};
+
+template <>
+struct Numeric<int128> : numeric::Wrapping<int128, uint128>
+{
+    static constexpr char const* name = "int128";
+    static constexpr bool integral = true;
+    static constexpr bool wraps = true;
+
+    static int128 from_word(Program::value_type word)
+    {
+        return word;
+    }
+
+    static int128 parse(std::string_view numeral)
+    {
+        if (numeral.find('.') != std::string_view::npos)
+        {
+            numeric::not_integer(numeral);
+        }
+        int128 value = 0;
+        for (char c : numeral)
+        {
+            if (__builtin_mul_overflow(value, 10, &value) || __builtin_add_overflow(value, c - '0', &value))
+            {
+                numeric::out_of_range(numeral);
+            }
+        }
+        return value;
+    }
+
+    static std::optional<Program::value_type> encode(int128 value)
+    {
+        return to_word(value);
+    }
+
+    static int128 decode(Program::value_type immediate)
+    {
+        return immediate;
+    }
+
+    static bool is_zero(int128 value)
+    {
+        return value == 0;
+    }
+
+    static std::optional<Program::value_type> to_word(int128 value)
+    {
+        auto word = static_cast<Program::value_type>(value);
+        if (word != value)
+        {
+            return std::nullopt;
+        }
+        return word;
+    }
+
+    static std::string to_string(int128 value)
+    {
+        // Digits are taken from the signed remainder, since negating the
+        // smallest value overflows.
+        char digits[40];
+        char* first = digits + sizeof(digits);
+        int128 rest = value;
+        do
+        {
+            int digit = int(rest % 10);
+            *--first = char('0' + (digit < 0 ? -digit : digit));
+            rest /= 10;
+        } while (rest != 0);
+        std::string text = value < 0 ? "-" : "";
+        text.append(first, digits + sizeof(digits));
+        return text;
+    }
+
+    static void to_bytes(std::string& bytes, int128 value)
+    {
+        numeric::append_bytes(bytes, value);
+    }
+
+    static std::optional<int128> from_bytes(std::string_view bytes)
+    {
+        return numeric::read_bytes<int128>(bytes);
+    }
+
+    static void write(OutputBuffer& output, int128 value)
+    {
+        auto word = to_word(value);
+        if (word.has_value())
+        {
+            output.append(word.value());
+        }
+        else
+        {
+            output.append(to_string(value));
+        }
+    }
+};
+
+template <>
+struct Numeric<double>
+{
+    static constexpr char const* name = "double";
+    static constexpr bool integral = false;
+    static constexpr bool wraps = false;
+
+    static double from_word(Program::value_type word)
+    {
+        return double(word);
+    }
+
+    static double parse(std::string_view numeral)
+    {
+        double value = 0;
+        auto result = std::from_chars(numeral.data(), numeral.data() + numeral.size(), value);
+        if (result.ec != std::errc())
+        {
+            numeric::out_of_range(numeral);
+        }
+        return value;
+    }
+
+    // The bits of the double.
+    static std::optional<Program::value_type> encode(double value)
+    {
+        Program::value_type immediate;
+        std::memcpy(&immediate, &value, sizeof(value));
+        return immediate;
+    }
+
+    static double decode(Program::value_type immediate)
+    {
+        double value;
+        std::memcpy(&value, &immediate, sizeof(value));
+        return value;
+    }
+
+    static bool is_zero(double value)
+    {
+        return value == 0;
+    }
+
+    static std::optional<Program::value_type> to_word(double value)
+    {
+        // 2^63 is exact as a double, unlike the largest word.
+        if (!(value >= -0x1p63 && value < 0x1p63) || std::trunc(value) != value)
+        {
+            return std::nullopt;
+        }
+        return Program::value_type(value);
+    }
+
+    // Shortest text that reads back as the same double. Zero is printed
+    // as "0" whatever its sign, as the integer types print it: -5 % 1 is
+    // -0 in IEEE arithmetic.
+    static std::string to_string(double value)
+    {
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), value == 0 ? 0.0 : value);
+        return std::string(text, result.ptr);
+    }
+
+    static void to_bytes(std::string& bytes, double value)
+    {
+        numeric::append_bytes(bytes, value);
+    }
+
+    static std::optional<double> from_bytes(std::string_view bytes)
+    {
+        return numeric::read_bytes<double>(bytes);
+    }
+
+    static void write(OutputBuffer& output, double value)
+    {
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), value == 0 ? 0.0 : value);
+        output.append(std::string_view(text, std::size_t(result.ptr - text)));
+    }
+
+    static double apply(Program::Opcode op, double a, double b)
+    {
+        switch (op)
+        {
+        case Program::Opcode::power:
+            if (a == 0 && b < 0)
+            {
+                numeric::division_by_zero();
+            }
+            return std::pow(a, b);
+        case Program::Opcode::multiply:
+            return a * b;
+        case Program::Opcode::divide:
+            if (b == 0)
+            {
+                numeric::division_by_zero();
+            }
+            return a / b;
+        case Program::Opcode::modulo:
+            if (b == 0)
+            {
+                numeric::division_by_zero();
+            }
+            return std::fmod(a, b);
+        case Program::Opcode::add:
+            return a + b;
+        case Program::Opcode::subtract:
+            return a - b;
+        default:
+            numeric::invalid();
+        }
+    }
+
+    static double apply(Program::Opcode op, double a)
+    {
+        switch (op)
+        {
+        case Program::Opcode::negate:
+            return -a;
+        case Program::Opcode::identity:
+            return a;
+        default:
+            numeric::invalid();
+        }
+    }
+};
+
+template <>
+struct Numeric<Decimal>
+{
+    static constexpr char const* name = "decimal";
+    static constexpr bool integral = false;
+    static constexpr bool wraps = false;
+
+    static Decimal from_word(Program::value_type word)
+    {
+        return Decimal::from_integer(word);
+    }
+
+    static Decimal parse(std::string_view numeral)
+    {
+        auto value = Decimal::parse(numeral);
+        if (!value.has_value())
+        {
+            numeric::out_of_range(numeral);
+        }
+        return value.value();
+    }
+
+    // The units, when they fit.
+    static std::optional<Program::value_type> encode(Decimal value)
+    {
+        auto immediate = static_cast<Program::value_type>(value.raw());
+        if (immediate != value.raw())
+        {
+            return std::nullopt;
+        }
+        return immediate;
+    }
+
+    static Decimal decode(Program::value_type immediate)
+    {
+        return Decimal::from_units(immediate);
+    }
+
+    static bool is_zero(Decimal value)
+    {
+        return value.is_zero();
+    }
+
+    static std::optional<Program::value_type> to_word(Decimal value)
+    {
+        if (!value.is_integer())
+        {
+            return std::nullopt;
+        }
+        auto integer = value.raw() / Decimal::scale;
+        auto word = static_cast<Program::value_type>(integer);
+        if (word != integer)
+        {
+            return std::nullopt;
+        }
+        return word;
+    }
+
+    static std::string to_string(Decimal value)
+    {
+        return value.to_string();
+    }
+
+    static void to_bytes(std::string& bytes, Decimal value)
+    {
+        numeric::append_bytes(bytes, value.raw());
+    }
+
+    static std::optional<Decimal> from_bytes(std::string_view bytes)
+    {
+        auto units = numeric::read_bytes<Decimal::units_type>(bytes);
+        if (!units.has_value())
+        {
+            return std::nullopt;
+        }
+        return Decimal::from_units(units.value());
+    }
+
+    static void write(OutputBuffer& output, Decimal value)
+    {
+        output.append(value.to_string());
+    }
+
+    static Decimal apply(Program::Opcode op, Decimal a, Decimal b)
+    {
+        switch (op)
+        {
+        case Program::Opcode::power:
+            if (!b.is_integer())
+            {
+                throw Calculator::calculator_error(Diagnostic::Code::invalid_operation, "Exponents must be integers.");
+            }
+            if (a.is_zero() && b.is_negative())
+            {
+                numeric::division_by_zero();
+            }
+            return Decimal::pow(a, b.raw() / Decimal::scale);
+        case Program::Opcode::multiply:
+            return a * b;
+        case Program::Opcode::divide:
+        case Program::Opcode::modulo:
+            if (b.is_zero())
+            {
+                numeric::division_by_zero();
+            }
+            return op == Program::Opcode::divide ? a / b : a % b;
+        case Program::Opcode::add:
+            return a + b;
+        case Program::Opcode::subtract:
+            return a - b;
+        default:
+            numeric::invalid();
+        }
+    }
+
+    static Decimal apply(Program::Opcode op, Decimal a)
+    {
+        switch (op)
+        {
+        case Program::Opcode::negate:
+            return -a;
+        case Program::Opcode::identity:
+            return a;
+        default:
+            numeric::invalid();
+        }
+    }
+};
+
+template <>
+struct Numeric<BigInt>
+{
+    static constexpr char const* name = "bigint";
+    static constexpr bool integral = true;
+    static constexpr bool wraps = false;
+
+    static BigInt from_word(Program::value_type word)
+    {
+        return word;
+    }
+
+    static BigInt parse(std::string_view numeral)
+    {
+        auto value = BigInt::parse(numeral);
+        if (!value.has_value())
+        {
+            numeric::not_integer(numeral);
+        }
+        return value.value();
+    }
+
+    static std::optional<Program::value_type> encode(BigInt const& value)
+    {
+        return to_word(value);
+    }
+
+    static BigInt decode(Program::value_type immediate)
+    {
+        return immediate;
+    }
+
+    static bool is_zero(BigInt const& value)
+    {
+        return value.is_zero();
+    }
+
+    static std::optional<Program::value_type> to_word(BigInt const& value)
+    {
+        if (!value.is_word())
+        {
+            return std::nullopt;
+        }
+        return value.word();
+    }
+
+    static std::string to_string(BigInt const& value)
+    {
+        return value.to_string();
+    }
+
+    static void to_bytes(std::string& bytes, BigInt const& value)
+    {
+        value.to_bytes(bytes);
+    }
+
+    static std::optional<BigInt> from_bytes(std::string_view bytes)
+    {
+        return BigInt::from_bytes(bytes);
+    }
+
+    static void write(OutputBuffer& output, BigInt const& value)
+    {
+        if (value.is_word())
+        {
+            output.append(long(value.word()));
+        }
+        else
+        {
+            output.append(value.to_string());
+        }
+    }
+
+    static BigInt apply(Program::Opcode op, BigInt const& a, BigInt const& b)
+    {
+        switch (op)
+        {
+        case Program::Opcode::power:
+            if (b.is_negative())
+            {
+                // Only the sign of the exponent and its parity matter here.
+                return Numeric<long>::power(a.is_word() ? a.word() : 2, b.wrapped() | std::numeric_limits<long>::min());
+            }
+            return BigInt::pow(a, b);
+        case Program::Opcode::multiply:
+            return a * b;
+        case Program::Opcode::divide:
+        case Program::Opcode::modulo:
+            if (b.is_zero())
+            {
+                numeric::division_by_zero();
+            }
+            return op == Program::Opcode::divide ? a / b : a % b;
+        case Program::Opcode::add:
+            return a + b;
+        case Program::Opcode::subtract:
+            return a - b;
+        default:
+            numeric::invalid();
+        }
+    }
+
+    static BigInt apply(Program::Opcode op, BigInt const& a)
+    {
+        switch (op)
+        {
+        case Program::Opcode::negate:
+            return -a;
+        case Program::Opcode::bit_not:
+            return ~a;
+        case Program::Opcode::identity:
+            return a;
+        default:
+            numeric::invalid();
+        }
+    }
+};
+
+#endif
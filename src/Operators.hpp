@@ -0,0 +1,87 @@
+#ifndef GUARD_OPERATORS_HPP
+#define GUARD_OPERATORS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "Bytecode.hpp"
+
+// Every operator of the language with its precedence, associativity and
+// arity, known at compile time. Higher precedence binds tighter.
+class Operators
+{
+public:
+    enum class Arity : std::uint8_t
+    {
+        prefix,
+        infix
+    };
+
+    enum class Associativity : std::uint8_t
+    {
+        left,
+        right
+    };
+
+    enum class Assignment : std::uint8_t
+    {
+        none,
+        // Stores the value.
+        value,
+        // Stores the expression, which is evaluated again whenever a symbol
+        // it reads changes.
+        formula
+    };
+
+    struct Info
+    {
+        std::string_view spelling;
+        Arity arity;
+        std::uint8_t precedence;
+        Associativity associativity;
+        // Assignment is not an instruction: it is recorded in
+        // Program::assigned_symbol, and `opcode` is meaningless for it.
+        Assignment assignment;
+        Program::Opcode opcode;
+    };
+
+    using index_type = std::uint8_t;
+
+    static constexpr index_type none = 0xff;
+
+    static constexpr std::uint8_t assignment_precedence = 1;
+
+    static constexpr std::array<Info, 11> table = {{
+        {"=", Arity::infix, assignment_precedence, Associativity::right, Assignment::value, Program::Opcode::identity},
+        {":=", Arity::infix, assignment_precedence, Associativity::right, Assignment::formula, Program::Opcode::identity},
+        {"+", Arity::infix, 2, Associativity::left, Assignment::none, Program::Opcode::add},
+        {"-", Arity::infix, 2, Associativity::left, Assignment::none, Program::Opcode::subtract},
+        {"*", Arity::infix, 3, Associativity::left, Assignment::none, Program::Opcode::multiply},
+        {"/", Arity::infix, 3, Associativity::left, Assignment::none, Program::Opcode::divide},
+        {"%", Arity::infix, 3, Associativity::left, Assignment::none, Program::Opcode::modulo},
+        {"**", Arity::infix, 4, Associativity::right, Assignment::none, Program::Opcode::power},
+        // All unary operators have more precedence than the binary ones.
+        {"-", Arity::prefix, 5, Associativity::right, Assignment::none, Program::Opcode::negate},
+        {"~", Arity::prefix, 5, Associativity::right, Assignment::none, Program::Opcode::bit_not},
+        {"+", Arity::prefix, 5, Associativity::right, Assignment::none, Program::Opcode::identity}
+    }};
+
+    static constexpr index_type find(std::string_view spelling, Arity arity)
+    {
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            if (table[i].spelling == spelling && table[i].arity == arity)
+            {
+                return index_type(i);
+            }
+        }
+        return none;
+    }
+};
+
+static_assert(Operators::find("**", Operators::Arity::infix) != Operators::none,
+              "operator table lookups must work at compile time");
+
+#endif
@@ -0,0 +1,218 @@
+#include <utility>
+
+#include "Ast.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "Numeric.hpp"
+#include "Optimizer.hpp"
+
+template <typename Value>
+typename Optimizer<Value>::node_id Optimizer<Value>::unary(Tree& ast, Program::Opcode op, node_id a)
+{
+    if (op == Program::Opcode::identity)
+    {
+        return a;
+    }
+    if (ast.is_number(a))
+    {
+        try
+        {
+            return ast.number(Numeric<Value>::apply(op, ast.number_at(a)));
+        }
+        catch (Calculator::calculator_error const&)
+        {
+            return ast.unary(op, a);
+        }
+    }
+    // --x, and ~~x where ~ is defined
+    if (ast[a].kind == Tree::Kind::unary && ast[a].op == op &&
+        (op == Program::Opcode::negate || Numeric<Value>::integral))
+    {
+        return ast[a].lhs;
+    }
+    return ast.unary(op, a);
+}
+
+template <typename Value>
+typename Optimizer<Value>::node_id Optimizer<Value>::binary(Tree& ast, Program::Opcode op, node_id a, node_id b)
+{
+    bool literal_a = ast.is_number(a);
+    bool literal_b = ast.is_number(b);
+    if (literal_a && literal_b)
+    {
+        try
+        {
+            return ast.number(Numeric<Value>::apply(op, ast.number_at(a), ast.number_at(b)));
+        }
+        catch (Calculator::calculator_error const&)
+        {
+            return ast.binary(op, a, b);
+        }
+    }
+
+    // Literals go to the right of commutative operations, so x + 1 and
+    // 1 + x end up as the same node.
+    if ((op == Program::Opcode::add || op == Program::Opcode::multiply) && literal_a)
+    {
+        std::swap(a, b);
+        std::swap(literal_a, literal_b);
+    }
+
+    // Whether `a` is itself `op` applied to something and a literal.
+    bool chained = Numeric<Value>::integral && literal_b && ast[a].kind == Tree::Kind::binary && ast[a].op == op &&
+        ast.is_number(ast[a].rhs);
+
+    switch (op)
+    {
+    case Program::Opcode::add:
+        // Not for doubles: -0.0 + 0 is 0.
+        if (Numeric<Value>::integral && ast.is_word(b, 0))
+        {
+            return a;
+        }
+        if (chained)
+        {
+            return reassociate(ast, op, a, b);
+        }
+        break;
+    case Program::Opcode::subtract:
+        if (ast.is_word(b, 0))
+        {
+            return a;
+        }
+        // Doubles have -0.0, infinities and NaN to spoil these.
+        if (Numeric<Value>::integral && ast.is_word(a, 0))
+        {
+            return unary(ast, Program::Opcode::negate, b);
+        }
+        if (Numeric<Value>::integral && a == b && cannot_fail(ast, a))
+        {
+            return word(ast, 0);
+        }
+        break;
+    case Program::Opcode::multiply:
+        if (ast.is_word(b, 1))
+        {
+            return a;
+        }
+        if (Numeric<Value>::integral && ast.is_word(b, 0) && cannot_fail(ast, a))
+        {
+            return b;
+        }
+        if (ast.is_word(b, -1))
+        {
+            return unary(ast, Program::Opcode::negate, a);
+        }
+        if (chained)
+        {
+            return reassociate(ast, op, a, b);
+        }
+        break;
+    case Program::Opcode::divide:
+        if (ast.is_word(b, 1))
+        {
+            return a;
+        }
+        break;
+    case Program::Opcode::modulo:
+        if (Numeric<Value>::integral && (ast.is_word(b, 1) || ast.is_word(b, -1)) && cannot_fail(ast, a))
+        {
+            return word(ast, 0);
+        }
+        break;
+    case Program::Opcode::power:
+        if (ast.is_word(b, 1))
+        {
+            return a;
+        }
+        if (ast.is_word(b, 0) && cannot_fail(ast, a))
+        {
+            return word(ast, 1);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return ast.binary(op, a, b);
+}
+
+template <typename Value>
+typename Optimizer<Value>::node_id Optimizer<Value>::condition(Tree& ast, node_id test, node_id then,
+                                                               node_id otherwise)
+{
+    // The value not taken would never have been evaluated, so dropping it
+    // hides nothing.
+    if (ast.is_number(test))
+    {
+        return Numeric<Value>::is_zero(ast.number_at(test)) ? otherwise : then;
+    }
+    if (then == otherwise && cannot_fail(ast, test))
+    {
+        return then;
+    }
+    return ast.condition(test, then, otherwise);
+}
+
+template <typename Value>
+typename Optimizer<Value>::node_id Optimizer<Value>::reassociate(Tree& ast, Program::Opcode op, node_id a, node_id b)
+{
+    node_id x = ast[a].lhs;
+    Value c;
+    try
+    {
+        c = Numeric<Value>::apply(op, ast.number_at(ast[a].rhs), ast.number_at(b));
+    }
+    catch (Calculator::calculator_error const&)
+    {
+        return ast.binary(op, a, b);
+    }
+    return binary(ast, op, x, ast.number(c));
+}
+
+template <typename Value>
+typename Optimizer<Value>::node_id Optimizer<Value>::word(Tree& ast, Program::value_type word)
+{
+    return ast.number(Numeric<Value>::from_word(word));
+}
+
+template <typename Value>
+bool Optimizer<Value>::cannot_fail(Tree const& ast, node_id id)
+{
+    typename Tree::Node const& node = ast[id];
+    switch (node.kind)
+    {
+    case Tree::Kind::literal:
+    case Tree::Kind::constant:
+    case Tree::Kind::symbol:
+    case Tree::Kind::index:
+        // Symbols are resolved (and reported if undefined) before the
+        // program runs, even when no instruction reads them.
+        return true;
+    case Tree::Kind::unary:
+        // ~ is an error for some types.
+        return (node.op == Program::Opcode::negate || Numeric<Value>::integral) && cannot_fail(ast, node.lhs);
+    case Tree::Kind::binary:
+        if (node.op == Program::Opcode::divide || node.op == Program::Opcode::modulo ||
+            node.op == Program::Opcode::power)
+        {
+            return false;
+        }
+        return cannot_fail(ast, node.lhs) && cannot_fail(ast, node.rhs);
+    case Tree::Kind::condition:
+        return cannot_fail(ast, node.lhs) && cannot_fail(ast, ast[node.rhs].lhs) &&
+            cannot_fail(ast, ast[node.rhs].rhs);
+    case Tree::Kind::call:
+    case Tree::Kind::recurse:
+    case Tree::Kind::reduce:
+        // Calls can nest too deep, and bounds may not be integers.
+    case Tree::Kind::argument:
+    case Tree::Kind::alternatives:
+        return false;
+    }
+    return false;
+}
+
+#define INSTANTIATE(Value) template class Optimizer<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,43 @@
+#ifndef GUARD_OPTIMIZER_HPP
+#define GUARD_OPTIMIZER_HPP
+
+#include "Ast.hpp"
+#include "Bytecode.hpp"
+
+// Node constructors for an Ast that simplify as they build. The Compiler
+// creates every operation through them, so each line comes out with
+// literal subexpressions folded, identities such as x*1, x+0, x*0 and --x
+// removed, and chains like (x + 1) + 2 merged into x + 3. The Ast is hash
+// consed, so repeated subexpressions end up as one shared node.
+//
+// Folding computes with Numeric<Value>, as evaluation does, and identities
+// that only hold for integers are left alone for the other types.
+//
+// Rewrites never hide an error: a subexpression is only dropped when it
+// can't fail, and a literal operation that fails (1/0) is kept for
+// evaluation to report.
+template <typename Value>
+class Optimizer
+{
+public:
+    using Tree = Ast<Value>;
+    using node_id = typename Tree::node_id;
+
+public:
+    static node_id unary(Tree& ast, Program::Opcode op, node_id a);
+    static node_id binary(Tree& ast, Program::Opcode op, node_id a, node_id b);
+    // if(test, then, otherwise), which only evaluates the value it takes.
+    static node_id condition(Tree& ast, node_id test, node_id then, node_id otherwise);
+
+    // Whether evaluating `id` can't throw, so dropping it hides nothing.
+    static bool cannot_fail(Tree const& ast, node_id id);
+
+private:
+    // (x op c1) op c2 as x op (c1 op c2), for associative `op`.
+    static node_id reassociate(Tree& ast, Program::Opcode op, node_id a, node_id b);
+
+    // The number `word`.
+    static node_id word(Tree& ast, Program::value_type word);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include "OutputBuffer.hpp"
+
+OutputBuffer::OutputBuffer(int fd, std::size_t capacity)
+    : fd(fd), buffer(capacity)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    try
+    {
+        flush();
+    }
+    catch (std::system_error const&)
+    {
+        // Nowhere left to report it.
+    }
+}
+
+void OutputBuffer::append(std::string_view text)
+{
+    if (text.size() > buffer.size())
+    {
+        flush();
+        buffer.resize(text.size());
+    }
+    reserve(text.size());
+    std::memcpy(buffer.data() + used, text.data(), text.size());
+    used += text.size();
+}
+
+void OutputBuffer::append(char c)
+{
+    reserve(1);
+    buffer[used++] = c;
+}
+
+void OutputBuffer::append(long value)
+{
+    // Enough for the sign and every digit of a 64 bit value.
+    reserve(20);
+    auto result = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), value);
+    used = std::size_t(result.ptr - buffer.data());
+}
+
+void OutputBuffer::flush()
+{
+    std::size_t written = 0;
+    while (written < used)
+    {
+        ssize_t count = ::write(fd, buffer.data() + written, used - written);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            used = 0;
+            throw std::system_error(errno, std::generic_category(), "write");
+        }
+        written += std::size_t(count);
+    }
+    used = 0;
+}
+
+void OutputBuffer::reserve(std::size_t size)
+{
+    if (buffer.size() - used < size)
+    {
+        flush();
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef GUARD_OUTPUT_BUFFER_HPP
+#define GUARD_OUTPUT_BUFFER_HPP
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Collects output in a large buffer and writes it to a file descriptor in
+// big chunks, so printing a result costs a memcpy rather than a system call.
+class OutputBuffer
+{
+public:
+    static constexpr std::size_t default_capacity = 1 << 20;
+
+private:
+    int fd;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+
+public:
+    OutputBuffer(int fd, std::size_t capacity = default_capacity);
+    OutputBuffer(OutputBuffer const&) = delete;
+    ~OutputBuffer();
+
+    OutputBuffer& operator=(OutputBuffer const&) = delete;
+
+    void append(std::string_view text);
+    void append(char c);
+    void append(long value);
+
+    void flush();
+
+private:
+    void reserve(std::size_t size);
+};
+
+#endif
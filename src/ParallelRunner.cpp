@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "BatchRunner.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "Compiler.hpp"
+#include "Lexer.hpp"
+#include "Numeric.hpp"
+#include "OutputBuffer.hpp"
+#include "ParallelRunner.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+#include "VirtualMachine.hpp"
+
+template <typename Value>
+ParallelRunner<Value>::ParallelRunner(BasicCalculator<Value>& calculator, std::size_t jobs, int output_fd, int error_fd)
+    : calculator(calculator), pool(jobs), output(output_fd), errors(error_fd)
+{
+    memory.reserve(window_size / chunk_size);
+    for (std::size_t i = 0; i < window_size / chunk_size; i++)
+    {
+        memory.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>());
+    }
+}
+
+template <typename Value>
+BatchRunner::Summary ParallelRunner<Value>::run(std::string const& path)
+{
+    BatchRunner::Summary summary;
+    auto start = std::chrono::steady_clock::now();
+
+    window.reserve(window_size);
+    std::string command;
+    BatchRunner::for_each_line(path, [this, &summary, &command](std::string_view line) {
+        summary.lines++;
+        // Blank lines count, but take no place in a window.
+        if (line.find_first_not_of(" \t") == std::string_view::npos)
+        {
+            return;
+        }
+        command.assign(line.begin(), line.end());
+        bool alone = Calculator::is_command(command) || Calculator::is_definition(command) ||
+            command.find(":=") != std::string::npos;
+        if (!alone)
+        {
+            window.emplace_back(memory[window.size() / chunk_size].get());
+            window.back().number = summary.lines;
+            window.back().text.assign(line.begin(), line.end());
+            // Whether it assigns a symbol formulas read takes its program,
+            // which the window then keeps.
+            if (calculator.has_formulas())
+            {
+                compile(window.back());
+                alone = drives_formulas(window.back());
+                if (alone)
+                {
+                    window.pop_back();
+                }
+            }
+        }
+        if (alone)
+        {
+            // Commands may touch the whole state, and so may lines that go
+            // through formulas or define functions, so they run on their own
+            // between windows.
+            run_window(summary);
+            errors.flush();
+
+            auto text = calculator.evaluate(command);
+            if (!text.has_value())
+            {
+                BatchRunner::report(errors, summary.lines, text.error().message);
+            }
+            else if (text.value().has_value())
+            {
+                output.append(text.value().value());
+                output.append('\n');
+            }
+            return;
+        }
+
+        if (window.size() == window_size)
+        {
+            run_window(summary);
+        }
+    });
+    run_window(summary);
+
+    output.flush();
+    errors.flush();
+
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+template <typename Value>
+void ParallelRunner<Value>::compile(Line& line) const
+{
+    if (line.compiled)
+    {
+        return;
+    }
+    line.compiled = true;
+    STATS_COUNT(lines);
+    thread_local std::vector<Lexer::Token> tokens;
+    {
+        STATS_TIME(tokenize);
+        if (auto error = Lexer::tokenize(line.text, tokens))
+        {
+            line.error = std::move(error->message);
+            return;
+        }
+    }
+    STATS_TIME(compile);
+    auto program = Compiler<Value>::try_compile(line.text, tokens, line.text.get_allocator().resource(),
+                                                &calculator.function_table());
+    if (program.has_value())
+    {
+        line.program = std::move(program.value());
+    }
+    else
+    {
+        line.error = program.error().message;
+    }
+}
+
+template <typename Value>
+bool ParallelRunner<Value>::drives_formulas(Line const& line) const
+{
+    return line.program.has_value() && line.program->assigned_symbol.has_value() &&
+        calculator.drives_formulas(line.program->assigned_symbol.value());
+}
+
+template <typename Value>
+void ParallelRunner<Value>::run_window(BatchRunner::Summary& summary)
+{
+    compile_window();
+    link_window();
+
+    waiting = std::vector<std::atomic<std::size_t>>(window.size());
+    for (auto const& line : window)
+    {
+        for (std::size_t dependent : line.dependents)
+        {
+            waiting[dependent].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    // Find every ready line before submitting any: once evaluation starts,
+    // workers bring other lines to zero and schedule those themselves.
+    std::vector<std::size_t> ready;
+    for (std::size_t i = 0; i < window.size(); i++)
+    {
+        if (window[i].program.has_value() && waiting[i].load(std::memory_order_relaxed) == 0)
+        {
+            ready.push_back(i);
+        }
+    }
+    for (std::size_t i : ready)
+    {
+        pool.submit([this, i]() {
+            evaluate(i);
+        });
+    }
+    pool.wait();
+
+    commit_window();
+    print_window(summary);
+    window.clear();
+}
+
+template <typename Value>
+void ParallelRunner<Value>::compile_window()
+{
+    // Compiling doesn't depend on any state, so every line can go at once.
+    for (std::size_t begin = 0; begin < window.size(); begin += chunk_size)
+    {
+        std::size_t end = std::min(begin + chunk_size, window.size());
+        pool.submit([this, begin, end]() {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                compile(window[i]);
+            }
+        });
+    }
+    pool.wait();
+}
+
+template <typename Value>
+void ParallelRunner<Value>::link_window()
+{
+    auto depend = [this](std::size_t writer, std::size_t reader) {
+        auto& dependents = window[writer].dependents;
+        if (dependents.empty() || dependents.back() != reader)
+        {
+            dependents.push_back(reader);
+        }
+    };
+
+    for (std::size_t i = 0; i < window.size(); i++)
+    {
+        Line& line = window[i];
+        if (!line.program.has_value())
+        {
+            continue;
+        }
+
+        for (auto symbol : line.program->symbols)
+        {
+            std::size_t writer = symbol < last_writer.size() ? last_writer[symbol] : none;
+            line.sources.push_back(writer);
+            if (writer != none)
+            {
+                depend(writer, i);
+            }
+        }
+
+        if (line.program->assigned_symbol.has_value())
+        {
+            auto symbol = line.program->assigned_symbol.value();
+            if (symbol >= last_writer.size())
+            {
+                last_writer.resize(std::size_t(symbol) + 1, none);
+            }
+            // Writers of one symbol run in order, so when a reader finds its
+            // writer failed every earlier writer is already done.
+            if (last_writer[symbol] != none)
+            {
+                line.previous_writer = last_writer[symbol];
+                depend(last_writer[symbol], i);
+            }
+            last_writer[symbol] = i;
+        }
+    }
+
+    for (auto const& line : window)
+    {
+        if (line.program.has_value() && line.program->assigned_symbol.has_value())
+        {
+            last_writer[line.program->assigned_symbol.value()] = none;
+        }
+    }
+}
+
+template <typename Value>
+void ParallelRunner<Value>::evaluate(std::size_t index)
+{
+    Line& line = window[index];
+    BasicProgram<Value> const& program = line.program.value();
+
+    // Kept by each worker, so lines don't allocate them.
+    thread_local std::vector<calc_type> frame;
+    thread_local std::vector<calc_type> stack;
+    try
+    {
+        frame.clear();
+        {
+            STATS_TIME(lookup);
+            for (std::size_t slot = 0; slot < program.symbols.size(); slot++)
+            {
+                // A failed assignment leaves the symbol as the writer before
+                // it left it.
+                std::size_t source = line.sources[slot];
+                while (source != none && !window[source].value.has_value())
+                {
+                    source = window[source].previous_writer;
+                }
+
+                std::optional<calc_type> value = source != none
+                    ? window[source].value
+                    : calculator.lookup(program.symbols[slot]);
+                if (!value.has_value())
+                {
+                    line.error = calculator.undefined(program.symbols[slot]).what();
+                    break;
+                }
+                frame.push_back(value.value());
+            }
+        }
+
+        if (line.error.empty())
+        {
+            STATS_TIME(evaluate);
+            stack.resize(std::max(stack.size(), program.scratch_size()));
+            line.value = VirtualMachine::run(program, frame.data(), stack.data());
+        }
+    }
+    catch (Calculator::calculator_error const& ce)
+    {
+        line.error = ce.what();
+    }
+
+    for (std::size_t dependent : line.dependents)
+    {
+        if (waiting[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            pool.submit([this, dependent]() {
+                evaluate(dependent);
+            });
+        }
+    }
+}
+
+template <typename Value>
+void ParallelRunner<Value>::commit_window()
+{
+    for (auto const& line : window)
+    {
+        if (line.program.has_value() && line.program->assigned_symbol.has_value() && line.value.has_value())
+        {
+            calculator.assign(line.program->assigned_symbol.value(), line.value.value());
+        }
+    }
+}
+
+template <typename Value>
+void ParallelRunner<Value>::print_window(BatchRunner::Summary& summary)
+{
+    for (auto const& line : window)
+    {
+        if (!line.error.empty())
+        {
+            BatchRunner::report(errors, line.number, line.error);
+        }
+        else if (line.value.has_value() && !line.program->assigned_symbol.has_value())
+        {
+            summary.results++;
+            Numeric<Value>::write(output, line.value.value());
+            output.append('\n');
+        }
+    }
+}
+
+#define INSTANTIATE(Value) template class ParallelRunner<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
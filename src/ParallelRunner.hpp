@@ -0,0 +1,101 @@
+#ifndef GUARD_PARALLEL_RUNNER_HPP
+#define GUARD_PARALLEL_RUNNER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "BatchRunner.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "OutputBuffer.hpp"
+#include "ThreadPool.hpp"
+
+// Batch evaluation spread over a ThreadPool. The script is taken a window of
+// lines at a time: every line is compiled, each one waits only for the
+// earlier lines that assign symbols it reads (or assigns), and results are
+// printed in input order once the window is done. Commands, formula
+// definitions and assignments that formulas depend on end the current window
+// and run by themselves.
+template <typename Value>
+class ParallelRunner
+{
+public:
+    using calc_type = Value;
+
+private:
+    static constexpr std::size_t window_size = 1 << 16;
+    // Lines compiled by one task, which share the memory they allocate.
+    static constexpr std::size_t chunk_size = 256;
+    static constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+
+    struct Line
+    {
+        // In the script, from 1, for errors.
+        std::size_t number = 0;
+        std::pmr::string text;
+        // Set once the line is compiled, to its program or its error.
+        bool compiled = false;
+        std::optional<BasicProgram<Value>> program;
+        std::string error;
+
+        // Result, or the assigned value for assignments.
+        std::optional<calc_type> value;
+
+        // For every slot of the program, the line in the window that last
+        // assigned that symbol, or `none` to read it from the calculator.
+        std::pmr::vector<std::size_t> sources;
+
+        // Previous line in the window assigning the same symbol.
+        std::size_t previous_writer = none;
+
+        std::pmr::vector<std::size_t> dependents;
+
+        explicit Line(std::pmr::memory_resource* memory)
+            : text(memory)
+            , sources(memory)
+            , dependents(memory)
+        {
+        }
+    };
+
+private:
+    BasicCalculator<Value>& calculator;
+    ThreadPool pool;
+    OutputBuffer output;
+    OutputBuffer errors;
+
+    // One pool per chunk of the window, used by one thread at a time. Lines
+    // give their memory back when the window is done, and the lines of the
+    // next window take it again.
+    std::vector<std::unique_ptr<std::pmr::unsynchronized_pool_resource>> memory;
+    std::vector<Line> window;
+    std::vector<std::atomic<std::size_t>> waiting;
+    // Indexed by atom, for link_window; `none` between windows.
+    std::vector<std::size_t> last_writer;
+
+public:
+    ParallelRunner(BasicCalculator<Value>& calculator, std::size_t jobs, int output_fd, int error_fd);
+
+    BatchRunner::Summary run(std::string const& path);
+
+private:
+    // Compiles a line of the window, unless it is compiled already.
+    void compile(Line& line) const;
+    // Whether the compiled `line` assigns a symbol involved in a formula.
+    bool drives_formulas(Line const& line) const;
+
+    void run_window(BatchRunner::Summary& summary);
+    void compile_window();
+    void link_window();
+    void evaluate(std::size_t index);
+    void commit_window();
+    void print_window(BatchRunner::Summary& summary);
+};
+
+#endif
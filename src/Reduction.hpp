@@ -0,0 +1,37 @@
+#ifndef GUARD_REDUCTION_HPP
+#define GUARD_REDUCTION_HPP
+
+#include <cstddef>
+#include <optional>
+
+#include "Bytecode.hpp"
+
+// A reduction such as "sum(i, 1, n, i * i % m)": the values of its body for
+// every integer index from the first bound to the last, combined by its
+// kind. The body is compiled once; its symbols are those of the program
+// running the reduction, whose frame it reads, followed by the index.
+//
+// When the body is a polynomial in the index, the VirtualMachine computes
+// the reduction from a few values of the body instead of all of them:
+// the Newton form of a sum, the first value raised to the count for a
+// constant product, the values at the bounds for the minimum or maximum of
+// a line (a constant, for types that wrap around). Other bodies run in
+// chunks spread over a ThreadPool.
+template <typename Value>
+struct BasicReduction
+{
+    // Degrees of the largest polynomials computed in closed form.
+    static constexpr std::size_t max_degree = 16;
+
+    Program::Reduction kind;
+    BasicProgram<Value> body;
+
+    // The degree of the body as a polynomial in the index, when the
+    // reduction is computed in closed form. Only integral types get one,
+    // and only where it gives exactly the value of the loop: sums and
+    // products wrap around like the loop does, the ends of a line that
+    // wraps don't bound it.
+    std::optional<std::size_t> degree;
+};
+
+#endif
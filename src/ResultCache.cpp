@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "Lexer.hpp"
+#include "Numeric.hpp"
+#include "ResultCache.hpp"
+
+template <typename Value>
+ResultCache<Value>::ResultCache(std::pmr::memory_resource* memory, std::size_t capacity)
+    : memory(memory), capacity(std::max<std::size_t>(capacity, 1)), index(memory), key(memory)
+{
+    entries.reserve(capacity);
+}
+
+template <typename Value>
+typename ResultCache<Value>::Entry* ResultCache<Value>::find(std::vector<Lexer::Token> const& tokens)
+{
+    key.clear();
+    for (auto const& token : tokens)
+    {
+        key += token.text;
+        key += ' ';
+    }
+
+    auto found = index.find(key);
+    if (found == index.end())
+    {
+        return nullptr;
+    }
+    Entry& entry = entries[found->second];
+    entry.referenced = true;
+    return &entry;
+}
+
+template <typename Value>
+typename ResultCache<Value>::Entry& ResultCache<Value>::insert(BasicProgram<Value> const& program)
+{
+    std::size_t slot = entries.size();
+    if (slot < capacity)
+    {
+        entries.emplace_back(memory);
+    }
+    else
+    {
+        while (entries[hand].referenced)
+        {
+            entries[hand].referenced = false;
+            hand = (hand + 1) % capacity;
+        }
+        slot = hand;
+        hand = (hand + 1) % capacity;
+        index.erase(entries[slot].key);
+        stats.evictions++;
+    }
+
+    Entry& entry = entries[slot];
+    entry.key = key;
+    entry.program = program;
+    entry.result.reset();
+    entry.versions.clear();
+    entry.referenced = true;
+    index.emplace(key, slot);
+    return entry;
+}
+
+template <typename Value>
+std::size_t ResultCache<Value>::size() const
+{
+    return entries.size();
+}
+
+template <typename Value>
+std::size_t ResultCache<Value>::max_size() const
+{
+    return capacity;
+}
+
+template <typename Value>
+void ResultCache<Value>::clear()
+{
+    entries.clear();
+    index.clear();
+    hand = 0;
+    stats = Stats();
+}
+
+#define INSTANTIATE(Value) template class ResultCache<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
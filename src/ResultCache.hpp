@@ -0,0 +1,86 @@
+#ifndef GUARD_RESULT_CACHE_HPP
+#define GUARD_RESULT_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "Lexer.hpp"
+
+// Lines seen recently, keyed by their tokens, so spacing doesn't matter.
+// Each entry keeps the compiled program and, once evaluated, the result
+// along with the version of every symbol it read: while those versions
+// don't change the result can be reused without evaluating, and when they
+// do at least compiling is skipped.
+//
+// Holds at most `capacity` lines and evicts with the CLOCK algorithm: a
+// hand sweeps over the entries, sparing (once) those used since it last
+// passed.
+//
+// Entries and the index are allocated from the memory resource given at
+// construction, and a new line reuses the storage of the entry it evicts.
+template <typename Value>
+class ResultCache
+{
+public:
+    using value_type = Value;
+
+    struct Entry
+    {
+        std::pmr::string key;
+        BasicProgram<Value> program;
+        std::optional<value_type> result;
+        std::pmr::vector<std::uint64_t> versions;
+        bool referenced = false;
+
+        explicit Entry(std::pmr::memory_resource* memory)
+            : key(memory)
+            , program(memory)
+            , versions(memory)
+        {
+        }
+    };
+
+    struct Stats
+    {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+    };
+
+    static constexpr std::size_t default_capacity = 1024;
+
+private:
+    std::pmr::memory_resource* memory;
+    std::size_t capacity;
+    std::vector<Entry> entries;
+    std::pmr::unordered_map<std::pmr::string, std::size_t> index;
+    std::size_t hand = 0;
+
+    // Key of the last find(), reused to look up without allocating.
+    std::pmr::string key;
+
+public:
+    Stats stats;
+
+public:
+    explicit ResultCache(std::pmr::memory_resource* memory = std::pmr::get_default_resource(),
+                         std::size_t capacity = default_capacity);
+
+    // The entry for the line made of `tokens`, or nullptr.
+    Entry* find(std::vector<Lexer::Token> const& tokens);
+    // Adds the line last passed to find() with a copy of its program.
+    Entry& insert(BasicProgram<Value> const& program);
+
+    std::size_t size() const;
+    std::size_t max_size() const;
+    void clear();
+};
+
+#endif
@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Calculator.hpp"
+#include "Numeric.hpp"
+#include "Server.hpp"
+#include "ThreadPool.hpp"
+
+namespace
+{
+
+[[noreturn]] void fail(char const* what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+bool is_port(std::string const& address)
+{
+    return !address.empty() && address.size() <= 5 &&
+        address.find_first_not_of("0123456789") == std::string::npos && std::stoul(address) <= 65535;
+}
+
+}
+
+Server::Server(std::string const& address, std::size_t jobs, session_factory make_session)
+    : make_session(std::move(make_session)), pool(jobs)
+{
+    if (is_port(address))
+    {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            fail("socket");
+        }
+        int on = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+        sockaddr_in name{};
+        name.sin_family = AF_INET;
+        name.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        name.sin_port = htons(std::uint16_t(std::stoul(address)));
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&name), sizeof name) < 0)
+        {
+            fail(address.c_str());
+        }
+    }
+    else
+    {
+        sockaddr_un name{};
+        if (address.size() >= sizeof name.sun_path)
+        {
+            throw std::system_error(std::make_error_code(std::errc::filename_too_long), address);
+        }
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            fail("socket");
+        }
+
+        name.sun_family = AF_UNIX;
+        std::memcpy(name.sun_path, address.c_str(), address.size() + 1);
+        ::unlink(address.c_str());
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&name), sizeof name) < 0)
+        {
+            fail(address.c_str());
+        }
+        socket_path = address;
+    }
+
+    if (::listen(listen_fd, SOMAXCONN) < 0)
+    {
+        fail("listen");
+    }
+
+    epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0)
+    {
+        fail("epoll");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = listener_id;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0)
+    {
+        fail("epoll_ctl");
+    }
+    event.data.u64 = wake_id;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0)
+    {
+        fail("epoll_ctl");
+    }
+}
+
+Server::~Server()
+{
+    pool.wait();
+    for (auto const& session : sessions)
+    {
+        ::close(session.second->fd);
+    }
+    ::close(listen_fd);
+    ::close(epoll_fd);
+    ::close(wake_fd);
+    if (!socket_path.empty())
+    {
+        ::unlink(socket_path.c_str());
+    }
+}
+
+std::string Server::address() const
+{
+    if (!socket_path.empty())
+    {
+        return socket_path;
+    }
+    sockaddr_in name{};
+    socklen_t size = sizeof name;
+    ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&name), &size);
+    return std::to_string(ntohs(name.sin_port));
+}
+
+void Server::run()
+{
+    std::vector<epoll_event> events(256);
+    while (true)
+    {
+        int count = ::epoll_wait(epoll_fd, events.data(), int(events.size()), -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fail("epoll_wait");
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            std::uint64_t id = events[std::size_t(i)].data.u64;
+            std::uint32_t flags = events[std::size_t(i)].events;
+            if (id == listener_id)
+            {
+                accept_all();
+                continue;
+            }
+
+            std::vector<std::uint64_t> changed;
+            if (id == wake_id)
+            {
+                std::uint64_t count;
+                while (::read(wake_fd, &count, sizeof count) > 0)
+                {
+                }
+                std::lock_guard<std::mutex> lock(ready_mutex);
+                changed.swap(ready);
+            }
+            else
+            {
+                auto found = sessions.find(id);
+                if (found == sessions.end())
+                {
+                    continue;
+                }
+                if (flags & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                {
+                    receive(id, *found->second);
+                }
+                changed.push_back(id);
+            }
+
+            for (std::uint64_t changed_id : changed)
+            {
+                auto found = sessions.find(changed_id);
+                if (found != sessions.end())
+                {
+                    send(*found->second);
+                    update(changed_id, *found->second);
+                }
+            }
+        }
+    }
+}
+
+template <typename Value>
+void Server::respond(BasicCalculator<Value>& calculator, std::string const& line, std::string& answers)
+{
+    if (line.find_first_not_of(" \t") == std::string::npos)
+    {
+        answers += ".\n";
+        return;
+    }
+
+    auto text = calculator.evaluate(line);
+    if (!text.has_value())
+    {
+        answers += "! ";
+        answers += text.error().message;
+        answers += '\n';
+        return;
+    }
+    if (!text.value().has_value())
+    {
+        answers += ".\n";
+        return;
+    }
+
+    std::string_view rest = text.value().value();
+    std::size_t end;
+    while ((end = rest.find('\n')) != std::string_view::npos)
+    {
+        answers += "- ";
+        answers += rest.substr(0, end);
+        answers += '\n';
+        rest.remove_prefix(end + 1);
+    }
+    answers += "= ";
+    answers += rest;
+    answers += '\n';
+}
+
+void Server::accept_all()
+{
+    while (true)
+    {
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            // Running out of descriptors, or a connection reset before it
+            // was accepted, only costs that connection.
+            return;
+        }
+
+        auto session = std::make_shared<Session>();
+        session->fd = fd;
+        session->respond = make_session();
+        std::uint64_t id = next_id++;
+        sessions.emplace(id, session);
+        update(id, *session);
+    }
+}
+
+void Server::receive(std::uint64_t id, Session& session)
+{
+    char buffer[64 * 1024];
+    std::string lines;
+    std::size_t pending;
+    {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        pending = session.lines.size();
+    }
+    // Stops at max_pending; update() then leaves the connection unread
+    // until the worker takes the lines.
+    while (!session.read_closed && pending + lines.size() < max_pending)
+    {
+        ssize_t size = ::read(session.fd, buffer, sizeof buffer);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (size <= 0)
+        {
+            // A half closed connection still gets the answers to what it
+            // sent.
+            session.read_closed = true;
+            break;
+        }
+
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < std::size_t(size); i++)
+        {
+            if (buffer[i] == '\n')
+            {
+                session.input.append(buffer + start, i - start);
+                if (!session.input.empty() && session.input.back() == '\r')
+                {
+                    session.input.pop_back();
+                }
+                lines += session.input;
+                lines += '\n';
+                session.input.clear();
+                start = i + 1;
+            }
+        }
+        session.input.append(buffer + start, std::size_t(size) - start);
+        if (session.input.size() > max_line)
+        {
+            close(id);
+            return;
+        }
+    }
+    if (lines.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(session.mutex);
+    session.lines += lines;
+    if (!session.busy)
+    {
+        session.busy = true;
+        pool.submit([this, id, session = sessions.at(id)]() {
+            evaluate(id, session);
+        });
+    }
+}
+
+void Server::send(Session& session)
+{
+    std::lock_guard<std::mutex> lock(session.mutex);
+    std::size_t sent = 0;
+    while (sent < session.output.size())
+    {
+        ssize_t size = ::send(session.fd, session.output.data() + sent, session.output.size() - sent, MSG_NOSIGNAL);
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            // Nobody is left to read the answers.
+            session.read_closed = true;
+            session.output.clear();
+            return;
+        }
+        if (size <= 0)
+        {
+            break;
+        }
+        sent += std::size_t(size);
+    }
+    session.output.erase(0, sent);
+}
+
+void Server::update(std::uint64_t id, Session& session)
+{
+    std::uint32_t events = 0;
+    bool done;
+    {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        done = session.read_closed && !session.busy && session.lines.empty() && session.output.empty();
+        if (!session.read_closed && session.output.size() < max_backlog && session.lines.size() < max_pending)
+        {
+            events |= EPOLLIN;
+        }
+        if (!session.output.empty())
+        {
+            events |= EPOLLOUT;
+        }
+    }
+    if (done)
+    {
+        close(id);
+        return;
+    }
+    if (events == session.events)
+    {
+        return;
+    }
+
+    // With nothing to wait for, the descriptor leaves the set: a closed
+    // connection would otherwise report EPOLLHUP over and over while its
+    // last lines are evaluated.
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    int operation = session.events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (::epoll_ctl(epoll_fd, operation, session.fd, &event) < 0)
+    {
+        // A session the loop can't watch would never be served again.
+        close(id);
+        return;
+    }
+    session.events = events;
+}
+
+void Server::close(std::uint64_t id)
+{
+    auto found = sessions.find(id);
+    // Deregisters the descriptor too. A worker still evaluating its lines
+    // keeps the session alive, and finds nobody to wake.
+    ::close(found->second->fd);
+    sessions.erase(found);
+}
+
+void Server::evaluate(std::uint64_t id, std::shared_ptr<Session> session)
+{
+    std::string lines;
+    std::string line;
+    std::string answers;
+    while (true)
+    {
+        bool was_full;
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            session->output += answers;
+            lines.clear();
+            lines.swap(session->lines);
+            was_full = lines.size() >= max_pending;
+            if (lines.empty())
+            {
+                session->busy = false;
+                break;
+            }
+        }
+        // The loop reads a connection it stopped reading once woken.
+        if (!answers.empty() || was_full)
+        {
+            wake(id);
+        }
+
+        answers.clear();
+        std::string_view rest = lines;
+        std::size_t end;
+        while ((end = rest.find('\n')) != std::string_view::npos)
+        {
+            line.assign(rest.substr(0, end));
+            session->respond(line, answers);
+            rest.remove_prefix(end + 1);
+        }
+    }
+    wake(id);
+}
+
+void Server::wake(std::uint64_t id)
+{
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex);
+        ready.push_back(id);
+    }
+    // Can only fail when the counter would overflow, and then the loop has
+    // plenty of wake ups pending anyway.
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = ::write(wake_fd, &one, sizeof one);
+}
+
+#define INSTANTIATE(Value) template void Server::respond(BasicCalculator<Value>&, std::string const&, std::string&);
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
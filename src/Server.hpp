@@ -0,0 +1,127 @@
+#ifndef GUARD_SERVER_HPP
+#define GUARD_SERVER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Calculator.hpp"
+#include "ThreadPool.hpp"
+
+// Serves calculator sessions over a Unix domain socket, or a TCP port on
+// the loopback interface. Every connection is a session with a calculator
+// of its own. Any client may connect, so the calculators should be
+// confined to their session (see BasicCalculator::confine).
+//
+// One thread runs an epoll loop doing all the socket I/O, without ever
+// blocking; lines are evaluated on a ThreadPool, by at most one worker per
+// session at a time, so a session sees its lines in order. Clients may
+// pipeline: send many lines at once and read the answers later.
+//
+// Every line gets one answer, in the order the lines came:
+//   "= TEXT"   the value of an expression, or the output of a command;
+//              output of several lines has all but the last sent as
+//              "- TEXT"
+//   "."        nothing to show, such as for an assignment
+//   "! TEXT"   an error
+class Server
+{
+public:
+    // A longer line closes its connection.
+    static constexpr std::size_t max_line = 1 << 20;
+    // Once this much output is waiting for a client, its connection isn't
+    // read until some of it is sent.
+    static constexpr std::size_t max_backlog = 1 << 20;
+    // Likewise once this many bytes of lines are waiting to be evaluated,
+    // so a client can't queue work faster than its worker does it.
+    static constexpr std::size_t max_pending = 1 << 20;
+
+    // Evaluates one line for a session, adding its answer to `answers`.
+    using responder = std::function<void(std::string const& line, std::string& answers)>;
+    // Makes the responder of a new session, which holds its calculator.
+    using session_factory = std::function<responder()>;
+
+private:
+    // epoll data of what isn't a session.
+    static constexpr std::uint64_t listener_id = 0;
+    static constexpr std::uint64_t wake_id = 1;
+
+    struct Session
+    {
+        int fd;
+        responder respond;
+
+        // Used by the event loop only.
+        std::string input;
+        bool read_closed = false;
+        std::uint32_t events = 0;
+
+        // Shared with the worker evaluating the session's lines.
+        std::mutex mutex;
+        // Lines waiting to be evaluated, each ending in '\n'. Kept in one
+        // buffer, which the worker swaps with one of its own, so lines
+        // don't allocate.
+        std::string lines;
+        std::string output;
+        bool busy = false;
+    };
+
+private:
+    session_factory make_session;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::string socket_path;
+
+    std::unordered_map<std::uint64_t, std::shared_ptr<Session>> sessions;
+    std::uint64_t next_id = wake_id + 1;
+
+    // Sessions with new output, or whose worker finished.
+    std::mutex ready_mutex;
+    std::vector<std::uint64_t> ready;
+
+    // Last, so workers stop before the rest goes away.
+    ThreadPool pool;
+
+public:
+    // `address` is a port number, for TCP on 127.0.0.1 (0 picks a free
+    // one), or else the path of a Unix domain socket, replacing any socket
+    // already there.
+    Server(std::string const& address, std::size_t jobs, session_factory make_session);
+    Server(Server const&) = delete;
+    ~Server();
+
+    Server& operator=(Server const&) = delete;
+
+    // Where clients can connect, as given to the constructor, with the
+    // port chosen when it was 0.
+    std::string address() const;
+
+    // Serves until the process ends.
+    [[noreturn]] void run();
+
+    // Answer of `responder` for `line` in the protocol above, given by what
+    // BasicCalculator::evaluate returns for it.
+    template <typename Value>
+    static void respond(BasicCalculator<Value>& calculator, std::string const& line, std::string& answers);
+
+private:
+    void accept_all();
+    void receive(std::uint64_t id, Session& session);
+    void send(Session& session);
+    // Registers for the events the session now needs, or closes it when
+    // it is done, or can't be registered.
+    void update(std::uint64_t id, Session& session);
+    void close(std::uint64_t id);
+
+    // Runs on a worker: evaluates the session's lines until there are none.
+    void evaluate(std::uint64_t id, std::shared_ptr<Session> session);
+    void wake(std::uint64_t id);
+};
+
+#endif
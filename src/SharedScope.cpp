@@ -0,0 +1,36 @@
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "Numeric.hpp"
+#include "SharedScope.hpp"
+#include "SymbolTable.hpp"
+
+template <typename Value>
+typename SharedScope<Value>::snapshot SharedScope<Value>::read(std::uint64_t& snapshot_generation)
+{
+    // The generation first: the snapshot loaded after it is at least as
+    // new, and a reader given a newer one only refreshes once more.
+    snapshot_generation = generation.load(std::memory_order_acquire);
+    return std::atomic_load_explicit(&current, std::memory_order_acquire);
+}
+
+template <typename Value>
+void SharedScope<Value>::update(std::function<void(SymbolTable<Value>&)> const& change)
+{
+    std::lock_guard<std::mutex> writing(writer);
+    snapshot latest = std::atomic_load_explicit(&current, std::memory_order_acquire);
+
+    auto next = std::make_shared<SymbolTable<Value>>(*latest);
+    change(*next);
+
+    std::atomic_store_explicit(&current, snapshot(std::move(next)), std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release);
+    // The old snapshot goes with `latest`, unless readers still hold it.
+}
+
+#define INSTANTIATE(Value) template class SharedScope<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
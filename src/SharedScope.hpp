@@ -0,0 +1,60 @@
+#ifndef GUARD_SHARED_SCOPE_HPP
+#define GUARD_SHARED_SCOPE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "SymbolTable.hpp"
+
+// Symbols shared by many calculators, on any threads, such as constants
+// loaded once for a whole server. Calculators read them under their own
+// symbols, without copying them.
+//
+// Values are published RCU style: the scope holds an immutable snapshot,
+// and a writer copies it, changes the copy and swaps it in with an atomic
+// store. A reader keeps the snapshot it took for as long as it likes, and
+// only needs a new one when the generation changed, which it learns from a
+// single atomic load; it then takes the new one with an atomic load of the
+// pointer. Readers never take a lock of the scope, nor wait for a writer,
+// which copies and changes the table before its store. An old snapshot
+// goes away with its last reader.
+//
+// Publishing copies every value, so it suits values that rarely change; a
+// writer with many changes makes them in one update.
+template <typename Value>
+class SharedScope
+{
+public:
+    using snapshot = std::shared_ptr<SymbolTable<Value> const>;
+
+private:
+    // Readers load it all the time and writers store it rarely, so it gets
+    // a cache line nothing else writes to.
+    alignas(64) std::atomic<std::uint64_t> generation{0};
+
+    // Only read and written through std::atomic_load and atomic_store.
+    alignas(64) snapshot current = std::make_shared<SymbolTable<Value> const>();
+
+    // Held for a whole update, so writers don't lose each other's changes.
+    std::mutex writer;
+
+public:
+    // Changes with every publish. Starts at 0, with nothing in the scope.
+    std::uint64_t get_generation() const
+    {
+        return generation.load(std::memory_order_acquire);
+    }
+
+    // The latest snapshot, with its generation.
+    snapshot read(std::uint64_t& snapshot_generation);
+
+    // Publishes what `change` makes of a copy of the latest snapshot.
+    // Symbols keep their version numbers unless changed, and changed ones
+    // get numbers the scope never used before.
+    void update(std::function<void(SymbolTable<Value>&)> const& change);
+};
+
+#endif
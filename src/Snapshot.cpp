@@ -0,0 +1,632 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "Diagnostic.hpp"
+#include "Files.hpp"
+#include "FormulaGraph.hpp"
+#include "Numeric.hpp"
+#include "OutputBuffer.hpp"
+#include "Snapshot.hpp"
+#include "SymbolTable.hpp"
+
+namespace
+{
+
+// Counts larger than this can't be in a file that fits in memory, and
+// refusing them keeps the layout arithmetic from overflowing.
+constexpr std::uint64_t max_count = std::uint64_t(1) << 40;
+
+std::uint64_t align(std::uint64_t offset)
+{
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+// Start of each section, and the size of the file, for the counts in a
+// header.
+struct Layout
+{
+    std::uint64_t symbols;
+    std::uint64_t index;
+    std::uint64_t formulas;
+    std::uint64_t strings;
+    std::uint64_t data;
+    std::uint64_t end;
+};
+
+template <typename Header, typename Symbol, typename Formula>
+Layout layout(Header const& header)
+{
+    Layout sections;
+    sections.symbols = align(sizeof(Header));
+    sections.index = align(sections.symbols + header.symbol_count * sizeof(Symbol));
+    sections.formulas = align(sections.index + header.index_size * sizeof(std::uint32_t));
+    sections.strings = align(sections.formulas + header.formula_count * sizeof(Formula));
+    sections.data = align(sections.strings + header.strings_size);
+    sections.end = sections.data + header.data_size;
+    return sections;
+}
+
+[[noreturn]] void fail(std::string const& path)
+{
+    throw Calculator::calculator_error(Diagnostic::Code::file, path + ": " + std::strerror(errno));
+}
+
+}
+
+template <typename Value>
+Snapshot<Value>::Snapshot(std::string path)
+    : path(std::move(path))
+{
+    int fd = ::open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fail(this->path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) < 0)
+    {
+        ::close(fd);
+        fail(this->path);
+    }
+    if (std::size_t(info.st_size) < sizeof(Header))
+    {
+        ::close(fd);
+        throw Calculator::calculator_error(Diagnostic::Code::file, this->path + " is not a snapshot.");
+    }
+
+    mapping_size = std::size_t(info.st_size);
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        fail(this->path);
+    }
+
+    char const* base = static_cast<char const*>(mapping);
+    header = reinterpret_cast<Header const*>(base);
+    try
+    {
+        check();
+    }
+    catch (...)
+    {
+        ::munmap(mapping, mapping_size);
+        throw;
+    }
+
+    Layout sections = layout<Header, Symbol, Formula>(*header);
+    symbols = reinterpret_cast<Symbol const*>(base + sections.symbols);
+    index = reinterpret_cast<std::uint32_t const*>(base + sections.index);
+    formulas = reinterpret_cast<Formula const*>(base + sections.formulas);
+    strings = base + sections.strings;
+    data = base + sections.data;
+}
+
+template <typename Value>
+Snapshot<Value>::~Snapshot()
+{
+    ::munmap(mapping, mapping_size);
+}
+
+template <typename Value>
+void Snapshot<Value>::save(std::string const& path, SymbolTable<Value> const& values, FormulaGraph<Value>& graph)
+{
+    std::vector<Symbol> symbol_records;
+    std::vector<Formula> formula_records;
+    std::string strings;
+    std::string data;
+
+    auto add_text = [&strings](std::string_view text) {
+        Span span{strings.size(), text.size()};
+        strings.append(text);
+        return span;
+    };
+    auto add_spans = [&data](std::vector<Span> const& spans) {
+        Span span{data.size(), spans.size() * sizeof(Span)};
+        data.append(reinterpret_cast<char const*>(spans.data()), span.size);
+        return span;
+    };
+
+    values.for_each([&](AtomTable::atom symbol, Value const& value) {
+        // Formulas are saved as code, and computed again when restored.
+        if (graph.find(symbol) != nullptr)
+        {
+            return;
+        }
+        Symbol record;
+        record.name = add_text(AtomTable::name(symbol));
+        record.value.offset = data.size();
+        Numeric<Value>::to_bytes(data, value);
+        record.value.size = data.size() - record.value.offset;
+        symbol_records.push_back(record);
+    });
+
+    for (AtomTable::atom target : graph.all())
+    {
+        BasicProgram<Value> const& program = *graph.find(target);
+        // Functions aren't part of a snapshot, so neither are their calls,
+        // nor the bodies of reductions.
+        if (!program.functions.empty() || !program.reductions.empty())
+        {
+            throw Calculator::calculator_error(Diagnostic::Code::invalid_argument,
+                                               AtomTable::name(target) + " calls functions or reductions, which "
+                                                                         "can't be saved.");
+        }
+        Formula record;
+        record.target = add_text(AtomTable::name(target));
+
+        std::vector<Span> spans;
+        for (AtomTable::atom symbol : program.symbols)
+        {
+            spans.push_back(add_text(AtomTable::name(symbol)));
+        }
+        record.symbols = add_spans(spans);
+
+        spans.clear();
+        for (Value const& constant : program.constants)
+        {
+            Span span{data.size(), 0};
+            Numeric<Value>::to_bytes(data, constant);
+            span.size = data.size() - span.offset;
+            spans.push_back(span);
+        }
+        record.constants = add_spans(spans);
+
+        // Field by field, so the padding of an Instruction is written as
+        // zeros rather than whatever was in memory.
+        record.code = Span{data.size(), program.code.size() * sizeof(Program::Instruction)};
+        for (Program::Instruction const& instruction : program.code)
+        {
+            Program::Instruction copy;
+            std::memset(&copy, 0, sizeof(copy));
+            copy.op = instruction.op;
+            copy.slot = instruction.slot;
+            copy.immediate = instruction.immediate;
+            data.append(reinterpret_cast<char const*>(&copy), sizeof(copy));
+        }
+
+        record.max_stack = program.max_stack;
+        record.temporaries = program.temporaries;
+        formula_records.push_back(record);
+    }
+
+    // At most half full, so probes stay short.
+    std::uint64_t index_size = 1;
+    while (index_size < 2 * symbol_records.size())
+    {
+        index_size *= 2;
+    }
+    std::vector<std::uint32_t> index(index_size, 0);
+    for (std::size_t i = 0; i < symbol_records.size(); i++)
+    {
+        Span name = symbol_records[i].name;
+        std::uint64_t slot = hash(std::string_view(strings).substr(name.offset, name.size)) & (index_size - 1);
+        while (index[slot] != 0)
+        {
+            slot = (slot + 1) & (index_size - 1);
+        }
+        index[slot] = std::uint32_t(i + 1);
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = format_version;
+    header.byte_order = byte_order;
+    std::strncpy(header.type, Numeric<Value>::name, sizeof(header.type) - 1);
+    header.symbol_count = symbol_records.size();
+    header.index_size = index_size;
+    header.formula_count = formula_records.size();
+    header.strings_size = strings.size();
+    header.data_size = data.size();
+    Layout sections = layout<Header, Symbol, Formula>(header);
+
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fail(temporary);
+    }
+    try
+    {
+        OutputBuffer output(fd);
+        std::uint64_t written = 0;
+        auto put = [&output, &written](void const* bytes, std::size_t size) {
+            output.append(std::string_view(static_cast<char const*>(bytes), size));
+            written += size;
+        };
+        auto pad = [&output, &written](std::uint64_t offset) {
+            output.append(std::string(offset - written, '\0'));
+            written = offset;
+        };
+
+        put(&header, sizeof(header));
+        pad(sections.symbols);
+        put(symbol_records.data(), symbol_records.size() * sizeof(Symbol));
+        pad(sections.index);
+        put(index.data(), index.size() * sizeof(std::uint32_t));
+        pad(sections.formulas);
+        put(formula_records.data(), formula_records.size() * sizeof(Formula));
+        pad(sections.strings);
+        put(strings.data(), strings.size());
+        pad(sections.data);
+        put(data.data(), data.size());
+        output.flush();
+    }
+    catch (std::system_error const& e)
+    {
+        ::close(fd);
+        ::unlink(temporary.c_str());
+        throw Calculator::calculator_error(Diagnostic::Code::file, temporary + ": " + e.code().message());
+    }
+
+    if (::fsync(fd) < 0 || ::close(fd) < 0)
+    {
+        int error = errno;
+        ::unlink(temporary.c_str());
+        errno = error;
+        fail(temporary);
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) < 0)
+    {
+        int error = errno;
+        ::unlink(temporary.c_str());
+        errno = error;
+        fail(path);
+    }
+
+    // A journal truncated after a save relies on the rename too.
+    if (int error = files::sync_directory(path))
+    {
+        errno = error;
+        fail(path);
+    }
+}
+
+template <typename Value>
+std::size_t Snapshot<Value>::size() const
+{
+    return std::size_t(header->symbol_count);
+}
+
+template <typename Value>
+std::string_view Snapshot<Value>::name(std::size_t symbol) const
+{
+    return text(symbols[symbol].name);
+}
+
+template <typename Value>
+Value Snapshot<Value>::value(std::size_t symbol) const
+{
+    auto value = Numeric<Value>::from_bytes(bytes(symbols[symbol].value));
+    if (!value.has_value())
+    {
+        damaged();
+    }
+    return value.value();
+}
+
+template <typename Value>
+std::optional<std::size_t> Snapshot<Value>::find(std::string_view name) const
+{
+    std::uint64_t mask = header->index_size - 1;
+    std::uint64_t slot = hash(name) & mask;
+    for (std::uint64_t probes = 0; probes < header->index_size; probes++)
+    {
+        std::uint32_t entry = index[slot];
+        if (entry == 0)
+        {
+            break;
+        }
+        if (this->name(entry - 1) == name)
+        {
+            return entry - 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return std::nullopt;
+}
+
+template <typename Value>
+std::size_t Snapshot<Value>::formula_count() const
+{
+    return std::size_t(header->formula_count);
+}
+
+template <typename Value>
+std::pair<AtomTable::atom, BasicProgram<Value>> Snapshot<Value>::formula(std::size_t number) const
+{
+    Formula const& record = formulas[number];
+    AtomTable::atom target = AtomTable::intern(text(record.target));
+
+    BasicProgram<Value> program;
+    program.assigned_symbol = target;
+    program.formula = true;
+    program.max_stack = std::size_t(record.max_stack);
+    program.temporaries = std::size_t(record.temporaries);
+
+    // Lists in the data section aren't aligned, so they are copied out.
+    for (std::uint64_t i = 0; i < record.symbols.size / sizeof(Span); i++)
+    {
+        Span span;
+        std::memcpy(&span, data + record.symbols.offset + i * sizeof(Span), sizeof(span));
+        program.symbols.push_back(AtomTable::intern(text(span)));
+    }
+    for (std::uint64_t i = 0; i < record.constants.size / sizeof(Span); i++)
+    {
+        Span span;
+        std::memcpy(&span, data + record.constants.offset + i * sizeof(Span), sizeof(span));
+        auto constant = Numeric<Value>::from_bytes(bytes(span));
+        if (!constant.has_value())
+        {
+            damaged();
+        }
+        program.constants.push_back(std::move(constant.value()));
+    }
+    program.code.resize(std::size_t(record.code.size / sizeof(Program::Instruction)));
+    std::memcpy(program.code.data(), data + record.code.offset, std::size_t(record.code.size));
+
+    return {target, std::move(program)};
+}
+
+template <typename Value>
+std::uint64_t Snapshot<Value>::hash(std::string_view name)
+{
+    // FNV-1a.
+    std::uint64_t value = 14695981039346656037u;
+    for (char c : name)
+    {
+        value = (value ^ static_cast<unsigned char>(c)) * 1099511628211u;
+    }
+    return value;
+}
+
+template <typename Value>
+void Snapshot<Value>::damaged() const
+{
+    throw Calculator::calculator_error(Diagnostic::Code::file, path + " is damaged.");
+}
+
+template <typename Value>
+void Snapshot<Value>::check() const
+{
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != format_version ||
+        header->byte_order != byte_order)
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::file, path + " is not a snapshot.");
+    }
+    if (std::string_view(header->type, strnlen(header->type, sizeof(header->type))) != Numeric<Value>::name)
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::file,
+                                           path + " doesn't hold " + Numeric<Value>::name + " values.");
+    }
+
+    if (header->symbol_count > max_count || header->index_size > max_count || header->formula_count > max_count ||
+        header->strings_size > max_count || header->data_size > max_count ||
+        header->index_size == 0 || (header->index_size & (header->index_size - 1)) != 0 ||
+        header->index_size <= header->symbol_count)
+    {
+        damaged();
+    }
+    Layout sections = layout<Header, Symbol, Formula>(*header);
+    if (sections.end != mapping_size)
+    {
+        damaged();
+    }
+
+    // Everything else is checked through the section pointers.
+    char const* base = static_cast<char const*>(mapping);
+    auto symbol_records = reinterpret_cast<Symbol const*>(base + sections.symbols);
+    auto index_slots = reinterpret_cast<std::uint32_t const*>(base + sections.index);
+    auto formula_records = reinterpret_cast<Formula const*>(base + sections.formulas);
+    auto within = [](Span span, std::uint64_t size) {
+        return span.offset <= size && span.size <= size - span.offset;
+    };
+    auto list = [&within, this, base, &sections](Span span) {
+        if (!within(span, header->data_size) || span.size % sizeof(Span) != 0)
+        {
+            damaged();
+        }
+        std::vector<Span> spans(std::size_t(span.size / sizeof(Span)));
+        // An empty list has no storage to copy into, not even a pointer.
+        if (!spans.empty())
+        {
+            std::memcpy(spans.data(), base + sections.data + span.offset, std::size_t(span.size));
+        }
+        return spans;
+    };
+
+    for (std::uint64_t i = 0; i < header->symbol_count; i++)
+    {
+        if (!within(symbol_records[i].name, header->strings_size) || !within(symbol_records[i].value, header->data_size))
+        {
+            damaged();
+        }
+    }
+    for (std::uint64_t i = 0; i < header->index_size; i++)
+    {
+        if (index_slots[i] > header->symbol_count)
+        {
+            damaged();
+        }
+    }
+
+    for (std::uint64_t i = 0; i < header->formula_count; i++)
+    {
+        Formula const& record = formula_records[i];
+        std::vector<Span> names = list(record.symbols);
+        std::vector<Span> constants = list(record.constants);
+        if (!within(record.target, header->strings_size) ||
+            !within(record.code, header->data_size) || record.code.size % sizeof(Program::Instruction) != 0)
+        {
+            damaged();
+        }
+        for (Span name : names)
+        {
+            if (!within(name, header->strings_size))
+            {
+                damaged();
+            }
+        }
+        for (Span constant : constants)
+        {
+            if (!within(constant, header->data_size))
+            {
+                damaged();
+            }
+        }
+
+        // The code must keep the stack within max_stack and use only slots
+        // that exist, as the virtual machine doesn't check.
+        std::uint64_t count = record.code.size / sizeof(Program::Instruction);
+        if (count == 0 || record.max_stack > count || record.temporaries > count)
+        {
+            damaged();
+        }
+        // Jumps only go forward, and every way into an instruction must
+        // agree on the depth of the stack there.
+        constexpr std::uint64_t unreached = std::uint64_t(-1);
+        std::vector<std::uint64_t> arriving(count + 1, unreached);
+        auto arrive = [this, &arriving](std::uint64_t at, std::uint64_t stack) {
+            if (arriving[at] != unreached && arriving[at] != stack)
+            {
+                damaged();
+            }
+            arriving[at] = stack;
+        };
+        std::uint64_t depth = 0;
+        bool falls_through = true;
+        for (std::uint64_t j = 0; j < count; j++)
+        {
+            if (falls_through)
+            {
+                arrive(j, depth);
+            }
+            if (arriving[j] == unreached)
+            {
+                damaged();
+            }
+            depth = arriving[j];
+            falls_through = true;
+
+            Program::Instruction instruction;
+            std::memcpy(&instruction, base + sections.data + record.code.offset + j * sizeof(instruction),
+                        sizeof(instruction));
+            std::uint64_t needs = 0;
+            std::uint64_t limit = std::uint64_t(-1);
+            switch (instruction.op)
+            {
+            case Program::Opcode::push_literal:
+                break;
+            case Program::Opcode::push_constant:
+                limit = constants.size();
+                break;
+            case Program::Opcode::load_symbol:
+                limit = names.size();
+                break;
+            case Program::Opcode::load_temp:
+                limit = record.temporaries;
+                break;
+            case Program::Opcode::save_temp:
+                limit = record.temporaries;
+                needs = 1;
+                break;
+            case Program::Opcode::negate:
+            case Program::Opcode::bit_not:
+            case Program::Opcode::identity:
+                needs = 1;
+                break;
+            case Program::Opcode::power:
+            case Program::Opcode::multiply:
+            case Program::Opcode::divide:
+            case Program::Opcode::modulo:
+            case Program::Opcode::add:
+            case Program::Opcode::subtract:
+                needs = 2;
+                break;
+            case Program::Opcode::jump:
+            case Program::Opcode::jump_if_zero:
+                if (instruction.immediate <= std::int64_t(j) || std::uint64_t(instruction.immediate) > count)
+                {
+                    damaged();
+                }
+                break;
+            default:
+                damaged();
+            }
+            if (instruction.op == Program::Opcode::jump)
+            {
+                arrive(std::uint64_t(instruction.immediate), depth);
+                falls_through = false;
+                continue;
+            }
+            if (instruction.op == Program::Opcode::jump_if_zero)
+            {
+                if (depth == 0)
+                {
+                    damaged();
+                }
+                arrive(std::uint64_t(instruction.immediate), --depth);
+                continue;
+            }
+            if (depth < needs || (limit != std::uint64_t(-1) && instruction.slot >= limit))
+            {
+                damaged();
+            }
+            if (needs == 0)
+            {
+                depth++;
+            }
+            else if (needs == 2)
+            {
+                depth--;
+            }
+            if (depth > record.max_stack)
+            {
+                damaged();
+            }
+        }
+        if (falls_through)
+        {
+            arrive(count, depth);
+        }
+        if (arriving[count] != 1)
+        {
+            damaged();
+        }
+    }
+}
+
+template <typename Value>
+std::string_view Snapshot<Value>::text(Span span) const
+{
+    return std::string_view(strings + span.offset, std::size_t(span.size));
+}
+
+template <typename Value>
+std::string_view Snapshot<Value>::bytes(Span span) const
+{
+    return std::string_view(data + span.offset, std::size_t(span.size));
+}
+
+#define INSTANTIATE(Value) template class Snapshot<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
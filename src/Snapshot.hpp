@@ -0,0 +1,127 @@
+#ifndef GUARD_SNAPSHOT_HPP
+#define GUARD_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "AtomTable.hpp"
+#include "Bytecode.hpp"
+#include "FormulaGraph.hpp"
+#include "SymbolTable.hpp"
+
+// A calculator's symbols and formulas saved as one binary file, made to be
+// mapped into memory and read where it lies: restoring copies values out
+// of it, without lexing, parsing or evaluating anything. Formulas are
+// saved compiled.
+//
+// The file is a header followed by sections, each 8 byte aligned, holding
+// integers in the byte order of the machine that wrote it:
+//
+//   symbols    Symbol records: the name and value of each symbol
+//   index      hash table of the names, so one symbol is found without
+//              reading the others: symbol + 1 per slot, 0 when empty,
+//              probed linearly from the name's hash
+//   formulas   Formula records
+//   strings    the names, back to back
+//   data       values in Numeric<Value>::to_bytes form, and the lists of
+//              the formulas
+//
+// Opening a file checks that everything in it points inside it and that
+// formula code can be run, so a damaged file is refused rather than read.
+template <typename Value>
+class Snapshot
+{
+private:
+    static constexpr char magic[8] = {'C', 'A', 'L', 'C', 'S', 'N', 'A', 'P'};
+    static constexpr std::uint32_t format_version = 1;
+    static constexpr std::uint32_t byte_order = 0x01020304;
+
+    // Bytes of the strings or data section.
+    struct Span
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        // Numeric<Value>::name.
+        char type[16];
+        std::uint64_t symbol_count;
+        std::uint64_t index_size;
+        std::uint64_t formula_count;
+        std::uint64_t strings_size;
+        std::uint64_t data_size;
+    };
+
+    struct Symbol
+    {
+        Span name;
+        Span value;
+    };
+
+    struct Formula
+    {
+        Span target;
+        // Spans of the names of the symbols read, of the constants, and the
+        // Program::Instructions.
+        Span symbols;
+        Span constants;
+        Span code;
+        std::uint64_t max_stack;
+        std::uint64_t temporaries;
+    };
+
+private:
+    std::string path;
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    Header const* header = nullptr;
+    Symbol const* symbols = nullptr;
+    std::uint32_t const* index = nullptr;
+    Formula const* formulas = nullptr;
+    char const* strings = nullptr;
+    char const* data = nullptr;
+
+public:
+    // Maps the file at `path`. Throws calculator_error if it can't be read,
+    // isn't a snapshot of `Value`s, or is damaged.
+    explicit Snapshot(std::string path);
+    Snapshot(Snapshot const&) = delete;
+    ~Snapshot();
+
+    Snapshot& operator=(Snapshot const&) = delete;
+
+    // Writes `values`, except those of formulas, and `graph` to `path`.
+    // The file is written aside and renamed over `path` once complete, so
+    // it is either the old snapshot or the new one.
+    static void save(std::string const& path, SymbolTable<Value> const& values, FormulaGraph<Value>& graph);
+
+    std::size_t size() const;
+    std::string_view name(std::size_t symbol) const;
+    Value value(std::size_t symbol) const;
+    std::optional<std::size_t> find(std::string_view name) const;
+
+    std::size_t formula_count() const;
+    // The target and program of a formula.
+    std::pair<AtomTable::atom, BasicProgram<Value>> formula(std::size_t number) const;
+
+private:
+    static std::uint64_t hash(std::string_view name);
+
+    // Throws calculator_error saying the file is damaged.
+    [[noreturn]] void damaged() const;
+    void check() const;
+    std::string_view text(Span span) const;
+    std::string_view bytes(Span span) const;
+};
+
+#endif
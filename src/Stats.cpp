@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "Stats.hpp"
+
+namespace
+{
+
+// Counts of one thread, on its own cache line so threads don't slow each
+// other down. Only that thread writes them, so adding needs no atomic
+// read-modify-write, except in the last block, which every thread beyond
+// the first block_count - 1 shares.
+struct alignas(64) Block
+{
+    std::array<std::atomic<std::uint64_t>, Stats::counters> counts;
+    std::array<std::atomic<std::uint64_t>, Stats::phases> calls;
+    std::array<std::atomic<std::uint64_t>, Stats::phases> timed;
+    std::array<std::atomic<std::uint64_t>, Stats::phases> ticks;
+    bool shared;
+};
+
+constexpr std::size_t block_count = 64;
+
+std::array<Block, block_count> blocks;
+std::atomic<std::size_t> next_block{0};
+
+// Plain pointer, so it can be used from operator new before anything is set
+// up.
+thread_local Block* own_block = nullptr;
+
+Block& block()
+{
+    if (own_block == nullptr)
+    {
+        std::size_t index = next_block.fetch_add(1, std::memory_order_relaxed);
+        own_block = &blocks[std::min(index, block_count - 1)];
+        if (index >= block_count - 1)
+        {
+            own_block->shared = true;
+        }
+    }
+    return *own_block;
+}
+
+std::uint64_t bump(Block& block, std::atomic<std::uint64_t>& counter, std::uint64_t amount)
+{
+    if (block.shared)
+    {
+        return counter.fetch_add(amount, std::memory_order_relaxed) + amount;
+    }
+    std::uint64_t value = counter.load(std::memory_order_relaxed) + amount;
+    counter.store(value, std::memory_order_relaxed);
+    return value;
+}
+
+// Ticks are converted to time by comparing them with the clock over the
+// whole run.
+struct Origin
+{
+    std::uint64_t ticks = Stats::ticks();
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+};
+
+Origin const origin;
+
+double nanoseconds_per_tick()
+{
+    std::uint64_t ticks = Stats::ticks() - origin.ticks;
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - origin.time).count();
+    return ticks == 0 ? 1 : nanoseconds / double(ticks);
+}
+
+std::string format(char const* format, double value)
+{
+    char text[64];
+    std::snprintf(text, sizeof text, format, value);
+    return text;
+}
+
+}
+
+#ifndef CALCULATOR_NO_STATS
+void* operator new(std::size_t size)
+{
+    Block& own = block();
+    bump(own, own.counts[std::size_t(Stats::Counter::allocations)], 1);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+void Stats::add(Counter counter, std::uint64_t amount)
+{
+    Block& own = block();
+    bump(own, own.counts[std::size_t(counter)], amount);
+}
+
+bool Stats::begin(Phase phase)
+{
+    Block& own = block();
+    return bump(own, own.calls[std::size_t(phase)], 1) % sample_period == 1;
+}
+
+void Stats::add_time(Phase phase, std::uint64_t ticks)
+{
+    Block& own = block();
+    bump(own, own.timed[std::size_t(phase)], 1);
+    bump(own, own.ticks[std::size_t(phase)], ticks);
+}
+
+Stats::Totals Stats::totals()
+{
+    Totals totals;
+    std::array<std::uint64_t, phases> timed{};
+    std::array<std::uint64_t, phases> ticks{};
+    for (Block const& block : blocks)
+    {
+        for (std::size_t i = 0; i < counters; i++)
+        {
+            totals.counts[i] += block.counts[i].load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < phases; i++)
+        {
+            totals.calls[i] += block.calls[i].load(std::memory_order_relaxed);
+            timed[i] += block.timed[i].load(std::memory_order_relaxed);
+            ticks[i] += block.ticks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    double scale = nanoseconds_per_tick();
+    for (std::size_t i = 0; i < phases; i++)
+    {
+        if (timed[i] != 0)
+        {
+            totals.nanoseconds[i] = double(ticks[i]) * scale * double(totals.calls[i]) / double(timed[i]);
+        }
+    }
+    return totals;
+}
+
+void Stats::reset()
+{
+    for (Block& block : blocks)
+    {
+        for (auto& count : block.counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < phases; i++)
+        {
+            block.calls[i].store(0, std::memory_order_relaxed);
+            block.timed[i].store(0, std::memory_order_relaxed);
+            block.ticks[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+char const* Stats::name(Phase phase)
+{
+    static char const* const names[phases] = {"tokenize", "cache", "compile", "lookup", "evaluate", "formulas"};
+    return names[std::size_t(phase)];
+}
+
+char const* Stats::name(Counter counter)
+{
+    static char const* const names[counters] = {"lines", "allocations", "calculator_copies"};
+    return names[std::size_t(counter)];
+}
+
+std::string Stats::report()
+{
+    Totals totals = Stats::totals();
+    std::uint64_t lines = totals.counts[std::size_t(Counter::lines)];
+    std::uint64_t allocations = totals.counts[std::size_t(Counter::allocations)];
+
+    std::string text = "lines " + std::to_string(lines) +
+        ", allocations " + std::to_string(allocations) +
+        (lines == 0 ? "" : format(" (%.1f per line)", double(allocations) / double(lines))) +
+        ", calculator copies " + std::to_string(totals.counts[std::size_t(Counter::calculator_copies)]);
+    for (std::size_t i = 0; i < phases; i++)
+    {
+        std::uint64_t calls = totals.calls[i];
+        text += "\n" + std::string(name(Phase(i))) + ": " + std::to_string(calls) + " calls, " +
+            format("%.3f ms", totals.nanoseconds[i] / 1e6) +
+            (calls == 0 ? "" : format(", %.0f ns each", totals.nanoseconds[i] / double(calls)));
+    }
+    return text;
+}
+
+std::string Stats::to_json()
+{
+    Totals totals = Stats::totals();
+    std::string json = "{";
+    for (std::size_t i = 0; i < counters; i++)
+    {
+        json += "\"" + std::string(name(Counter(i))) + "\": " + std::to_string(totals.counts[i]) + ", ";
+    }
+    json += "\"phases\": {";
+    for (std::size_t i = 0; i < phases; i++)
+    {
+        json += std::string(i == 0 ? "" : ", ") + "\"" + name(Phase(i)) + "\": {\"calls\": " +
+            std::to_string(totals.calls[i]) + ", \"ns\": " + format("%.0f", totals.nanoseconds[i]) + "}";
+    }
+    return json + "}}\n";
+}
@@ -0,0 +1,138 @@
+#ifndef GUARD_STATS_HPP
+#define GUARD_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Process wide counters, and time spent in each phase of evaluating a line,
+// cheap enough to leave on in production: each thread adds to a block of
+// its own, so threads don't contend. Reading the clock can cost more than a
+// phase takes, so every call of a phase is counted but only one in
+// `sample_period` is timed, and totals are scaled from those. Allocations
+// are counted by replacing operator new.
+//
+// Building with CALCULATOR_NO_STATS defined compiles all of it out: the
+// macros below expand to nothing and operator new is left alone.
+class Stats
+{
+public:
+    enum class Phase : std::uint8_t
+    {
+        // Splitting a line into tokens.
+        tokenize,
+        // Finding the line in the ResultCache and checking its result.
+        cache,
+        // Parsing, optimizing and generating code on a cache miss.
+        compile,
+        // Reading the values of the symbols a program uses.
+        lookup,
+        // Running the program.
+        evaluate,
+        // Evaluating formulas again after an assignment.
+        formulas,
+        count
+    };
+
+    enum class Counter : std::uint8_t
+    {
+        lines,
+        allocations,
+        calculator_copies,
+        count
+    };
+
+    static constexpr std::size_t phases = std::size_t(Phase::count);
+    static constexpr std::size_t counters = std::size_t(Counter::count);
+    static constexpr std::uint64_t sample_period = 16;
+
+#ifdef CALCULATOR_NO_STATS
+    static constexpr bool enabled = false;
+#else
+    static constexpr bool enabled = true;
+#endif
+
+    struct Totals
+    {
+        std::array<std::uint64_t, counters> counts{};
+        std::array<std::uint64_t, phases> calls{};
+        std::array<double, phases> nanoseconds{};
+    };
+
+    // Adds the time from its construction to its destruction to a phase.
+    class Timer
+    {
+    private:
+        Phase phase;
+        bool timed;
+        std::uint64_t start = 0;
+
+    public:
+        explicit Timer(Phase phase)
+            : phase(phase)
+            , timed(begin(phase))
+        {
+            if (timed)
+            {
+                start = ticks();
+            }
+        }
+
+        Timer(Timer const&) = delete;
+
+        ~Timer()
+        {
+            if (timed)
+            {
+                add_time(phase, ticks() - start);
+            }
+        }
+
+        Timer& operator=(Timer const&) = delete;
+    };
+
+public:
+    static void add(Counter counter, std::uint64_t amount = 1);
+    // Counts a call of `phase`, and tells whether to time it.
+    static bool begin(Phase phase);
+    static void add_time(Phase phase, std::uint64_t ticks);
+
+    // Sums over every thread so far.
+    static Totals totals();
+    static void reset();
+
+    static char const* name(Phase phase);
+    static char const* name(Counter counter);
+
+    // For :stats, one line per phase.
+    static std::string report();
+    static std::string to_json();
+
+    // Time stamp counter, or nanoseconds where there is none.
+    static std::uint64_t ticks()
+    {
+#if defined(__x86_64__)
+        return __rdtsc();
+#else
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+};
+
+#ifdef CALCULATOR_NO_STATS
+#define STATS_TIME(phase)
+#define STATS_COUNT(counter)
+#else
+// Times the rest of the enclosing block as Stats::Phase::phase.
+#define STATS_TIME(phase) Stats::Timer const stats_timer(Stats::Phase::phase)
+#define STATS_COUNT(counter) Stats::add(Stats::Counter::counter)
+#endif
+
+#endif
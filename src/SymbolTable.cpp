@@ -0,0 +1,110 @@
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Numeric.hpp"
+#include "SymbolTable.hpp"
+
+template <typename Value>
+typename SymbolTable<Value>::Slot& SymbolTable<Value>::slot_for(atom id)
+{
+    std::size_t page = id >> page_bits;
+    if (page >= pages.size())
+    {
+        pages.resize(page + 1);
+    }
+    if (pages[page].empty())
+    {
+        pages[page].resize(page_size);
+    }
+    std::uint32_t& slot = pages[page][id & (page_size - 1)];
+    if (slot == 0)
+    {
+        slots.push_back({id, false, 0, value_type()});
+        slot = std::uint32_t(slots.size());
+    }
+    return slots[slot - 1];
+}
+
+template <typename Value>
+void SymbolTable<Value>::set(atom id, value_type const& value)
+{
+    Slot& slot = slot_for(id);
+    if (!checkpoints.empty())
+    {
+        undo_log.push_back({id, slot.defined, slot.value});
+    }
+    if (!slot.defined)
+    {
+        slot.defined = true;
+        count++;
+    }
+    slot.value = value;
+    slot.version = ++clock;
+}
+
+template <typename Value>
+void SymbolTable<Value>::erase(atom id)
+{
+    Slot const* found = slot_of(id);
+    if (found == nullptr || !found->defined)
+    {
+        return;
+    }
+
+    Slot& slot = slot_for(id);
+    if (!checkpoints.empty())
+    {
+        undo_log.push_back({id, true, slot.value});
+    }
+    slot.defined = false;
+    slot.version = ++clock;
+    count--;
+}
+
+template <typename Value>
+std::size_t SymbolTable<Value>::size() const
+{
+    return count;
+}
+
+template <typename Value>
+void SymbolTable<Value>::checkpoint()
+{
+    checkpoints.push_back(undo_log.size());
+}
+
+template <typename Value>
+bool SymbolTable<Value>::rollback()
+{
+    if (checkpoints.empty())
+    {
+        return false;
+    }
+
+    std::size_t mark = checkpoints.back();
+    checkpoints.pop_back();
+    while (undo_log.size() > mark)
+    {
+        Change& change = undo_log.back();
+        Slot& slot = slot_for(change.id);
+        if (slot.defined && !change.was_defined)
+        {
+            count--;
+        }
+        else if (!slot.defined && change.was_defined)
+        {
+            count++;
+        }
+        slot.defined = change.was_defined;
+        slot.value = std::move(change.old_value);
+        slot.version = ++clock;
+        undo_log.pop_back();
+    }
+    return true;
+}
+
+#define INSTANTIATE(Value) template class SymbolTable<Value>;
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
@@ -0,0 +1,115 @@
+#ifndef GUARD_SYMBOL_TABLE_HPP
+#define GUARD_SYMBOL_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AtomTable.hpp"
+
+// Values of a calculator's symbols in a compact array of slots, found
+// through a two level array from atom to slot, so reading a symbol is a
+// few indexed loads. Atoms are numbered across the process, so values
+// indexed by atom would cost every calculator as much as all the symbols of
+// every other, including the globals shared with it (see SharedScope). Here
+// a calculator only pays for its slots, and for a page of the index per
+// range of atoms it assigns in.
+//
+// Checkpoints are positions in an undo log of overwritten values. Taking one
+// is O(1) and rolling back costs as much as the assignments made since, no
+// matter how many symbols exist. Nothing is logged while there are no
+// checkpoints.
+//
+// Every change of a symbol, rollbacks included, gives it a new version
+// number, never reused by the table, so comparing versions tells whether a
+// symbol changed since it was read.
+template <typename Value>
+class SymbolTable
+{
+public:
+    using value_type = Value;
+    using atom = AtomTable::atom;
+
+private:
+    // Symbols keep their slot once erased, for their version.
+    struct Slot
+    {
+        atom id;
+        bool defined;
+        std::uint64_t version;
+        value_type value;
+    };
+
+    struct Change
+    {
+        atom id;
+        bool was_defined;
+        value_type old_value;
+    };
+
+private:
+    static constexpr std::size_t page_bits = 9;
+    static constexpr std::size_t page_size = std::size_t(1) << page_bits;
+
+private:
+    std::vector<Slot> slots;
+    // For each page of atoms, the slot of every atom plus one, or 0 if it
+    // has none. Pages without a slot are left empty.
+    std::vector<std::vector<std::uint32_t>> pages;
+    std::uint64_t clock = 0;
+    std::size_t count = 0;
+
+    std::vector<Change> undo_log;
+    std::vector<std::size_t> checkpoints;
+
+public:
+    value_type const* find(atom id) const
+    {
+        Slot const* slot = slot_of(id);
+        return slot != nullptr && slot->defined ? &slot->value : nullptr;
+    }
+
+    // Version of a symbol that was never assigned is 0.
+    std::uint64_t version(atom id) const
+    {
+        Slot const* slot = slot_of(id);
+        return slot != nullptr ? slot->version : 0;
+    }
+
+    void set(atom id, value_type const& value);
+    void erase(atom id);
+
+    std::size_t size() const;
+
+    void checkpoint();
+    bool rollback();
+
+    // In the order symbols were first assigned.
+    template <typename Function>
+    void for_each(Function const& function) const
+    {
+        for (Slot const& slot : slots)
+        {
+            if (slot.defined)
+            {
+                function(slot.id, slot.value);
+            }
+        }
+    }
+
+private:
+    Slot const* slot_of(atom id) const
+    {
+        std::size_t page = id >> page_bits;
+        if (page >= pages.size() || pages[page].empty())
+        {
+            return nullptr;
+        }
+        std::uint32_t slot = pages[page][id & (page_size - 1)];
+        return slot != 0 ? &slots[slot - 1] : nullptr;
+    }
+    // The slot of `id`, added if it has none.
+    Slot& slot_for(atom id);
+};
+
+#endif
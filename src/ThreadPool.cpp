@@ -0,0 +1,146 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+thread_local ThreadPool* ThreadPool::current_pool = nullptr;
+thread_local std::size_t ThreadPool::current_index = 0;
+
+ThreadPool::ThreadPool(std::size_t workers)
+{
+    if (workers == 0)
+    {
+        workers = 1;
+    }
+
+    for (std::size_t i = 0; i < workers; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < workers; i++)
+    {
+        threads.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+std::size_t ThreadPool::size() const
+{
+    return threads.size();
+}
+
+bool ThreadPool::on_worker()
+{
+    return current_pool != nullptr;
+}
+
+void ThreadPool::submit(task t)
+{
+    std::size_t index = current_pool == this
+        ? current_index
+        : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    unfinished.fetch_add(1);
+    queued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(t));
+    }
+
+    // Taking the lock orders this notification after a sleeping worker's
+    // last look at `queued`.
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    all_done.wait(lock, [this]() {
+        return unfinished.load() == 0;
+    });
+}
+
+void ThreadPool::work(std::size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true)
+    {
+        task t;
+        if (!take(index, t))
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            work_available.wait(lock, [this]() {
+                return stopping || queued.load() != 0;
+            });
+            if (stopping && queued.load() == 0)
+            {
+                return;
+            }
+            continue;
+        }
+
+        t();
+
+        if (unfinished.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            all_done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::take(std::size_t index, task& t)
+{
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            t = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    for (std::size_t offset = 1; offset < queues.size(); offset++)
+    {
+        Queue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            t = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
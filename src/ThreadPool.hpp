@@ -0,0 +1,71 @@
+#ifndef GUARD_THREAD_POOL_HPP
+#define GUARD_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task queue each. A worker runs the
+// newest task of its own queue first and, when it runs dry, steals the
+// oldest task of another worker's queue.
+class ThreadPool
+{
+public:
+    using task = std::function<void()>;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex state_mutex;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    bool stopping = false;
+
+    // Tasks sitting in a queue, and tasks submitted but not finished yet.
+    std::atomic<std::size_t> queued{0};
+    std::atomic<std::size_t> unfinished{0};
+    std::atomic<std::size_t> next_queue{0};
+
+    static thread_local ThreadPool* current_pool;
+    static thread_local std::size_t current_index;
+
+public:
+    explicit ThreadPool(std::size_t workers);
+    ThreadPool(ThreadPool const&) = delete;
+    ~ThreadPool();
+
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    std::size_t size() const;
+
+    // Whether the calling thread is a worker of any pool.
+    static bool on_worker();
+
+    // Called from one of the workers, the task goes to that worker's own
+    // queue; otherwise queues are filled round robin. Tasks must not throw.
+    void submit(task t);
+
+    // Blocks until every submitted task, including the ones submitted by
+    // other tasks, has finished.
+    void wait();
+
+private:
+    void work(std::size_t index);
+    bool take(std::size_t index, task& t);
+};
+
+#endif
@@ -0,0 +1,465 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "Calculator.hpp"
+#include "Diagnostic.hpp"
+#include "Function.hpp"
+#include "NativeCode.hpp"
+#include "Numeric.hpp"
+#include "Reduction.hpp"
+#include "ThreadPool.hpp"
+#include "VirtualMachine.hpp"
+
+namespace
+{
+
+// Set on a thread running chunks of a reduction, so reductions nested in
+// it don't spread chunks of their own for each index.
+thread_local bool reducing = false;
+
+// The workers helping the thread running a reduction, shared by all of
+// them. Threads of any pool run reductions alone, so calculators already
+// spread over a pool don't take more cores than it has.
+ThreadPool* reduction_pool()
+{
+    static std::unique_ptr<ThreadPool> pool = []() {
+        unsigned cores = std::thread::hardware_concurrency();
+        return cores > 1 ? std::make_unique<ThreadPool>(cores - 1) : nullptr;
+    }();
+    return pool.get();
+}
+
+template <typename Value>
+Value from_unsigned(uint128 value)
+{
+    // Counts reach 2^64, one bit past a word.
+    Value high = Numeric<Value>::from_word(Program::value_type(value >> 32));
+    Value low = Numeric<Value>::from_word(Program::value_type(value & 0xffffffff));
+    return Numeric<Value>::apply(Program::Opcode::add,
+                                 Numeric<Value>::apply(Program::Opcode::multiply, high,
+                                                       Numeric<Value>::from_word(Program::value_type(1) << 32)),
+                                 low);
+}
+
+// C(count, k). The factors of k! are divided out of the factors of the
+// numerator before any multiplication, so the product is right even where
+// the type wraps around.
+template <typename Value>
+Value binomial(uint128 count, std::size_t k)
+{
+    std::vector<uint128> factors;
+    for (std::size_t j = 0; j < k; j++)
+    {
+        factors.push_back(count - j);
+    }
+    for (std::uint64_t divisor = 2; divisor <= k; divisor++)
+    {
+        std::uint64_t left = divisor;
+        for (std::size_t j = 0; j < k && left != 1; j++)
+        {
+            std::uint64_t common = std::gcd(left, std::uint64_t(factors[j] % left));
+            if (common == 0)
+            {
+                common = left;
+            }
+            factors[j] /= common;
+            left /= common;
+        }
+    }
+    Value result = Numeric<Value>::from_word(1);
+    for (uint128 factor : factors)
+    {
+        result = Numeric<Value>::apply(Program::Opcode::multiply, result, from_unsigned<Value>(factor));
+    }
+    return result;
+}
+
+template <typename Value>
+Value combine(Program::Reduction reduction, Value const& a, Value const& b)
+{
+    switch (reduction)
+    {
+    case Program::Reduction::sum:
+        return Numeric<Value>::apply(Program::Opcode::add, a, b);
+    case Program::Reduction::product:
+        return Numeric<Value>::apply(Program::Opcode::multiply, a, b);
+    case Program::Reduction::minimum:
+        return b < a ? b : a;
+    case Program::Reduction::maximum:
+        return a < b ? b : a;
+    }
+    return a;
+}
+
+}
+
+template <typename Value>
+Value VirtualMachine::run(BasicProgram<Value> const& program, Value const* frame, Value* stack)
+{
+    // Lines never make tail calls, so the caller's frame stays untouched.
+    return execute(program, const_cast<Value*>(frame), stack, 0);
+}
+
+template <typename Value>
+Value VirtualMachine::execute(BasicProgram<Value> const& program, Value* frame, Value* stack, std::size_t depth)
+{
+    // Indexed by depth. Moving a vector keeps its storage, so frames in use
+    // stay put when deeper ones are added.
+    thread_local std::vector<std::vector<Value>> frames;
+
+    // `top` points one past the last value on the stack.
+    Value* top = stack;
+    Value* temps = stack + program.max_stack;
+
+    // Runs `body` with the `arity` values on top of the stack as arguments,
+    // replacing them with its result.
+    auto call = [&](BasicProgram<Value> const& body, std::size_t arity) {
+        if (depth + 1 >= max_depth)
+        {
+            throw Calculator::calculator_error(Diagnostic::Code::too_deep,
+                                               "Calls nested deeper than " + std::to_string(max_depth) + ".");
+        }
+        if (frames.size() <= depth)
+        {
+            frames.resize(depth + 1);
+        }
+        std::vector<Value>& callee = frames[depth];
+        if (callee.size() < arity + body.scratch_size())
+        {
+            callee.resize(arity + body.scratch_size());
+        }
+        top -= arity;
+        for (std::size_t i = 0; i < arity; i++)
+        {
+            callee[i] = std::move(top[i]);
+        }
+        *top = execute(body, callee.data(), callee.data() + arity, depth + 1);
+        top++;
+    };
+
+    Program::Instruction const* code = program.code.data();
+    std::size_t size = program.code.size();
+    for (std::size_t pc = 0; pc < size;)
+    {
+        auto const& instruction = code[pc++];
+        switch (instruction.op)
+        {
+        case Program::Opcode::push_literal:
+            *top++ = Numeric<Value>::decode(instruction.immediate);
+            break;
+        case Program::Opcode::push_constant:
+            *top++ = program.constants[instruction.slot];
+            break;
+        case Program::Opcode::load_symbol:
+            *top++ = frame[instruction.slot];
+            break;
+        case Program::Opcode::negate:
+        case Program::Opcode::bit_not:
+        case Program::Opcode::identity:
+            top[-1] = Numeric<Value>::apply(instruction.op, top[-1]);
+            break;
+        case Program::Opcode::power:
+        case Program::Opcode::multiply:
+        case Program::Opcode::divide:
+        case Program::Opcode::modulo:
+        case Program::Opcode::add:
+        case Program::Opcode::subtract:
+            top--;
+            top[-1] = Numeric<Value>::apply(instruction.op, top[-1], top[0]);
+            break;
+        case Program::Opcode::save_temp:
+            temps[instruction.slot] = top[-1];
+            break;
+        case Program::Opcode::load_temp:
+            *top++ = temps[instruction.slot];
+            break;
+        case Program::Opcode::jump:
+            pc = std::size_t(instruction.immediate);
+            break;
+        case Program::Opcode::jump_if_zero:
+            top--;
+            if (Numeric<Value>::is_zero(*top))
+            {
+                pc = std::size_t(instruction.immediate);
+            }
+            break;
+        case Program::Opcode::call:
+            call(program.functions[instruction.slot]->body, std::size_t(instruction.immediate));
+            break;
+        case Program::Opcode::recurse:
+            call(program, std::size_t(instruction.immediate));
+            break;
+        case Program::Opcode::reduce:
+            top--;
+            top[-1] = reduce(*program.reductions[instruction.slot], frame, top[-1], top[0], depth);
+            break;
+        case Program::Opcode::tail_recurse:
+        {
+            std::size_t arity = std::size_t(instruction.immediate);
+            top -= arity;
+            for (std::size_t i = 0; i < arity; i++)
+            {
+                frame[i] = std::move(top[i]);
+            }
+            top = stack;
+            pc = 0;
+            break;
+        }
+        }
+    }
+
+    return std::move(top[-1]);
+}
+
+template <typename Value>
+Value VirtualMachine::reduce(BasicReduction<Value> const& reduction, Value const* frame, Value const& first,
+                             Value const& last, std::size_t depth)
+{
+    using word = Program::value_type;
+    std::string name = Program::name(reduction.kind);
+    auto from = Numeric<Value>::to_word(first);
+    auto to = Numeric<Value>::to_word(last);
+    if (!from.has_value() || !to.has_value())
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::not_integer,
+                                           "The bounds of " + name + " are not integers.");
+    }
+    if (to.value() < from.value())
+    {
+        switch (reduction.kind)
+        {
+        case Program::Reduction::sum:
+            return Numeric<Value>::from_word(0);
+        case Program::Reduction::product:
+            return Numeric<Value>::from_word(1);
+        default:
+            throw Calculator::calculator_error(Diagnostic::Code::invalid_operation, name + " of no values.");
+        }
+    }
+    if (depth + 1 >= max_depth)
+    {
+        throw Calculator::calculator_error(Diagnostic::Code::too_deep,
+                                           "Calls nested deeper than " + std::to_string(max_depth) + ".");
+    }
+    // Indexes after the first, which may not fit a word.
+    std::uint64_t span = std::uint64_t(to.value()) - std::uint64_t(from.value());
+    auto index = [&from](std::uint64_t offset) {
+        return word(std::uint64_t(from.value()) + offset);
+    };
+
+    // The body runs one level deeper, like a call, in a frame of the
+    // enclosing one followed by the index.
+    BasicProgram<Value> const& body = reduction.body;
+    std::size_t captured = body.symbols.size() - 1;
+    std::optional<NativeCode> native;
+    if constexpr (std::is_same_v<Value, NativeCode::value_type>)
+    {
+        if (span >= reduction_chunk && NativeCode::supported())
+        {
+            native = NativeCode::compile(body);
+        }
+    }
+    struct Runner
+    {
+        BasicProgram<Value> const& body;
+        NativeCode const* native;
+        std::vector<Value> frame;
+        std::vector<Value> stack;
+        std::size_t depth;
+
+        Value at(word i)
+        {
+            frame.back() = Numeric<Value>::from_word(i);
+            if constexpr (std::is_same_v<Value, NativeCode::value_type>)
+            {
+                if (native != nullptr)
+                {
+                    return native->run(frame.data(), stack.data());
+                }
+            }
+            return execute(body, frame.data(), stack.data(), depth);
+        }
+    };
+    auto runner = [&]() {
+        Runner made{body, native.has_value() ? &native.value() : nullptr, std::vector<Value>(frame, frame + captured),
+                    std::vector<Value>(body.scratch_size()), depth + 1};
+        made.frame.emplace_back();
+        return made;
+    };
+    auto accumulate = [&reduction, &index](Runner& run, std::uint64_t begin, std::uint64_t end) {
+        Value result = run.at(index(begin));
+        for (std::uint64_t offset = begin; offset != end;)
+        {
+            offset++;
+            result = combine(reduction.kind, result, run.at(index(offset)));
+        }
+        return result;
+    };
+
+    if (reduction.degree.has_value() && span > reduction.degree.value())
+    {
+        Runner run = runner();
+        std::size_t degree = reduction.degree.value();
+        switch (reduction.kind)
+        {
+        case Program::Reduction::sum:
+        {
+            // Newton's form: the sum of p(from + k) for k < count is the sum
+            // of C(count, j + 1) times the j-th forward difference at from.
+            std::vector<Value> differences;
+            for (std::size_t k = 0; k <= degree; k++)
+            {
+                differences.push_back(run.at(index(k)));
+            }
+            for (std::size_t j = 1; j <= degree; j++)
+            {
+                for (std::size_t k = degree; k >= j; k--)
+                {
+                    differences[k] = Numeric<Value>::apply(Program::Opcode::subtract, differences[k],
+                                                           differences[k - 1]);
+                }
+            }
+            Value result = Numeric<Value>::from_word(0);
+            for (std::size_t j = 0; j <= degree; j++)
+            {
+                Value term = Numeric<Value>::apply(Program::Opcode::multiply, binomial<Value>(uint128(span) + 1, j + 1),
+                                                   differences[j]);
+                result = Numeric<Value>::apply(Program::Opcode::add, result, term);
+            }
+            return result;
+        }
+        case Program::Reduction::product:
+            return Numeric<Value>::apply(Program::Opcode::power, run.at(index(0)),
+                                         from_unsigned<Value>(uint128(span) + 1));
+        case Program::Reduction::minimum:
+        case Program::Reduction::maximum:
+            // A line is monotonic; the Compiler only allows one for types
+            // that don't wrap around.
+            return combine(reduction.kind, run.at(index(0)), run.at(index(span)));
+        }
+    }
+
+    std::uint64_t chunk = std::max(reduction_chunk, span / max_chunks + 1);
+    ThreadPool* pool = reducing || ThreadPool::on_worker() ? nullptr : reduction_pool();
+    if (span < chunk || pool == nullptr)
+    {
+        Runner run = runner();
+        return accumulate(run, 0, span);
+    }
+
+    std::uint64_t chunks = span / chunk + 1;
+    std::vector<std::optional<Value>> partials(chunks);
+    std::vector<std::exception_ptr> errors(chunks);
+    std::atomic<std::uint64_t> next{0};
+    // The first chunk that failed: the error of the loop is its error.
+    std::atomic<std::uint64_t> failed{chunks};
+    auto work = [&]() {
+        std::optional<Runner> run;
+        for (std::uint64_t c; (c = next.fetch_add(1)) < chunks;)
+        {
+            // Chunks are taken in order, and those after a failed one don't
+            // change the outcome.
+            if (c > failed.load())
+            {
+                break;
+            }
+            try
+            {
+                if (!run.has_value())
+                {
+                    run.emplace(runner());
+                }
+                partials[c] = accumulate(run.value(), c * chunk, std::min(c * chunk + chunk - 1, span));
+            }
+            catch (...)
+            {
+                errors[c] = std::current_exception();
+                std::uint64_t seen = failed.load();
+                while (c < seen && !failed.compare_exchange_weak(seen, c))
+                {
+                }
+            }
+        }
+    };
+
+    {
+        // The helpers read this frame, so it is only left once every helper
+        // submitted has finished, whichever way it is left.
+        struct Helpers
+        {
+            std::mutex mutex;
+            std::condition_variable done;
+            std::size_t running = 0;
+
+            ~Helpers()
+            {
+                reducing = false;
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [this]() {
+                    return running == 0;
+                });
+            }
+        } helpers;
+        reducing = true;
+        std::uint64_t workers = std::min<std::uint64_t>(pool->size(), chunks - 1);
+        for (std::uint64_t i = 0; i < workers; i++)
+        {
+            {
+                std::lock_guard<std::mutex> lock(helpers.mutex);
+                helpers.running++;
+            }
+            try
+            {
+                pool->submit([&work, &helpers]() {
+                    work();
+                    std::lock_guard<std::mutex> lock(helpers.mutex);
+                    if (--helpers.running == 0)
+                    {
+                        helpers.done.notify_all();
+                    }
+                });
+            }
+            catch (...)
+            {
+                // The helpers already running take the remaining chunks.
+                std::lock_guard<std::mutex> lock(helpers.mutex);
+                helpers.running--;
+                break;
+            }
+        }
+        work();
+    }
+
+    for (std::uint64_t c = 0; c < chunks; c++)
+    {
+        if (errors[c] != nullptr)
+        {
+            std::rethrow_exception(errors[c]);
+        }
+    }
+    Value result = std::move(partials[0].value());
+    for (std::uint64_t c = 1; c < chunks; c++)
+    {
+        result = combine(reduction.kind, result, partials[c].value());
+    }
+    return result;
+}
+
+#define INSTANTIATE(Value) \
+    template Value VirtualMachine::run(BasicProgram<Value> const&, Value const*, Value*);
+FOR_EACH_NUMERIC_TYPE(INSTANTIATE)
+#undef INSTANTIATE
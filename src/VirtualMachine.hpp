@@ -0,0 +1,58 @@
+#ifndef GUARD_VIRTUAL_MACHINE_HPP
+#define GUARD_VIRTUAL_MACHINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Bytecode.hpp"
+
+// Interpreter for BasicProgram. Values stay `Value`s from the moment a
+// literal is compiled until the result is handed back, and every operation
+// is Numeric<Value>'s, compiled into the loop of each instantiation.
+//
+// A call runs the body of the function in a frame of its own: the
+// arguments, which are the body's symbols, followed by its stack. Frames
+// are kept per thread and per depth, so calls don't allocate once they have
+// grown. A tail call of the running function reuses its frame instead.
+//
+// A reduction runs its body for each index with the frame it was given
+// and the index, unless it has a closed form (see Reduction.hpp). Long
+// ranges are split into chunks that the thread and the workers of a shared
+// ThreadPool take in turn, and the results of the chunks combined in order,
+// so they don't depend on the threads. On a worker of any pool, such as
+// those of ParallelRunner and Server, the chunks all run on that worker.
+// Long bodies are compiled to NativeCode for the loop when they can be.
+class VirtualMachine
+{
+public:
+    // Calls nested deeper than this fail with Diagnostic::Code::too_deep,
+    // rather than overflowing the native stack.
+    static constexpr std::size_t max_depth = 10000;
+
+    // Indexes of a reduction run on the thread evaluating it, unless there
+    // are more than this; those are split into at most max_chunks chunks
+    // of at least this many.
+    static constexpr std::uint64_t reduction_chunk = 1 << 16;
+    static constexpr std::uint64_t max_chunks = 4096;
+
+public:
+    // `frame` holds the value of every slot in program.symbols and `stack`
+    // must have room for program.scratch_size() values.
+    template <typename Value>
+    static Value run(BasicProgram<Value> const& program, Value const* frame, Value* stack);
+
+private:
+    // `depth` counts the calls running `program`. Only a tail call writes
+    // to `frame`, and only bodies of functions make them, whose frames are
+    // the machine's own.
+    template <typename Value>
+    static Value execute(BasicProgram<Value> const& program, Value* frame, Value* stack, std::size_t depth);
+
+    // The value of `reduction` from index `first` to `last`, in the frame
+    // of the program running it.
+    template <typename Value>
+    static Value reduce(BasicReduction<Value> const& reduction, Value const* frame, Value const& first,
+                        Value const& last, std::size_t depth);
+};
+
+#endif
@@ -1,23 +1,184 @@
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <readline/readline.h>
 #include <readline/history.h>
+#include <unistd.h>
 
+#include "BatchRunner.hpp"
 #include "Calculator.hpp"
+#include "Numeric.hpp"
+#include "ParallelRunner.hpp"
+#include "Server.hpp"
+#include "SharedScope.hpp"
+#include "Stats.hpp"
 
-int main()
+namespace
 {
-    Calculator calc;
 
+struct Options
+{
+    // Script to run instead of the interactive prompt, "-" for standard input.
+    std::string batch;
+
+    // Address to serve sessions on, see Server.
+    std::string serve;
+
+    // Worker threads for batch mode and the server. When not given, batch
+    // mode uses one and the server one per core.
+    std::size_t jobs = 0;
+
+    // Type of values, as named by Numeric<Value>::name.
+    std::string type = Numeric<BigInt>::name;
+
+    // Where to write Stats as JSON on exit, "-" for standard error.
+    std::string stats;
+
+    // Script whose symbols are shared by every calculator, such as the
+    // sessions of the server.
+    std::string globals;
+
+    // Snapshot to start from, see Snapshot. The server shares its values
+    // like those of `globals`.
+    std::string restore;
+
+    // Journal to recover the session from and log its changes to, see
+    // Journal. Not for the server, whose sessions end with their
+    // connections.
+    std::string journal;
+};
+
+template <typename Value>
+int run(Options const& options);
+
+// The one place the type of values is chosen at run time: everything after
+// it is compiled for that type.
+std::map<std::string, std::function<int(Options const&)>> const runners = {
+#define RUNNER(Value) {Numeric<Value>::name, run<Value>},
+    FOR_EACH_NUMERIC_TYPE(RUNNER)
+#undef RUNNER
+};
+
+void usage(char const* program)
+{
+    std::string types;
+    for (auto const& runner : runners)
+    {
+        types += (types.empty() ? "" : "|") + runner.first;
+    }
+    std::cerr << "usage: " << program << " [--type " << types << "] [--stats FILE|-] [--globals FILE] [--restore FILE] [--journal FILE] [--batch FILE|- | --serve PATH|PORT] [--jobs N]" << std::endl;
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (std::size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--batch" && i + 1 < args.size())
+        {
+            options.batch = args[++i];
+        }
+        else if (args[i] == "--serve" && i + 1 < args.size())
+        {
+            options.serve = args[++i];
+        }
+        else if (args[i] == "--globals" && i + 1 < args.size())
+        {
+            options.globals = args[++i];
+        }
+        else if (args[i] == "--restore" && i + 1 < args.size())
+        {
+            options.restore = args[++i];
+        }
+        else if (args[i] == "--journal" && i + 1 < args.size())
+        {
+            options.journal = args[++i];
+        }
+        else if (args[i] == "--type" && i + 1 < args.size())
+        {
+            options.type = args[++i];
+            if (runners.count(options.type) == 0)
+            {
+                return false;
+            }
+        }
+        else if (args[i] == "--stats" && i + 1 < args.size() && Stats::enabled)
+        {
+            options.stats = args[++i];
+        }
+        else if (args[i] == "--jobs" && i + 1 < args.size())
+        {
+            try
+            {
+                options.jobs = std::stoul(args[++i]);
+            }
+            catch (std::exception const&)
+            {
+                return false;
+            }
+            if (options.jobs == 0)
+            {
+                options.jobs = std::max(1u, std::thread::hardware_concurrency());
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.serve.empty() || (options.batch.empty() && options.journal.empty());
+}
+
+template <typename Value>
+int run_batch(BasicCalculator<Value>& calc, Options const& options)
+{
+    BatchRunner::Summary summary;
+    if (options.jobs > 1)
+    {
+        ParallelRunner<Value> runner(calc, options.jobs, STDOUT_FILENO, STDERR_FILENO);
+        summary = runner.run(options.batch);
+    }
+    else
+    {
+        BatchRunner runner(STDOUT_FILENO, STDERR_FILENO);
+        summary = runner.run(calc, options.batch);
+    }
+
+    // Lines are logged a commit window at a time, and all of them are on
+    // disk once the script is done.
+    calc.commit();
+    std::fprintf(stderr, "%zu lines, %zu results in %.3f s (%.0f lines/s)\n",
+                 summary.lines, summary.results, summary.seconds,
+                 summary.seconds > 0 ? double(summary.lines) / summary.seconds : 0.0);
+    return 0;
+}
+
+template <typename Value>
+int run_interactive(BasicCalculator<Value>& calc)
+{
     char const* command;
     rl_bind_key('\t', rl_insert);
     while ((command = readline(">>> ")) != nullptr)
     {
         auto temp = calc.execute(command);
+        try
+        {
+            calc.commit();
+        }
+        catch (Calculator::calculator_error const& error)
+        {
+            std::cerr << error.what() << std::endl;
+        }
         if (temp.has_value())
         {
             std::cout << temp.value() << std::endl;
@@ -28,4 +189,118 @@ int main()
         }
         std::free((void*) command);
     }
+    return 0;
+}
+
+template <typename Value>
+std::shared_ptr<SharedScope<Value>> load_globals(Options const& options)
+{
+    auto globals = std::make_shared<SharedScope<Value>>();
+    // Sessions of the server start from the snapshot through the shared
+    // scope; formulas can't be shared, so only values are.
+    bool restoring = !options.restore.empty() && !options.serve.empty();
+    if (options.globals.empty() && !restoring)
+    {
+        return globals;
+    }
+
+    BasicCalculator<Value> loader(globals);
+    if (restoring)
+    {
+        loader.restore(options.restore);
+    }
+    if (!options.globals.empty())
+    {
+        // Errors are reported as for a script, and values are not shown.
+        BatchRunner::for_each_line(options.globals, [&loader](std::string_view line) {
+            if (line.find_first_not_of(" \t") != std::string_view::npos)
+            {
+                loader.execute(std::string(line));
+            }
+        });
+    }
+    loader.evaluate(":publish");
+    return globals;
+}
+
+template <typename Value>
+int run_server(Options const& options, std::shared_ptr<SharedScope<Value>> const& globals)
+{
+    std::size_t jobs = options.jobs != 0 ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    Server server(options.serve, jobs, [globals] {
+        auto calc = std::make_shared<BasicCalculator<Value>>(globals);
+        // Clients could otherwise read and write any file the server can,
+        // and see what other sessions do.
+        calc->confine();
+        return [calc](std::string const& line, std::string& answers) {
+            Server::respond(*calc, line, answers);
+        };
+    });
+    std::cerr << "Serving on " << server.address() << " with " << jobs << " workers" << std::endl;
+    server.run();
+}
+
+template <typename Value>
+int run(Options const& options)
+{
+    auto globals = load_globals<Value>(options);
+    if (!options.serve.empty())
+    {
+        return run_server<Value>(options, globals);
+    }
+
+    BasicCalculator<Value> calc(globals);
+    if (!options.journal.empty())
+    {
+        calc.recover(options.journal, options.restore);
+    }
+    else if (!options.restore.empty())
+    {
+        calc.restore(options.restore);
+    }
+    if (!options.batch.empty())
+    {
+        return run_batch(calc, options);
+    }
+    return run_interactive(calc);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int status;
+    try
+    {
+        status = runners.at(options.type)(options);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+
+    if (!options.stats.empty())
+    {
+        std::ofstream file;
+        if (options.stats != "-")
+        {
+            file.open(options.stats);
+        }
+        std::ostream& out = options.stats == "-" ? std::cerr : file;
+        out << Stats::to_json();
+        if (!out)
+        {
+            std::cerr << options.stats << ": could not write statistics" << std::endl;
+            status = 1;
+        }
+    }
+    return status;
 }
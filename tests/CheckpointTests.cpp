@@ -0,0 +1,98 @@
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+#include "src/Calculator.hpp"
+
+// :checkpoint and :rollback, through BasicCalculator::evaluate, so the
+// result cache and formulas take part.
+
+namespace
+{
+
+void check_nested()
+{
+    BasicCalculator<long> calc;
+    evaluate(calc, "a = 1");
+    evaluate(calc, ":checkpoint");
+    evaluate(calc, "a = 2");
+    evaluate(calc, "b = 3");
+    evaluate(calc, ":checkpoint");
+    evaluate(calc, "a = 4");
+    Test::expect(evaluate(calc, "a + b") == "7", "a + b before rolling back");
+
+    evaluate(calc, ":rollback");
+    Test::expect(evaluate(calc, "a + b") == "5", "a + b after the inner rollback");
+
+    evaluate(calc, ":rollback");
+    Test::expect(evaluate(calc, "a") == "1", "a after the outer rollback");
+    Test::expect(error_of(calc, "b") == "b is not defined.", "b after the outer rollback");
+
+    Test::expect(error_of(calc, ":rollback") == "There is no checkpoint to roll back to.",
+                 "rolling back with no checkpoint");
+}
+
+void check_many_changes()
+{
+    BasicCalculator<long> calc;
+    evaluate(calc, "x = 0");
+    evaluate(calc, ":checkpoint");
+    for (int i = 1; i <= 1000; i++)
+    {
+        evaluate(calc, "x = x + " + std::to_string(i));
+        evaluate(calc, "y" + std::to_string(i % 10) + " = x");
+    }
+    Test::expect(evaluate(calc, "x") == "500500", "x before rolling back");
+
+    evaluate(calc, ":rollback");
+    Test::expect(evaluate(calc, "x") == "0", "x after rolling back");
+    for (int i = 0; i < 10; i++)
+    {
+        std::string y = "y" + std::to_string(i);
+        Test::expect(error_of(calc, y) == y + " is not defined.", y + " after rolling back");
+    }
+}
+
+void check_formulas()
+{
+    BasicCalculator<long> calc;
+    evaluate(calc, "a = 1");
+    evaluate(calc, "f := a * 10");
+    evaluate(calc, ":checkpoint");
+    evaluate(calc, "a = 5");
+    Test::expect(evaluate(calc, "f") == "50", "f before rolling back");
+
+    // Formulas stay, and follow the values rolled back.
+    evaluate(calc, ":rollback");
+    Test::expect(evaluate(calc, "f") == "10", "f after rolling back");
+    evaluate(calc, "a = 2");
+    Test::expect(evaluate(calc, "f") == "20", "f after assigning again");
+}
+
+void check_copies()
+{
+    BasicCalculator<long> calc;
+    evaluate(calc, "a = 1");
+    evaluate(calc, ":checkpoint");
+    evaluate(calc, "a = 2");
+
+    // A copy takes the checkpoints too, and rolls back on its own.
+    BasicCalculator<long> copy(calc);
+    evaluate(copy, ":rollback");
+    Test::expect(evaluate(copy, "a") == "1", "a in the copy");
+    Test::expect(evaluate(calc, "a") == "2", "a in the original");
+    evaluate(calc, ":rollback");
+    Test::expect(evaluate(calc, "a") == "1", "a in the original after its rollback");
+}
+
+}
+
+std::vector<Test> checkpoint_tests()
+{
+    return {
+        Test("checkpoint/nested", check_nested),
+        Test("checkpoint/many_changes", check_many_changes),
+        Test("checkpoint/formulas", check_formulas),
+        Test("checkpoint/copies", check_copies),
+    };
+}
@@ -0,0 +1,173 @@
+#include <climits>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+#include "src/Bytecode.hpp"
+#include "src/Calculator.hpp"
+#include "src/ColumnKernels.hpp"
+#include "src/Numeric.hpp"
+
+// Every kernel the CPU runs against Numeric<long>, element by element, on
+// columns of awkward lengths so the scalar tails of the vector loops run
+// too.
+
+namespace
+{
+
+using value_type = ColumnKernels::value_type;
+using Opcode = Program::Opcode;
+
+constexpr Opcode unary_ops[] = {Opcode::negate, Opcode::bit_not, Opcode::identity};
+constexpr Opcode binary_ops[] = {Opcode::power, Opcode::multiply, Opcode::divide,
+                                 Opcode::modulo, Opcode::add, Opcode::subtract};
+
+// Random values with the edges of long mixed in. Zero only when `zero`,
+// since dividing by it, or raising it to a negative power, throws.
+std::vector<value_type> column(std::mt19937_64& random, std::size_t n, bool zero)
+{
+    static constexpr value_type edges[] = {LONG_MIN, LONG_MIN + 1, LONG_MAX, -1, 1, 2, 0};
+
+    std::vector<value_type> values(n);
+    for (auto& value : values)
+    {
+        switch (random() % 4)
+        {
+        case 0:
+            value = edges[random() % 7];
+            break;
+        case 1:
+            value = value_type(random() % 64) - 32;
+            break;
+        default:
+            value = value_type(random());
+            break;
+        }
+        if (value == 0 && !zero)
+        {
+            value = 1;
+        }
+    }
+    return values;
+}
+
+char const* name(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::negate:
+        return "negate";
+    case Opcode::bit_not:
+        return "bit_not";
+    case Opcode::identity:
+        return "identity";
+    case Opcode::power:
+        return "power";
+    case Opcode::multiply:
+        return "multiply";
+    case Opcode::divide:
+        return "divide";
+    case Opcode::modulo:
+        return "modulo";
+    case Opcode::add:
+        return "add";
+    case Opcode::subtract:
+        return "subtract";
+    default:
+        return "?";
+    }
+}
+
+std::string where(ColumnKernels const& kernels, Opcode op, std::size_t n, std::size_t i)
+{
+    return std::string(kernels.name) + " " + name(op) + " of " + std::to_string(n) +
+        " values, at " + std::to_string(i);
+}
+
+void check_unary()
+{
+    std::mt19937_64 random(1);
+    for (auto const* kernels : ColumnKernels::supported())
+    {
+        for (std::size_t n = 0; n < 40; n++)
+        {
+            std::vector<value_type> a = column(random, n, true);
+            for (Opcode op : unary_ops)
+            {
+                std::vector<value_type> out(n);
+                kernels->apply(op, a.data(), out.data(), n);
+                // The output may alias the input.
+                std::vector<value_type> in_place = a;
+                kernels->apply(op, in_place.data(), in_place.data(), n);
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    value_type expected = Numeric<value_type>::apply(op, a[i]);
+                    Test::expect(out[i] == expected, where(*kernels, op, n, i));
+                    Test::expect(in_place[i] == expected, where(*kernels, op, n, i) + ", in place");
+                }
+            }
+        }
+    }
+}
+
+void check_binary()
+{
+    std::mt19937_64 random(2);
+    for (auto const* kernels : ColumnKernels::supported())
+    {
+        for (std::size_t n = 0; n < 40; n++)
+        {
+            std::vector<value_type> a = column(random, n, false);
+            std::vector<value_type> b = column(random, n, false);
+            for (Opcode op : binary_ops)
+            {
+                std::vector<value_type> out(n);
+                kernels->apply(op, a.data(), b.data(), out.data(), n);
+                std::vector<value_type> in_place = a;
+                kernels->apply(op, in_place.data(), b.data(), in_place.data(), n);
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    value_type expected = Numeric<value_type>::apply(op, a[i], b[i]);
+                    Test::expect(out[i] == expected, where(*kernels, op, n, i));
+                    Test::expect(in_place[i] == expected, where(*kernels, op, n, i) + ", in place");
+                }
+            }
+        }
+    }
+}
+
+void check_division_by_zero()
+{
+    std::vector<value_type> a = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    std::vector<value_type> b = {1, 1, 1, 1, 1, 1, 1, 0, 1};
+    for (auto const* kernels : ColumnKernels::supported())
+    {
+        for (Opcode op : {Opcode::divide, Opcode::modulo})
+        {
+            bool thrown = false;
+            std::vector<value_type> out(a.size());
+            try
+            {
+                kernels->apply(op, a.data(), b.data(), out.data(), a.size());
+            }
+            catch (Calculator::calculator_error const& ce)
+            {
+                thrown = ce.code() == Diagnostic::Code::division_by_zero;
+            }
+            Test::expect(thrown, std::string(kernels->name) + " " + name(op) + " by zero");
+        }
+    }
+}
+
+}
+
+std::vector<Test> column_kernels_tests()
+{
+    return {
+        Test("column_kernels/unary", check_unary),
+        Test("column_kernels/binary", check_binary),
+        Test("column_kernels/division_by_zero", check_division_by_zero),
+    };
+}
@@ -0,0 +1,170 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+#include "src/Calculator.hpp"
+#include "src/Journal.hpp"
+
+// Journals cut short, as a crash leaves them: reading keeps the intact
+// records, and opening cuts off the rest before appending.
+
+namespace
+{
+
+struct Entry
+{
+    Journal::Kind kind;
+    std::string name;
+    std::string data;
+
+    bool operator==(Entry const& other) const
+    {
+        return kind == other.kind && name == other.name && data == other.data;
+    }
+};
+
+std::vector<Entry> entries(std::string const& path)
+{
+    std::vector<Entry> read;
+    std::size_t count = Journal::read(path, [&read](Journal::Record const& record) {
+        read.push_back({record.kind, std::string(record.name), std::string(record.data)});
+    });
+    Test::expect(count == read.size(), "the count of records read");
+    return read;
+}
+
+// Bytes of the record of `entry` in the file.
+std::size_t size_of(Entry const& entry)
+{
+    return Journal::record_header + sizeof(std::uint32_t) + entry.name.size() + entry.data.size();
+}
+
+// A journal of long values with a few records, and what it holds.
+std::vector<Entry> write_journal(std::string const& path)
+{
+    std::vector<Entry> written = {
+        {Journal::Kind::base, "long", ""},
+        {Journal::Kind::assign, "a", std::string("\x01\x00\x00\x00\x00\x00\x00\x00", 8)},
+        {Journal::Kind::line, "", "f := a * 2"},
+        {Journal::Kind::assign, "longer_name", std::string(8, '\x7f')},
+        {Journal::Kind::line, "", ":checkpoint"},
+    };
+    Journal journal(path, "long");
+    for (std::size_t i = 1; i < written.size(); i++)
+    {
+        if (written[i].kind == Journal::Kind::assign)
+        {
+            journal.assign(written[i].name, written[i].data);
+        }
+        else
+        {
+            journal.line(written[i].data);
+        }
+    }
+    journal.commit();
+    return written;
+}
+
+void check_torn_tail()
+{
+    TemporaryDirectory directory;
+    std::string path = directory.file("journal");
+    std::vector<Entry> written = write_journal(path);
+    std::string bytes = directory.read("journal");
+    Test::expect(entries(path) == written, "the records written");
+
+    // Cut at every length: the records wholly before the cut are read, and
+    // reopening keeps just those, then appends after them.
+    for (std::size_t size = 0; size <= bytes.size(); size++)
+    {
+        std::string torn = directory.write("torn", bytes.substr(0, size));
+        std::size_t intact = 0;
+        std::size_t end = 0;
+        while (intact < written.size() && end + size_of(written[intact]) <= size)
+        {
+            end += size_of(written[intact]);
+            intact++;
+        }
+        std::string where = " cut at " + std::to_string(size);
+
+        std::vector<Entry> read = entries(torn);
+        Test::expect(read == std::vector<Entry>(written.begin(), written.begin() + long(intact)), "records" + where);
+
+        {
+            Journal journal(torn, "long");
+            journal.line("after");
+            journal.commit();
+        }
+        std::vector<Entry> expected(written.begin(), written.begin() + long(intact));
+        if (intact == 0)
+        {
+            // Nothing was intact, so the journal starts over.
+            expected.push_back(written[0]);
+        }
+        expected.push_back({Journal::Kind::line, "", "after"});
+        Test::expect(entries(torn) == expected, "records appended after reopening" + where);
+    }
+}
+
+void check_damaged_record()
+{
+    TemporaryDirectory directory;
+    std::string path = directory.file("journal");
+    std::vector<Entry> written = write_journal(path);
+    std::string bytes = directory.read("journal");
+
+    // Reading stops at a record whose checksum doesn't match, even with
+    // intact records after it.
+    std::size_t start = size_of(written[0]) + size_of(written[1]);
+    for (std::size_t i = start; i < start + size_of(written[2]); i++)
+    {
+        std::string changed = bytes;
+        changed[i] = char(changed[i] ^ 0x01);
+        std::string damaged = directory.write("damaged", changed);
+        Test::expect(entries(damaged).size() == 2, "records with byte " + std::to_string(i) + " changed");
+    }
+}
+
+void check_recovery()
+{
+    TemporaryDirectory directory;
+    std::string path = directory.file("journal");
+    {
+        BasicCalculator<long> calc;
+        calc.recover(path, "");
+        evaluate(calc, "a = 1");
+        evaluate(calc, "f := a * 2");
+        evaluate(calc, "b = 10");
+        evaluate(calc, ":checkpoint");
+        evaluate(calc, "b = 20");
+        calc.commit();
+    }
+    std::string bytes = directory.read("journal");
+
+    BasicCalculator<long> recovered;
+    recovered.recover(path, "");
+    Test::expect(evaluate(recovered, "f") == "2", "f after recovering");
+    Test::expect(evaluate(recovered, "b") == "20", "b after recovering");
+    evaluate(recovered, ":rollback");
+    Test::expect(evaluate(recovered, "b") == "10", "b after recovering and rolling back");
+
+    // Losing the tail of the last record loses only that change.
+    std::string torn = directory.write("torn", bytes.substr(0, bytes.size() - 3));
+    BasicCalculator<long> partial;
+    partial.recover(torn, "");
+    Test::expect(evaluate(partial, "b") == "10", "b after recovering a torn journal");
+    Test::expect(evaluate(partial, "f") == "2", "f after recovering a torn journal");
+}
+
+}
+
+std::vector<Test> journal_tests()
+{
+    return {
+        Test("journal/torn_tail", check_torn_tail),
+        Test("journal/damaged_record", check_damaged_record),
+        Test("journal/recovery", check_recovery),
+    };
+}
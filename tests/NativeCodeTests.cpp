@@ -0,0 +1,170 @@
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+#include "src/AtomTable.hpp"
+#include "src/Bytecode.hpp"
+#include "src/Calculator.hpp"
+#include "src/Compiler.hpp"
+#include "src/NativeCode.hpp"
+#include "src/Numeric.hpp"
+#include "src/VirtualMachine.hpp"
+
+// NativeCode against the VirtualMachine on random expressions over symbols
+// holding the edges of long, so folding leaves the work to the code: both
+// must give the same value, or both fail with division by zero.
+
+namespace
+{
+
+constexpr char const* symbols[] = {"a", "b", "c", "d", "e"};
+
+class Generator
+{
+private:
+    std::mt19937_64 random;
+
+public:
+    explicit Generator(std::uint64_t seed)
+        : random(seed)
+    {
+    }
+
+    std::string expression(int depth)
+    {
+        if (depth == 0 || random() % 4 == 0)
+        {
+            return leaf();
+        }
+        switch (random() % 10)
+        {
+        case 0:
+            return "-" + expression(depth - 1);
+        case 1:
+            return "~" + expression(depth - 1);
+        case 2:
+            return "(" + expression(depth - 1) + ") ** " + leaf();
+        default:
+            break;
+        }
+        static constexpr char const* infix[] = {" + ", " - ", " * ", " / ", " % "};
+        return "(" + expression(depth - 1) + infix[random() % 5] + expression(depth - 1) + ")";
+    }
+
+    long value()
+    {
+        static constexpr long edges[] = {LONG_MIN, LONG_MIN + 1, LONG_MAX, -1, 0, 1, 2, 3};
+        return random() % 2 == 0 ? edges[random() % 8] : long(random() % 200) - 100;
+    }
+
+private:
+    std::string leaf()
+    {
+        switch (random() % 4)
+        {
+        case 0:
+            return std::to_string(random() % 10);
+        case 1:
+            return "-1";
+        default:
+            return symbols[random() % 5];
+        }
+    }
+};
+
+// What `run` returns, or nullopt when it fails with division by zero.
+template <typename Run>
+std::optional<long> outcome(Run run)
+{
+    try
+    {
+        return run();
+    }
+    catch (Calculator::calculator_error const& ce)
+    {
+        Test::expect(ce.code() == Diagnostic::Code::division_by_zero, std::string("unexpected error: ") + ce.what());
+        return std::nullopt;
+    }
+}
+
+void check_against(std::string const& line, std::vector<std::vector<long>> const& frames)
+{
+    BasicProgram<long> program = Compiler<long>::compile(line);
+    std::optional<NativeCode> native = NativeCode::compile(program);
+    Test::expect(native.has_value(), "compiling " + line);
+
+    std::vector<long> stack(program.scratch_size());
+    std::vector<long> frame;
+    for (auto const& values : frames)
+    {
+        frame.clear();
+        std::string where = line;
+        for (auto symbol : program.symbols)
+        {
+            std::string const& name = AtomTable::name(symbol);
+            long value = values[std::size_t(name[0] - 'a')];
+            frame.push_back(value);
+            where += ", " + name + " = " + std::to_string(value);
+        }
+        std::optional<long> expected = outcome([&] {
+            return VirtualMachine::run(program, frame.data(), stack.data());
+        });
+        std::optional<long> actual = outcome([&] {
+            return native->run(frame.data(), stack.data());
+        });
+        Test::expect(actual == expected, where);
+    }
+}
+
+void check_random()
+{
+    Generator generator(13);
+    std::vector<std::vector<long>> frames(20);
+    for (auto& frame : frames)
+    {
+        for (std::size_t i = 0; i < 5; i++)
+        {
+            frame.push_back(generator.value());
+        }
+    }
+    for (int i = 0; i < 2000; i++)
+    {
+        check_against(generator.expression(5), frames);
+    }
+}
+
+void check_edges()
+{
+    std::vector<std::vector<long>> frames;
+    for (long a : {LONG_MIN, LONG_MIN + 1, LONG_MAX, -7L, -1L, 0L, 1L, 7L})
+    {
+        for (long b : {LONG_MIN, LONG_MAX, -2L, -1L, 0L, 1L, 2L, 3L, 64L})
+        {
+            frames.push_back({a, b, 0, 0, 0});
+        }
+    }
+    for (char const* line : {"a / b", "a % b", "a / -1", "a % -1", "a ** b", "b ** a", "a ** 2 ** 3", "a * b",
+                             "a + b", "a - b", "-a", "~a", "a / (b - b)", "(a % b) + (a / b) * b"})
+    {
+        check_against(line, frames);
+    }
+}
+
+}
+
+std::vector<Test> native_code_tests()
+{
+    if (!NativeCode::supported())
+    {
+        return {};
+    }
+    return {
+        Test("native_code/edges", check_edges),
+        Test("native_code/random", check_random),
+    };
+}
@@ -0,0 +1,169 @@
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Test.hpp"
+#include "src/BatchRunner.hpp"
+#include "src/BigInt.hpp"
+#include "src/Calculator.hpp"
+#include "src/ParallelRunner.hpp"
+
+// ParallelRunner must print exactly what BatchRunner prints for the same
+// script, results and errors alike, whatever the number of workers.
+
+namespace
+{
+
+// Blank lines, commands, definitions and formulas, which end windows or
+// run alone, between lines that windows take.
+std::string const mixed_script =
+    "a = 1\n"
+    "b := a * 2\n"
+    "\n"
+    "b\n"
+    "a = 5\n"
+    "b\n"
+    "c = b + 1\n"
+    "   \n"
+    ":checkpoint\n"
+    "c = c * 10\n"
+    "c\n"
+    ":rollback\n"
+    "c\n"
+    ":rollback\n"
+    "def f(x) = x * x + 1\n"
+    "f(3)\n"
+    "d = f(c)\n"
+    "d\n"
+    "1 / 0\n"
+    "e = (1\n"
+    "undefined_symbol + 1\n"
+    "a = 7\n"
+    "b\n"
+    "\t\n"
+    "f(2)\n"
+    "sum(i, 1, 10, f(i))\n"
+    ":explain a + 1\n"
+    ":nothing\n"
+    "def g(x) = f(x) + a\n"
+    "g(1)\n"
+    "e := d + b\n"
+    "e\n"
+    "d = 0\n"
+    "e\n";
+
+// Lines reading and assigning a few symbols, many of them per window, so
+// lines wait on each other, and some assignments fail. With `formulas`,
+// a formula reads two of the symbols, and lines assigning those run alone.
+std::string random_script(std::size_t lines, bool formulas)
+{
+    std::mt19937_64 random(5);
+    auto any = [&random] {
+        return "v" + std::to_string(random() % 16);
+    };
+
+    std::string script;
+    for (std::size_t i = 0; i < 16; i++)
+    {
+        script += "v" + std::to_string(i) + " = " + std::to_string(i) + "\n";
+    }
+    if (formulas)
+    {
+        script += "w := v1 + v2 * 2\n";
+    }
+    for (std::size_t i = 0; i < lines; i++)
+    {
+        switch (random() % 8)
+        {
+        case 0:
+        case 1:
+        case 2:
+            script += any() + " = (" + any() + " + " + any() + " * 3) % 1000\n";
+            break;
+        case 3:
+            script += any() + " = " + any() + " / (" + any() + " % 3)\n";
+            break;
+        case 4:
+            script += "\n";
+            break;
+        case 5:
+            // Rare, so most windows are long.
+            script += random() % 64 == 0 ? ":checkpoint\n" : any() + " * 2\n";
+            break;
+        default:
+            script += any() + " - " + any() + "\n";
+            break;
+        }
+    }
+    return script;
+}
+
+struct Output
+{
+    std::string results;
+    std::string errors;
+};
+
+// Runs `path` on a new calculator, with BatchRunner when `jobs` is 0.
+template <typename Value>
+Output run(TemporaryDirectory const& directory, std::string const& path, std::size_t jobs)
+{
+    int output_fd = ::open(directory.file("results").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int error_fd = ::open(directory.file("errors").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    Test::expect(output_fd >= 0 && error_fd >= 0, "opening the output files");
+    {
+        BasicCalculator<Value> calculator;
+        if (jobs == 0)
+        {
+            BatchRunner(output_fd, error_fd).run(calculator, path);
+        }
+        else
+        {
+            ParallelRunner<Value>(calculator, jobs, output_fd, error_fd).run(path);
+        }
+    }
+    ::close(output_fd);
+    ::close(error_fd);
+    return {directory.read("results"), directory.read("errors")};
+}
+
+template <typename Value>
+void check_same_output(std::string const& script)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.write("script", script);
+
+    Output serial = run<Value>(directory, path, 0);
+    Test::expect(!serial.results.empty() && !serial.errors.empty(), "the script prints results and errors");
+    for (std::size_t jobs = 1; jobs <= 4; jobs++)
+    {
+        Output parallel = run<Value>(directory, path, jobs);
+        std::string what = " with " + std::to_string(jobs) + " jobs";
+        Test::expect(parallel.results == serial.results, "results" + what);
+        Test::expect(parallel.errors == serial.errors, "errors" + what);
+    }
+}
+
+}
+
+std::vector<Test> parallel_runner_tests()
+{
+    return {
+        Test("parallel_runner/mixed", [] {
+            check_same_output<long>(mixed_script);
+        }),
+        Test("parallel_runner/mixed_bigint", [] {
+            check_same_output<BigInt>(mixed_script);
+        }),
+        Test("parallel_runner/random", [] {
+            check_same_output<long>(random_script(3000, false));
+        }),
+        Test("parallel_runner/random_with_formulas", [] {
+            check_same_output<long>(random_script(3000, true) + "w\n");
+        }),
+    };
+}
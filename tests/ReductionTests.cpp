@@ -0,0 +1,156 @@
+#include <climits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+#include "src/AtomTable.hpp"
+#include "src/BigInt.hpp"
+#include "src/Bytecode.hpp"
+#include "src/Calculator.hpp"
+#include "src/Compiler.hpp"
+#include "src/Decimal.hpp"
+#include "src/Numeric.hpp"
+#include "src/Reduction.hpp"
+#include "src/VirtualMachine.hpp"
+
+// Reductions computed in closed form against the same reductions with the
+// closed form taken away, so the VirtualMachine loops over every index:
+// for each integral type, both must give the same value, wrapping around
+// alike for long and int128, or fail alike.
+
+namespace
+{
+
+// Every line has a closed form for every integral type. Bounds and
+// coefficients are symbols, so nothing is folded.
+std::vector<std::string> const closed_lines = {
+    "sum(i, a, b, 3)",
+    "sum(i, a, b, i)",
+    "sum(i, a, b, i * i * i - 5 * i + c)",
+    "sum(i, a, b, (i + c) ** 3 * 7)",
+    "sum(i, a, b, i * c * c)",
+    "sum(i, a, b, i ** 16)",
+    "prod(i, a, b, c)",
+    "prod(i, a, b, c * c - 1)",
+    "min(i, a, b, c * 2)",
+    "max(i, a, b, c - 7)",
+};
+
+// Lines of degree 1 under min and max: closed only where values don't wrap.
+std::vector<std::string> const line_extremes = {
+    "min(i, a, b, 3 * i - c)",
+    "max(i, a, b, c - i)",
+};
+
+struct Frame
+{
+    long a;
+    long b;
+    long c;
+};
+
+std::vector<Frame> const frames = {
+    {1, 10, 3},
+    {-50, 50, -7},
+    {5, 4, 2},
+    {7, 7, 0},
+    {-3000, 4000, 1L << 40},
+    {1, 100, LONG_MAX},
+    {-100, 100, LONG_MIN},
+};
+
+template <typename Value>
+std::string outcome(BasicProgram<Value> const& program, Frame const& values)
+{
+    std::vector<Value> frame;
+    for (auto symbol : program.symbols)
+    {
+        std::string const& name = AtomTable::name(symbol);
+        long value = name == "a" ? values.a : name == "b" ? values.b : values.c;
+        frame.push_back(Numeric<Value>::from_word(value));
+    }
+    std::vector<Value> stack(program.scratch_size());
+    try
+    {
+        return Numeric<Value>::to_string(VirtualMachine::run(program, frame.data(), stack.data()));
+    }
+    catch (Calculator::calculator_error const& ce)
+    {
+        return std::string("error: ") + ce.what();
+    }
+}
+
+template <typename Value>
+void check_line(std::string const& line, bool closed)
+{
+    std::string where = std::string(Numeric<Value>::name) + ": " + line;
+    BasicProgram<Value> program = Compiler<Value>::compile(line);
+    Test::expect(program.reductions.size() == 1, where + " has a reduction");
+    Test::expect(program.reductions[0]->degree.has_value() == closed,
+                 where + (closed ? " has a closed form" : " has no closed form"));
+    if (!closed)
+    {
+        return;
+    }
+
+    BasicProgram<Value> looped = program;
+    auto reduction = std::make_shared<BasicReduction<Value>>(*looped.reductions[0]);
+    reduction->degree.reset();
+    looped.reductions[0] = reduction;
+
+    for (auto const& values : frames)
+    {
+        std::string expected = outcome(looped, values);
+        std::string actual = outcome(program, values);
+        Test::expect(actual == expected, where + " with a = " + std::to_string(values.a) + ", b = " +
+                     std::to_string(values.b) + ", c = " + std::to_string(values.c) + ": " + actual +
+                     " instead of " + expected);
+    }
+}
+
+template <typename Value>
+void check_type()
+{
+    // Only integral types get closed forms.
+    for (auto const& line : closed_lines)
+    {
+        check_line<Value>(line, Numeric<Value>::integral);
+    }
+    for (auto const& line : line_extremes)
+    {
+        check_line<Value>(line, Numeric<Value>::integral && !Numeric<Value>::wraps);
+    }
+}
+
+void check_wrap_around()
+{
+    // The loop wraps around at every step, and the closed form must land
+    // on the same value, not the exact one.
+    BasicCalculator<long> calc;
+    evaluate(calc, "c = 2 ** 62");
+    Test::expect(evaluate(calc, "sum(i, 1, 4, c)") == "0", "four times 2 ** 62");
+    Test::expect(evaluate(calc, "sum(i, 1, 5, c)") == "4611686018427387904", "five times 2 ** 62");
+    Test::expect(evaluate(calc, "prod(i, 1, 64, 2)") == "0", "2 ** 64");
+    Test::expect(evaluate(calc, "prod(i, 1, 63, 2)") == "-9223372036854775808", "2 ** 63");
+    // 21333341333334000000 less 2 ** 64.
+    Test::expect(evaluate(calc, "sum(i, 1, 4000000, i * i)") == "2886597259624448384",
+                 "a sum of squares past LONG_MAX");
+
+    BasicCalculator<BigInt> exact;
+    Test::expect(evaluate(exact, "prod(i, 1, 64, 2)") == "18446744073709551616", "2 ** 64 in bigint");
+}
+
+}
+
+std::vector<Test> reduction_tests()
+{
+    return {
+        Test("reduction/long", check_type<long>),
+        Test("reduction/int128", check_type<int128>),
+        Test("reduction/bigint", check_type<BigInt>),
+        Test("reduction/double", check_type<double>),
+        Test("reduction/decimal", check_type<Decimal>),
+        Test("reduction/wrap_around", check_wrap_around),
+    };
+}
@@ -0,0 +1,18 @@
+# flake8: noqa
+
+Import('base_env')
+
+tests_env = base_env.Clone()
+
+tests_env.Append(LIBS=['pthread'])
+tests_env['OBJPREFIX'] = tests_env['OBJPREFIX'] + 'tests/'
+
+# The calculator is compiled again, without its main.
+sources = Glob('*.cpp') + [source for source in Glob('#/src/*.cpp') if source.name != 'main.cpp']
+
+tests = tests_env.Program(target='Tests', source=sources)
+
+# scons test builds the tests and runs them.
+tests_env.AlwaysBuild(tests_env.Alias('test', tests, tests[0].abspath))
+
+Return('tests')
@@ -0,0 +1,128 @@
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+#include "src/BigInt.hpp"
+#include "src/Calculator.hpp"
+#include "src/Decimal.hpp"
+#include "src/Numeric.hpp"
+
+// Saving a calculator with :save and restoring it with :load, for every
+// type of value, must give back the same symbols and formulas.
+
+namespace
+{
+
+// Values each type can hold, as lines assigning them.
+std::vector<std::string> const assignments = {
+    "zero = 0",
+    "small = -3",
+    "third = 1 / 3",
+    "big = 123456789 * 1000000007",
+    "bigger = -(2 ** 62 + 2 ** 61)",
+};
+
+template <typename Value>
+void check_round_trip()
+{
+    TemporaryDirectory directory;
+    std::string path = directory.file("saved.snap");
+
+    BasicCalculator<Value> saved;
+    std::vector<std::string> names;
+    for (auto const& line : assignments)
+    {
+        evaluate(saved, line);
+        names.push_back(line.substr(0, line.find(' ')));
+    }
+    // Enough symbols that the index has collisions to probe past.
+    for (int i = 0; i < 1000; i++)
+    {
+        evaluate(saved, "v" + std::to_string(i) + " = " + std::to_string(i * 7919) + " - small");
+        names.push_back("v" + std::to_string(i));
+    }
+    evaluate(saved, "sum := small + big");
+    evaluate(saved, ":save " + path);
+
+    BasicCalculator<Value> loaded;
+    evaluate(loaded, "unsaved = 1");
+    evaluate(loaded, ":load " + path);
+    std::string type = Numeric<Value>::name;
+    for (auto const& name : names)
+    {
+        Test::expect(evaluate(loaded, name) == evaluate(saved, name), type + ": " + name);
+    }
+    Test::expect(evaluate(loaded, "sum") == evaluate(saved, "sum"), type + ": sum");
+    Test::expect(error_of(loaded, "unsaved") == "unsaved is not defined.", type + ": a symbol made before loading");
+
+    // The formula still follows what it reads.
+    evaluate(saved, "small = 4");
+    evaluate(loaded, "small = 4");
+    Test::expect(evaluate(loaded, "sum") == evaluate(saved, "sum"), type + ": sum after assigning");
+
+    // Loading some symbols leaves the others alone.
+    BasicCalculator<Value> some;
+    evaluate(some, "zero = 42");
+    evaluate(some, "v1 = 42");
+    evaluate(some, ":load " + path + " big v7");
+    Test::expect(evaluate(some, "zero") == "42", type + ": a symbol not loaded");
+    Test::expect(evaluate(some, "v1") == "42", type + ": another symbol not loaded");
+    Test::expect(evaluate(some, "big") == evaluate(loaded, "big"), type + ": big loaded by name");
+    Test::expect(evaluate(some, "v7") == evaluate(loaded, "v7"), type + ": v7 loaded by name");
+    Test::expect(!error_of(some, ":load " + path + " missing").empty(), type + ": loading a missing symbol");
+}
+
+void check_refused()
+{
+    TemporaryDirectory directory;
+    std::string path = directory.file("saved.snap");
+    BasicCalculator<long> saved;
+    evaluate(saved, "a = 1");
+    evaluate(saved, "f := a * 2");
+    evaluate(saved, ":save " + path);
+    std::string bytes = directory.read("saved.snap");
+
+    // A snapshot of another type.
+    BasicCalculator<double> other;
+    error_of(other, ":load " + path);
+
+    // Cut short anywhere, or with any byte of its header changed.
+    BasicCalculator<long> calc;
+    evaluate(calc, "a = 5");
+    for (std::size_t size = 0; size < bytes.size(); size += 7)
+    {
+        std::string damaged = directory.write("damaged.snap", bytes.substr(0, size));
+        error_of(calc, ":load " + damaged);
+    }
+    for (std::size_t i = 0; i < 64; i++)
+    {
+        // The type name is read up to its end, leaving the padding after it
+        // unchecked. It starts after the magic, the version and the byte
+        // order.
+        if (i > 16 + std::strlen(Numeric<long>::name) && i < 32)
+        {
+            continue;
+        }
+        std::string changed = bytes;
+        changed[i] = char(changed[i] ^ 0x40);
+        std::string damaged = directory.write("damaged.snap", changed);
+        error_of(calc, ":load " + damaged);
+    }
+    Test::expect(evaluate(calc, "a") == "5", "a after refusing the damaged files");
+}
+
+}
+
+std::vector<Test> snapshot_tests()
+{
+    return {
+        Test("snapshot/long", check_round_trip<long>),
+        Test("snapshot/int128", check_round_trip<int128>),
+        Test("snapshot/double", check_round_trip<double>),
+        Test("snapshot/decimal", check_round_trip<Decimal>),
+        Test("snapshot/bigint", check_round_trip<BigInt>),
+        Test("snapshot/refused", check_refused),
+    };
+}
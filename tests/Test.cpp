@@ -0,0 +1,92 @@
+#include <cerrno>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <stdlib.h>
+
+#include "Test.hpp"
+
+Test::Test(std::string name, body check)
+    : name(std::move(name))
+    , check(std::move(check))
+{
+}
+
+std::string const& Test::get_name() const
+{
+    return name;
+}
+
+std::optional<std::string> Test::run() const
+{
+    try
+    {
+        check();
+    }
+    catch (failure const& f)
+    {
+        return std::string(f.what());
+    }
+    catch (std::exception const& e)
+    {
+        return std::string("unexpected exception: ") + e.what();
+    }
+    return std::nullopt;
+}
+
+void Test::expect(bool condition, std::string const& what)
+{
+    if (!condition)
+    {
+        throw failure(what);
+    }
+}
+
+TemporaryDirectory::TemporaryDirectory()
+    : path("/tmp/calculator-test-XXXXXX")
+{
+    if (::mkdtemp(&path[0]) == nullptr)
+    {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+}
+
+TemporaryDirectory::~TemporaryDirectory()
+{
+    std::error_code ignored;
+    std::filesystem::remove_all(path, ignored);
+}
+
+std::string TemporaryDirectory::file(std::string const& name) const
+{
+    return path + "/" + name;
+}
+
+std::string TemporaryDirectory::write(std::string const& name, std::string const& text) const
+{
+    std::string path = file(name);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+    if (!out.flush())
+    {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    return path;
+}
+
+std::string TemporaryDirectory::read(std::string const& name) const
+{
+    std::string path = file(name);
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
@@ -0,0 +1,93 @@
+#ifndef GUARD_TEST_HPP
+#define GUARD_TEST_HPP
+
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "src/Calculator.hpp"
+
+// A named check of some part of the calculator. The body calls expect()
+// for each thing that should hold; the first one that doesn't ends the
+// test, and so does any exception escaping the body.
+class Test
+{
+public:
+    using body = std::function<void()>;
+
+    // Thrown by expect() when an expectation doesn't hold.
+    class failure : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+private:
+    std::string name;
+    body check;
+
+public:
+    Test(std::string name, body check);
+
+    std::string const& get_name() const;
+
+    // Runs the body, and returns why it failed, if it did.
+    std::optional<std::string> run() const;
+
+    // Fails the test, saying `what`, unless `condition` holds.
+    static void expect(bool condition, std::string const& what);
+};
+
+// A directory of its own under /tmp, removed with everything in it along
+// with the object.
+class TemporaryDirectory
+{
+public:
+    std::string path;
+
+public:
+    TemporaryDirectory();
+    TemporaryDirectory(TemporaryDirectory const&) = delete;
+    ~TemporaryDirectory();
+
+    TemporaryDirectory& operator=(TemporaryDirectory const&) = delete;
+
+    // The path of `name` in the directory.
+    std::string file(std::string const& name) const;
+    // Writes `text` to `name`, and returns its path.
+    std::string write(std::string const& name, std::string const& text) const;
+    // The contents of `name`, which must exist.
+    std::string read(std::string const& name) const;
+};
+
+// What `calculator` shows for `line`, or "" for nothing. Fails the test
+// if the line fails.
+template <typename Value>
+std::string evaluate(BasicCalculator<Value>& calculator, std::string const& line)
+{
+    auto text = calculator.evaluate(line);
+    Test::expect(text.has_value(), line + " failed: " + (text.has_value() ? "" : text.error().message));
+    return text.value().value_or("");
+}
+
+// The error of `line`, which must fail.
+template <typename Value>
+std::string error_of(BasicCalculator<Value>& calculator, std::string const& line)
+{
+    auto text = calculator.evaluate(line);
+    Test::expect(!text.has_value(), line + " should fail");
+    return text.error().message;
+}
+
+// Lists of tests, defined next to the code that sets them up.
+std::vector<Test> column_kernels_tests();
+std::vector<Test> parallel_runner_tests();
+std::vector<Test> checkpoint_tests();
+std::vector<Test> native_code_tests();
+std::vector<Test> snapshot_tests();
+std::vector<Test> journal_tests();
+std::vector<Test> reduction_tests();
+
+#endif
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+
+namespace
+{
+
+void usage(char const* program)
+{
+    std::cerr << "usage: " << program << " [--filter TEXT]" << std::endl;
+}
+
+}
+
+// Runs the tests, reporting each failure and a summary on standard error.
+// Exits with 1 when any test failed.
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    // Only tests whose name contains this run.
+    std::string filter;
+    if (args.size() == 2 && args[0] == "--filter")
+    {
+        filter = args[1];
+    }
+    else if (!args.empty())
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<std::vector<Test>> lists = {
+        column_kernels_tests(),
+        parallel_runner_tests(),
+        checkpoint_tests(),
+        native_code_tests(),
+        snapshot_tests(),
+        journal_tests(),
+        reduction_tests(),
+    };
+
+    std::size_t run = 0;
+    std::size_t failed = 0;
+    for (auto const& tests : lists)
+    {
+        for (auto const& test : tests)
+        {
+            if (test.get_name().find(filter) == std::string::npos)
+            {
+                continue;
+            }
+            run++;
+            if (std::optional<std::string> failure = test.run())
+            {
+                failed++;
+                std::cerr << "FAILED " << test.get_name() << ": " << failure.value() << std::endl;
+            }
+        }
+    }
+    std::cerr << run << " tests, " << failed << " failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}